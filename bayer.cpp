@@ -0,0 +1,517 @@
+// bayer.cpp
+#include "bayer.h"
+#include "kernel_dispatch.h"
+#include "worker_pool.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <linux/videodev2.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BAYER_X86 1
+#include <immintrin.h>
+#define TARGET_SSE41 __attribute__((target("sse4.1")))
+#define TARGET_AVX2  __attribute__((target("avx2")))
+#endif
+
+//
+// === Formats ===
+//
+
+struct BayerFourcc {
+    uint32_t    fourcc;
+    const char* name;
+    BayerFormat fmt;
+};
+
+#define BAYER_DEPTHS(O, o, order)                                                             \
+    {V4L2_PIX_FMT_S##O##8,   "s" o "8",   {order, 8,  BayerPacking::Byte}},                    \
+    {V4L2_PIX_FMT_S##O##10,  "s" o "10",  {order, 10, BayerPacking::Word}},                    \
+    {V4L2_PIX_FMT_S##O##10P, "s" o "10p", {order, 10, BayerPacking::Mipi}},                    \
+    {V4L2_PIX_FMT_S##O##12,  "s" o "12",  {order, 12, BayerPacking::Word}},                    \
+    {V4L2_PIX_FMT_S##O##12P, "s" o "12p", {order, 12, BayerPacking::Mipi}},                    \
+    {V4L2_PIX_FMT_S##O##16,  "s" o "16",  {order, 16, BayerPacking::Word}}
+
+static const BayerFourcc bayer_fourccs[] = {
+    BAYER_DEPTHS(BGGR, "bggr", BayerOrder::Bggr),
+    BAYER_DEPTHS(GBRG, "gbrg", BayerOrder::Gbrg),
+    BAYER_DEPTHS(GRBG, "grbg", BayerOrder::Grbg),
+    BAYER_DEPTHS(RGGB, "rggb", BayerOrder::Rggb),
+};
+
+bool bayer_format(uint32_t pixelformat, BayerFormat& fmt) {
+    for (const BayerFourcc& b : bayer_fourccs)
+        if (b.fourcc == pixelformat) { fmt = b.fmt; return true; }
+    return false;
+}
+
+uint32_t bayer_pixelformat(const char* name) {
+    for (const BayerFourcc& b : bayer_fourccs)
+        if (!strcmp(b.name, name)) return b.fourcc;
+    return 0;
+}
+
+std::vector<uint32_t> bayer_pixelformats() {
+    std::vector<uint32_t> all;
+    for (const BayerFourcc& b : bayer_fourccs) all.push_back(b.fourcc);
+    return all;
+}
+
+bool parse_demosaic(const char* name, Demosaic& mode) {
+    if (!strcmp(name, "bilinear")) mode = Demosaic::Bilinear;
+    else if (!strcmp(name, "edge")) mode = Demosaic::EdgeAware;
+    else return false;
+    return true;
+}
+
+enum { R, G, B };
+
+// Colour of the samples at (x, y); only the parities matter.
+static int cfa(BayerOrder o, int x, int y) {
+    static const uint8_t pattern[4][4] = {
+        {B, G, G, R}, {G, B, R, G}, {G, R, B, G}, {R, G, G, B},
+    };
+    return pattern[int(o)][(y & 1) * 2 + (x & 1)];
+}
+
+//
+// === Unpacking ===
+//
+// Bilinear works on the 8 most significant bits of each sample, edge-aware
+// on all of them. For CSI-2 packing the MSBs are whole bytes, so the 8-bit
+// unpack only drops the LSB bytes.
+
+static void unpack_words_scalar(const uint8_t* s, uint8_t* d, int w, int shift) {
+    for (int i = 0; i < w; ++i)
+        d[i] = uint8_t(std::min(255, (s[2 * i] | s[2 * i + 1] << 8) >> shift));
+}
+
+static void unpack_mipi_scalar(const uint8_t* s, uint8_t* d, int w, int bits) {
+    if (bits == 10)
+        for (int i = 0; i < w; ++i) d[i] = s[i / 4 * 5 + i % 4];
+    else
+        for (int i = 0; i < w; ++i) d[i] = s[i / 2 * 3 + i % 2];
+}
+
+static void unpack16(const uint8_t* s, uint16_t* d, int w, const BayerFormat& f) {
+    const int maxv = (1 << f.bits) - 1;
+    switch (f.packing) {
+    case BayerPacking::Byte:
+        std::copy(s, s + w, d);
+        break;
+    case BayerPacking::Word:
+        for (int i = 0; i < w; ++i) d[i] = uint16_t(std::min(maxv, s[2 * i] | s[2 * i + 1] << 8));
+        break;
+    case BayerPacking::Mipi:
+        if (f.bits == 10)
+            for (int i = 0; i < w; ++i) {
+                const uint8_t* g = s + i / 4 * 5;
+                d[i] = uint16_t(g[i % 4] << 2 | (g[4] >> (i % 4 * 2) & 3));
+            }
+        else
+            for (int i = 0; i < w; ++i) {
+                const uint8_t* g = s + i / 2 * 3;
+                d[i] = uint16_t(g[i % 2] << 4 | (g[2] >> (i % 2 * 4) & 15));
+            }
+        break;
+    }
+}
+
+//
+// === Bilinear ===
+//
+// For a row whose samples alternate between green and N (red or blue),
+// with O the remaining colour:
+//   at N sites:  N = C,  G = avg(H, V),  O = avg of the four diagonals
+//   at G sites:  G = C,  N = H,          O = V
+// where H and V average the left/right and up/down neighbours. Averages
+// round up, two at a time, exactly like pavgb, so the SIMD kernels match
+// the scalar one byte for byte.
+
+static inline uint8_t avg(uint8_t a, uint8_t b) {
+    return uint8_t((a + b + 1) >> 1);
+}
+
+// Output pixels [x0, w) of the row at `d`; x0 is even. `up`, `cur` and
+// `dn` have mirrored samples at -1 and w.
+static void bilinear_row_scalar(const uint8_t* up, const uint8_t* cur, const uint8_t* dn,
+                                uint8_t* d, int x0, int w, bool green_even, bool red_row) {
+    d += x0 * 3;
+    for (int x = x0; x < w; ++x, d += 3) {
+        const uint8_t h = avg(cur[x - 1], cur[x + 1]), v = avg(up[x], dn[x]);
+        uint8_t n, g, o;
+        if (((x & 1) == 0) == green_even) {
+            n = h; g = cur[x]; o = v;
+        } else {
+            n = cur[x]; g = avg(h, v);
+            o = avg(avg(up[x - 1], up[x + 1]), avg(dn[x - 1], dn[x + 1]));
+        }
+        d[0] = red_row ? n : o;
+        d[1] = g;
+        d[2] = red_row ? o : n;
+    }
+}
+
+#ifdef BAYER_X86
+
+// pshufb masks that interleave 16 R, 16 G and 16 B bytes into 48 bytes of
+// RGB24: [output block][channel].
+struct InterleaveMasks {
+    int8_t m[3][3][16];
+};
+
+static constexpr InterleaveMasks interleave_masks() {
+    InterleaveMasks t{};
+    for (int j = 0; j < 3; ++j)
+        for (int c = 0; c < 3; ++c)
+            for (int k = 0; k < 16; ++k) {
+                const int i = 16 * j + k;
+                t.m[j][c][k] = int8_t(i % 3 == c ? i / 3 : -1);
+            }
+    return t;
+}
+
+alignas(16) static constexpr InterleaveMasks rgb_masks = interleave_masks();
+
+TARGET_SSE41 static inline __m128i load16(const uint8_t* p) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+}
+
+TARGET_SSE41 static inline __m128i mask16(int j, int c) {
+    return _mm_load_si128(reinterpret_cast<const __m128i*>(rgb_masks.m[j][c]));
+}
+
+TARGET_SSE41 static void unpack_words_sse41(const uint8_t* s, uint8_t* d, int w, int shift) {
+    const __m128i count = _mm_cvtsi32_si128(shift);
+    int i = 0;
+    for (; i + 16 <= w; i += 16) {
+        __m128i lo = _mm_srl_epi16(load16(s + 2 * i), count);
+        __m128i hi = _mm_srl_epi16(load16(s + 2 * i + 16), count);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(d + i), _mm_packus_epi16(lo, hi));
+    }
+    unpack_words_scalar(s + 2 * i, d + i, w - i, shift);
+}
+
+// One 16-byte load holds three whole 10-bit groups (12 samples) or five
+// 12-bit ones (10 samples). The store writes 16 bytes; the next iteration
+// overwrites the 4 or 6 that are not samples.
+TARGET_SSE41 static void unpack_mipi_sse41(const uint8_t* s, uint8_t* d, int w, int bits) {
+    int i = 0;
+    if (bits == 10) {
+        const __m128i m = _mm_setr_epi8(0, 1, 2, 3, 5, 6, 7, 8, 10, 11, 12, 13, -1, -1, -1, -1);
+        for (; i + 16 <= w; i += 12)
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(d + i),
+                             _mm_shuffle_epi8(load16(s + i / 4 * 5), m));
+    } else {
+        const __m128i m = _mm_setr_epi8(0, 1, 3, 4, 6, 7, 9, 10, 12, 13, -1, -1, -1, -1, -1, -1);
+        for (; i + 16 <= w; i += 10)
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(d + i),
+                             _mm_shuffle_epi8(load16(s + i / 2 * 3), m));
+    }
+    // i is a multiple of the group size, so the rest starts on a group.
+    unpack_mipi_scalar(s + (bits == 10 ? i / 4 * 5 : i / 2 * 3), d + i, w - i, bits);
+}
+
+TARGET_SSE41 static void bilinear_row_sse41(const uint8_t* up, const uint8_t* cur,
+                                            const uint8_t* dn, uint8_t* d, int x0, int w,
+                                            bool green_even, bool red_row) {
+    // Blend masks select the green sites; x is even at byte 0.
+    const __m128i gmask = _mm_set1_epi16(int16_t(green_even ? 0x00ff : 0xff00));
+    int x = x0;
+    for (; x + 16 <= w; x += 16) {
+        const __m128i c  = load16(cur + x);
+        const __m128i h  = _mm_avg_epu8(load16(cur + x - 1), load16(cur + x + 1));
+        const __m128i v  = _mm_avg_epu8(load16(up + x), load16(dn + x));
+        const __m128i dg = _mm_avg_epu8(_mm_avg_epu8(load16(up + x - 1), load16(up + x + 1)),
+                                        _mm_avg_epu8(load16(dn + x - 1), load16(dn + x + 1)));
+        const __m128i n = _mm_blendv_epi8(c, h, gmask);
+        const __m128i g = _mm_blendv_epi8(_mm_avg_epu8(h, v), c, gmask);
+        const __m128i o = _mm_blendv_epi8(dg, v, gmask);
+        const __m128i r = red_row ? n : o, b = red_row ? o : n;
+        for (int j = 0; j < 3; ++j) {
+            __m128i out = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r, mask16(j, R)),
+                                                    _mm_shuffle_epi8(g, mask16(j, G))),
+                                       _mm_shuffle_epi8(b, mask16(j, B)));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(d + x * 3 + 16 * j), out);
+        }
+    }
+    bilinear_row_scalar(up, cur, dn, d, x, w, green_even, red_row);
+}
+
+TARGET_AVX2 static inline __m256i load32(const uint8_t* p) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+}
+
+TARGET_AVX2 static void unpack_words_avx2(const uint8_t* s, uint8_t* d, int w, int shift) {
+    const __m128i count = _mm_cvtsi32_si128(shift);
+    int i = 0;
+    for (; i + 32 <= w; i += 32) {
+        __m256i lo = _mm256_srl_epi16(load32(s + 2 * i), count);
+        __m256i hi = _mm256_srl_epi16(load32(s + 2 * i + 32), count);
+        // packus interleaves the 128-bit lanes; put them back in order.
+        __m256i out = _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi), _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(d + i), out);
+    }
+    _mm256_zeroupper();   // before the SSE tail, see kernel_dispatch.h
+    unpack_words_sse41(s + 2 * i, d + i, w - i, shift);
+}
+
+// 32 pixels; pshufb stays within 128-bit lanes, so each lane interleaves
+// its own 16 pixels into 48 bytes.
+TARGET_AVX2 static void bilinear_row_avx2(const uint8_t* up, const uint8_t* cur,
+                                          const uint8_t* dn, uint8_t* d, int x0, int w,
+                                          bool green_even, bool red_row) {
+    const __m256i gmask = _mm256_set1_epi16(int16_t(green_even ? 0x00ff : 0xff00));
+    int x = x0;
+    for (; x + 32 <= w; x += 32) {
+        const __m256i c  = load32(cur + x);
+        const __m256i h  = _mm256_avg_epu8(load32(cur + x - 1), load32(cur + x + 1));
+        const __m256i v  = _mm256_avg_epu8(load32(up + x), load32(dn + x));
+        const __m256i dg = _mm256_avg_epu8(_mm256_avg_epu8(load32(up + x - 1), load32(up + x + 1)),
+                                           _mm256_avg_epu8(load32(dn + x - 1), load32(dn + x + 1)));
+        const __m256i n = _mm256_blendv_epi8(c, h, gmask);
+        const __m256i g = _mm256_blendv_epi8(_mm256_avg_epu8(h, v), c, gmask);
+        const __m256i o = _mm256_blendv_epi8(dg, v, gmask);
+        const __m256i r = red_row ? n : o, b = red_row ? o : n;
+        for (int j = 0; j < 3; ++j) {
+            const __m256i mr = _mm256_broadcastsi128_si256(mask16(j, R));
+            const __m256i mg = _mm256_broadcastsi128_si256(mask16(j, G));
+            const __m256i mb = _mm256_broadcastsi128_si256(mask16(j, B));
+            __m256i out = _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(r, mr),
+                                                          _mm256_shuffle_epi8(g, mg)),
+                                          _mm256_shuffle_epi8(b, mb));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(d + x * 3 + 16 * j),
+                             _mm256_castsi256_si128(out));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(d + x * 3 + 48 + 16 * j),
+                             _mm256_extracti128_si256(out, 1));
+        }
+    }
+    _mm256_zeroupper();   // before the SSE tail, see kernel_dispatch.h
+    bilinear_row_sse41(up, cur, dn, d, x, w, green_even, red_row);
+}
+
+#endif // BAYER_X86
+
+//
+// === Dispatch ===
+//
+
+struct BayerKernel {
+    const char* name;
+    void (*unpack_words)(const uint8_t*, uint8_t*, int, int);
+    void (*unpack_mipi)(const uint8_t*, uint8_t*, int, int);
+    void (*bilinear_row)(const uint8_t*, const uint8_t*, const uint8_t*, uint8_t*, int, int,
+                         bool, bool);
+    bool supported;
+};
+
+static BayerKernel pick_kernel() {
+#ifdef BAYER_X86
+    __builtin_cpu_init();
+    const BayerKernel kernels[] = {
+        {"avx2", unpack_words_avx2, unpack_mipi_sse41, bilinear_row_avx2,
+         bool(__builtin_cpu_supports("avx2"))},
+        {"sse4.1", unpack_words_sse41, unpack_mipi_sse41, bilinear_row_sse41,
+         bool(__builtin_cpu_supports("sse4.1"))},
+        {"scalar", unpack_words_scalar, unpack_mipi_scalar, bilinear_row_scalar, true},
+    };
+#else
+    const BayerKernel kernels[] = {
+        {"scalar", unpack_words_scalar, unpack_mipi_scalar, bilinear_row_scalar, true},
+    };
+#endif
+    return select_kernel(kernels, "BAYER_ISA");
+}
+
+static const BayerKernel& kernel() {
+    static const BayerKernel k = pick_kernel();
+    return k;
+}
+
+const char* bayer_isa() {
+    return kernel().name;
+}
+
+//
+// === Row rings ===
+//
+
+struct BayerJob {
+    const uint8_t* src;
+    size_t         src_stride;
+    uint8_t*       dst;
+    size_t         dst_stride;
+    int            width, height;
+    BayerFormat    fmt;
+};
+
+// Samples mirrored on either side of an unpacked row.
+constexpr int PAD = 2;
+
+// Mirror row v into 0..n-1 about the first and last row, which keeps its
+// colour phase.
+static inline int mirror(int v, int n) {
+    if (v < 0) v = -v;
+    if (v >= n) v = 2 * (n - 1) - v;
+    return v;
+}
+
+template <typename T>
+static void pad_row(T* row, int w) {
+    row[-1] = row[1];
+    row[-2] = row[2];
+    row[w]     = row[w - 2];
+    row[w + 1] = row[w - 3];
+}
+
+// Ring of `n` padded rows, addressed by (virtual) row number.
+template <typename T>
+struct RowRing {
+    std::vector<T>& buf;
+    size_t          row_size;
+    int             n;
+
+    RowRing(std::vector<T>& storage, int width, int rows)
+        : buf(storage), row_size(size_t(width) + 2 * PAD), n(rows) {
+        buf.resize(row_size * n);
+    }
+    T* operator[](int v) const {
+        return buf.data() + size_t(((v % n) + n) % n) * row_size + PAD;
+    }
+};
+
+static void load_row8(const BayerJob& j, const BayerKernel& k, uint8_t* row, int v) {
+    const uint8_t* s = j.src + size_t(mirror(v, j.height)) * j.src_stride;
+    switch (j.fmt.packing) {
+    case BayerPacking::Byte: memcpy(row, s, j.width);                         break;
+    case BayerPacking::Word: k.unpack_words(s, row, j.width, j.fmt.bits - 8); break;
+    case BayerPacking::Mipi: k.unpack_mipi(s, row, j.width, j.fmt.bits);      break;
+    }
+    pad_row(row, j.width);
+}
+
+static void load_row16(const BayerJob& j, uint16_t* row, int v) {
+    unpack16(j.src + size_t(mirror(v, j.height)) * j.src_stride, row, j.width, j.fmt);
+    pad_row(row, j.width);
+}
+
+static void bilinear_rows(const BayerJob& j, int y0, int y1) {
+    const BayerKernel& k = kernel();
+    thread_local std::vector<uint8_t> storage;
+    RowRing<uint8_t> rows(storage, j.width, 3);
+    load_row8(j, k, rows[y0 - 1], y0 - 1);
+    load_row8(j, k, rows[y0], y0);
+    for (int y = y0; y < y1; ++y) {
+        load_row8(j, k, rows[y + 1], y + 1);
+        const bool green_even = cfa(j.fmt.order, 0, y) == G;
+        const bool red_row    = cfa(j.fmt.order, green_even ? 1 : 0, y) == R;
+        k.bilinear_row(rows[y - 1], rows[y], rows[y + 1], j.dst + size_t(y) * j.dst_stride,
+                       0, j.width, green_even, red_row);
+    }
+}
+
+//
+// === Edge-aware ===
+//
+// Hamilton-Adams: at a red or blue site, green is estimated horizontally
+// and vertically, each as the average of the two greens plus a Laplacian
+// correction from the site's own colour, and the direction with the
+// smaller gradient wins (both are averaged on a tie). Red and blue are
+// then green plus the interpolated (colour - green) difference, which
+// keeps colour fringes off edges.
+
+static void green_row(const BayerJob& j, const RowRing<uint16_t>& raw, uint16_t* g, int v) {
+    const uint16_t *u2 = raw[v - 2], *u1 = raw[v - 1], *c = raw[v], *d1 = raw[v + 1],
+                   *d2 = raw[v + 2];
+    const int maxv = (1 << j.fmt.bits) - 1;
+    const int x_green = cfa(j.fmt.order, 0, v) == G ? 0 : 1;
+    for (int x = 0; x < j.width; ++x) {
+        if ((x & 1) == x_green) {
+            g[x] = c[x];
+            continue;
+        }
+        const int lap_h = 2 * c[x] - c[x - 2] - c[x + 2];
+        const int lap_v = 2 * c[x] - u2[x] - d2[x];
+        const int dh = std::abs(c[x - 1] - c[x + 1]) + std::abs(lap_h);
+        const int dv = std::abs(u1[x] - d1[x]) + std::abs(lap_v);
+        const int gh = 2 * (c[x - 1] + c[x + 1]) + lap_h;    // 4x the estimate
+        const int gv = 2 * (u1[x] + d1[x]) + lap_v;
+        const int g8 = dh < dv ? 2 * gh : dv < dh ? 2 * gv : gh + gv;
+        g[x] = uint16_t(std::clamp((g8 + 4) >> 3, 0, maxv));
+    }
+    pad_row(g, j.width);
+}
+
+static void edge_aware_row(const BayerJob& j, const RowRing<uint16_t>& raw,
+                           const RowRing<uint16_t>& green, int y) {
+    const uint16_t *ru = raw[y - 1], *rc = raw[y], *rd = raw[y + 1];
+    const uint16_t *gu = green[y - 1], *gc = green[y], *gd = green[y + 1];
+    const int maxv  = (1 << j.fmt.bits) - 1;
+    const int shift = j.fmt.bits - 8;
+    const int col[2]  = {cfa(j.fmt.order, 0, y), cfa(j.fmt.order, 1, y)};
+    const int vcol[2] = {cfa(j.fmt.order, 0, y + 1), cfa(j.fmt.order, 1, y + 1)};
+    uint8_t* d = j.dst + size_t(y) * j.dst_stride;
+    for (int x = 0; x < j.width; ++x, d += 3) {
+        const int own = col[x & 1];
+        int rgb[3];
+        rgb[G] = gc[x];
+        if (own == G) {
+            // The left/right neighbours have one colour, up/down the other.
+            const int dh = rc[x - 1] - gc[x - 1] + rc[x + 1] - gc[x + 1];
+            const int dv = ru[x] - gu[x] + rd[x] - gd[x];
+            rgb[col[(x + 1) & 1]] = gc[x] + ((dh + 1) >> 1);
+            rgb[vcol[x & 1]]      = gc[x] + ((dv + 1) >> 1);
+        } else {
+            const int dd = ru[x - 1] - gu[x - 1] + ru[x + 1] - gu[x + 1] +
+                           rd[x - 1] - gd[x - 1] + rd[x + 1] - gd[x + 1];
+            rgb[own]     = rc[x];
+            rgb[2 - own] = gc[x] + ((dd + 2) >> 2);
+        }
+        for (int i = 0; i < 3; ++i) d[i] = uint8_t(std::clamp(rgb[i], 0, maxv) >> shift);
+    }
+}
+
+// Output row y needs green rows y-1..y+1, and green row y+1 needs raw rows
+// y-1..y+3, so five raw rows and three green rows are enough.
+static void edge_aware_rows(const BayerJob& j, int y0, int y1) {
+    thread_local std::vector<uint16_t> raw_storage, green_storage;
+    RowRing<uint16_t> raw(raw_storage, j.width, 5);
+    RowRing<uint16_t> green(green_storage, j.width, 3);
+    for (int v = y0 - 3; v <= y0 + 1; ++v) load_row16(j, raw[v], v);
+    green_row(j, raw, green[y0 - 1], y0 - 1);
+    load_row16(j, raw[y0 + 2], y0 + 2);
+    green_row(j, raw, green[y0], y0);
+    for (int y = y0; y < y1; ++y) {
+        load_row16(j, raw[y + 3], y + 3);
+        green_row(j, raw, green[y + 1], y + 1);
+        edge_aware_row(j, raw, green, y);
+    }
+}
+
+//
+// === Frame entry point ===
+//
+
+void bayer_to_rgb24(const uint8_t* src, size_t src_stride, uint8_t* dst, size_t dst_stride,
+                    int width, int height, BayerFormat fmt, Demosaic mode, WorkerPool& pool) {
+    if (width < 4 || height < 4) return;
+    const BayerJob j{src, src_stride, dst, dst_stride, width, height, fmt};
+    // Every stripe re-reads a few rows above and below it, so keep stripes
+    // at least 32 rows tall; a few per thread balance the load.
+    in_stripes(height, 32, pool, [&](int y0, int y1) {
+        if (mode == Demosaic::Bilinear)
+            bilinear_rows(j, y0, y1);
+        else
+            edge_aware_rows(j, y0, y1);
+    });
+}
+
+bool bayer_to_rgb24(const FrameView& src, uint8_t* dst, size_t dst_stride, Demosaic mode,
+                    WorkerPool& pool) {
+    BayerFormat fmt;
+    if (!bayer_format(src.pixelformat, fmt)) return false;
+    bayer_to_rgb24(src.plane[0], src.stride[0], dst, dst_stride, src.width, src.height, fmt,
+                   mode, pool);
+    return true;
+}
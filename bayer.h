@@ -0,0 +1,78 @@
+// bayer.h
+//
+// Raw Bayer (colour filter array) frames to RGB24, for sensors that only
+// expose their raw output. Samples may be 8-bit, 10/12/16-bit in 16-bit
+// little-endian words, or MIPI CSI-2 packed 10/12-bit (the ...10P/...12P
+// formats); each row is unpacked and then demosaiced:
+//   - Bilinear: every missing colour is the rounded average of its nearest
+//     neighbours of that colour, on the 8 most significant bits. SIMD
+//     (SSE4.1, AVX2), for live preview.
+//   - EdgeAware: green is interpolated along the direction with the
+//     smaller gradient (Hamilton-Adams), red and blue from their
+//     differences to green, at the full sample depth. Scalar and about
+//     twenty times the cost of bilinear, for stills.
+//
+// Frames are converted in row stripes on a WorkerPool. A stripe keeps a
+// small ring of unpacked rows (3 for bilinear, 5 raw + 3 green for
+// edge-aware) and reads each source row once, so its working set is a few
+// rows whatever the sensor size and a 12 MP frame streams through L1/L2.
+// Borders are mirrored, which keeps the colour phase.
+//
+// Set BAYER_ISA=scalar|sse4.1|avx2 in the environment to force a narrower
+// bilinear kernel; they all produce the same bytes.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "frame_view.h"
+
+class WorkerPool;
+
+// Colours of the top-left 2x2 block, row by row.
+enum class BayerOrder { Bggr, Gbrg, Grbg, Rggb };
+
+enum class BayerPacking {
+    Byte,   // one 8-bit sample per byte
+    Word,   // one sample per 16-bit little-endian word, `bits` significant
+    Mipi,   // CSI-2: 10-bit as 4 MSB bytes + 1 LSB byte, 12-bit as 2 + 1
+};
+
+struct BayerFormat {
+    BayerOrder   order   = BayerOrder::Bggr;
+    int          bits    = 8;
+    BayerPacking packing = BayerPacking::Byte;
+};
+
+enum class Demosaic { Bilinear, EdgeAware };
+
+// Layout of a V4L2 Bayer fourcc (SBGGR8 .. SRGGB16, including the ...10P
+// and ...12P packed ones); false for anything else.
+bool bayer_format(uint32_t pixelformat, BayerFormat& fmt);
+inline bool is_bayer(uint32_t pixelformat) {
+    BayerFormat f;
+    return bayer_format(pixelformat, f);
+}
+
+// Fourcc for a lower-case name such as "sbggr8", "srggb10" or "srggb10p";
+// 0 if unknown.
+uint32_t bayer_pixelformat(const char* name);
+// Every fourcc bayer_format() accepts, e.g. for CaptureConfig::formats.
+std::vector<uint32_t> bayer_pixelformats();
+
+// "bilinear" or "edge"; false if unknown.
+bool parse_demosaic(const char* name, Demosaic& mode);
+
+// Demosaic `width` x `height` samples (both even, at least 4; a multiple
+// of 4 wide for ...10P, as CSI-2 requires) into RGB24, in row stripes on
+// `pool`. Strides are in bytes.
+void bayer_to_rgb24(const uint8_t* src, size_t src_stride, uint8_t* dst, size_t dst_stride,
+                    int width, int height, BayerFormat fmt, Demosaic mode, WorkerPool& pool);
+
+// Same, for a view of a Bayer format; false (and nothing written) for any
+// other pixel format.
+bool bayer_to_rgb24(const FrameView& src, uint8_t* dst, size_t dst_stride, Demosaic mode,
+                    WorkerPool& pool);
+
+// Name of the bilinear kernel in use: "avx2", "sse4.1" or "scalar".
+const char* bayer_isa();
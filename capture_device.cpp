@@ -0,0 +1,570 @@
+// capture_device.cpp
+#include "capture_device.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+static int xioctl(int fd, unsigned long request, void* arg) {
+    int r;
+    do {
+        r = ioctl(fd, request, arg);
+    } while (r == -1 && errno == EINTR);
+    return r;
+}
+
+//
+// === Frame ===
+//
+
+Frame::Frame(CaptureDevice* dev, const v4l2_buffer& buf, const v4l2_plane* planes,
+             void* const* plane_starts, const int* plane_fds)
+    : dev_(dev), buf_(buf) {
+    if (V4L2_TYPE_IS_MULTIPLANAR(buf.type)) {
+        num_planes_ = buf.length;
+        for (unsigned p = 0; p < num_planes_; ++p) {
+            planes_[p]     = planes[p];
+            plane_data_[p] = static_cast<const uint8_t*>(plane_starts[p]) + planes[p].data_offset;
+            plane_fd_[p]   = plane_fds[p];
+        }
+        buf_.m.planes = planes_;
+    } else {
+        num_planes_    = 1;
+        plane_data_[0] = static_cast<const uint8_t*>(plane_starts[0]);
+        plane_fd_[0]   = plane_fds[0];
+    }
+}
+
+size_t Frame::plane_size(unsigned p) const {
+    if (!V4L2_TYPE_IS_MULTIPLANAR(buf_.type)) return buf_.bytesused;
+    // An empty or failed buffer can report less than its data offset.
+    const v4l2_plane& pl = planes_[p];
+    return pl.bytesused > pl.data_offset ? pl.bytesused - pl.data_offset : 0;
+}
+
+// Planar YUV layouts: chroma planes after the first have `rows_div` times
+// fewer rows and `stride_div` times narrower rows than bytesperline says.
+// In the single-buffer variants they follow each other directly, as the
+// V4L2 format descriptions define.
+struct PlaneLayout {
+    uint32_t fourcc;
+    unsigned planes;
+    unsigned rows_div, stride_div;
+};
+
+static const PlaneLayout plane_layouts[] = {
+    {V4L2_PIX_FMT_NV12, 2, 2, 1},    {V4L2_PIX_FMT_NV21, 2, 2, 1},
+    {V4L2_PIX_FMT_NV12M, 2, 2, 1},   {V4L2_PIX_FMT_NV21M, 2, 2, 1},
+    {V4L2_PIX_FMT_P010, 2, 2, 1},    {V4L2_PIX_FMT_NV16, 2, 1, 1},
+    {V4L2_PIX_FMT_NV61, 2, 1, 1},    {V4L2_PIX_FMT_NV16M, 2, 1, 1},
+    {V4L2_PIX_FMT_NV61M, 2, 1, 1},   {V4L2_PIX_FMT_YUV420, 3, 2, 2},
+    {V4L2_PIX_FMT_YVU420, 3, 2, 2},  {V4L2_PIX_FMT_YUV420M, 3, 2, 1},
+    {V4L2_PIX_FMT_YVU420M, 3, 2, 1}, {V4L2_PIX_FMT_YUV422P, 3, 1, 2},
+    {V4L2_PIX_FMT_YUV422M, 3, 1, 1},
+};
+
+FrameView Frame::view() const {
+    FrameView v;
+    if (!dev_) return v;
+    v.pixelformat = dev_->pixelformat();
+    v.width       = int(dev_->width());
+    v.height      = int(dev_->height());
+
+    PlaneLayout layout{v.pixelformat, 1, 1, 1};
+    for (const PlaneLayout& l : plane_layouts)
+        if (l.fourcc == v.pixelformat) layout = l;
+    v.num_planes = layout.planes;
+
+    // The ...M formats have one buffer plane (and bytesperline) per image
+    // plane; the others pack every image plane into buffer plane 0.
+    size_t need[3]{}, offset = 0;
+    for (unsigned p = 0; p < layout.planes; ++p) {
+        const size_t rows = p ? (size_t(v.height) + layout.rows_div - 1) / layout.rows_div
+                              : size_t(v.height);
+        if (num_planes_ > 1) {
+            if (p >= num_planes_) return {};
+            v.plane[p]  = plane_data_[p];
+            v.stride[p] = dev_->bytesperline(p);
+            need[p]     = v.stride[p] * rows;
+        } else {
+            v.plane[p]  = plane_data_[0] + offset;
+            v.stride[p] = p ? dev_->bytesperline() / layout.stride_div : dev_->bytesperline();
+            offset     += v.stride[p] * rows;
+            need[0]     = offset;
+        }
+    }
+    for (unsigned p = 0; p < num_planes_ && p < 3; ++p)
+        if (plane_size(p) < need[p]) return {};
+    return v;
+}
+
+void Frame::take(Frame& other) {
+    dev_        = other.dev_;
+    buf_        = other.buf_;
+    num_planes_ = other.num_planes_;
+    for (unsigned p = 0; p < num_planes_; ++p) {
+        planes_[p]     = other.planes_[p];
+        plane_data_[p] = other.plane_data_[p];
+        plane_fd_[p]   = other.plane_fd_[p];
+    }
+    if (V4L2_TYPE_IS_MULTIPLANAR(buf_.type)) buf_.m.planes = planes_;
+    other.dev_           = nullptr;
+    other.plane_data_[0] = nullptr;
+    other.num_planes_    = 0;
+}
+
+Frame::Frame(Frame&& other) noexcept {
+    take(other);
+}
+
+Frame& Frame::operator=(Frame&& other) noexcept {
+    if (this != &other) {
+        release();
+        take(other);
+    }
+    return *this;
+}
+
+void Frame::release() {
+    if (!dev_) return;
+    dev_->requeue(buf_);
+    dev_           = nullptr;
+    plane_data_[0] = nullptr;
+    num_planes_    = 0;
+}
+
+//
+// === CaptureDevice ===
+//
+
+bool CaptureDevice::open(const CaptureConfig& cfg) {
+    close();
+
+    fd_ = ::open(cfg.device.c_str(), O_RDWR);
+    if (fd_ < 0) { perror(cfg.device.c_str()); return false; }
+
+    // 1) Query capabilities
+    v4l2_capability caps{};
+    if (xioctl(fd_, VIDIOC_QUERYCAP, &caps) < 0) {
+        perror("VIDIOC_QUERYCAP"); close(); return false;
+    }
+    // Prefer the single-planar API; fall back to MPLANE for devices that
+    // only implement that one.
+    uint32_t dev_caps = (caps.capabilities & V4L2_CAP_DEVICE_CAPS) ? caps.device_caps
+                                                                    : caps.capabilities;
+    if (dev_caps & V4L2_CAP_VIDEO_CAPTURE) {
+        fmt_.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    } else if (dev_caps & V4L2_CAP_VIDEO_CAPTURE_MPLANE) {
+        fmt_.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+    } else {
+        fprintf(stderr, "%s is no video capture device\n", cfg.device.c_str());
+        close(); return false;
+    }
+    if (!(dev_caps & V4L2_CAP_STREAMING)) {
+        fprintf(stderr, "%s does not support streaming i/o\n", cfg.device.c_str());
+        close(); return false;
+    }
+
+    // 2) Set format
+    if (!set_format(cfg)) { close(); return false; }
+
+    // 3) Request MMAP or USERPTR buffers
+    if (cfg.userptr && (cfg.export_dmabuf || cfg.buffer_budget)) {
+        fprintf(stderr, "userptr capture cannot export or add buffers\n");
+        close(); return false;
+    }
+    memory_ = cfg.userptr ? V4L2_MEMORY_USERPTR : V4L2_MEMORY_MMAP;
+    v4l2_requestbuffers req{};
+    req.count  = cfg.num_buffers;
+    req.type   = fmt_.type;
+    req.memory = memory_;
+    if (xioctl(fd_, VIDIOC_REQBUFS, &req) < 0) {
+        perror(cfg.userptr ? "VIDIOC_REQBUFS (USERPTR)" : "VIDIOC_REQBUFS");
+        close(); return false;
+    }
+    if (req.count < 1) {
+        fprintf(stderr, "Insufficient buffer memory on %s\n", cfg.device.c_str());
+        close(); return false;
+    }
+
+    frame_stats_init(&stats_);
+
+    // 4) Map (and optionally export) them. USERPTR buffers get their
+    // memory from set_userptr() later.
+    export_dmabuf_ = cfg.export_dmabuf;
+    buffers_.reserve(VIDEO_MAX_FRAME);
+    for (uint32_t i = 0; i < req.count; ++i) {
+        if (memory_ == V4L2_MEMORY_USERPTR) {
+            Buffer b{};
+            b.num_planes = num_planes();
+            for (unsigned p = 0; p < b.num_planes; ++p) b.dmabuf_fd[p] = -1;
+            buffers_.push_back(b);
+            nbuffers_.store(buffers_.size(), std::memory_order_relaxed);
+        } else if (!map_buffer(i)) {
+            close(); return false;
+        }
+    }
+
+    buffer_budget_     = cfg.buffer_budget;
+    seen_driver_drops_ = 0;
+    return true;
+}
+
+// The driver may adjust every field, so keep what it returns rather than
+// what we asked for.
+bool CaptureDevice::set_format(const CaptureConfig& cfg) {
+    const uint32_t type = fmt_.type;
+
+    if (cfg.goal != CaptureGoal::None) {
+        ModeRequest req;
+        req.goal    = cfg.goal;
+        req.width   = cfg.width;
+        req.height  = cfg.height;
+        req.min_fps = cfg.fps;
+        req.formats = cfg.formats;
+        CaptureMode mode;
+        if (!negotiate_format(fd_, req, fmt_, &mode, type)) return false;
+        // The driver may still have adjusted the size; report what it applied.
+        fprintf(stderr, "%s: negotiated %s %ux%u @ %.2f fps\n", cfg.device.c_str(),
+                fourcc_to_string(pixelformat()).c_str(), width(), height(), mode.fps());
+        return align_strides(cfg);
+    }
+
+    fmt_ = {};
+    fmt_.type = type;
+    if (mplane()) {
+        fmt_.fmt.pix_mp.width       = cfg.width;
+        fmt_.fmt.pix_mp.height      = cfg.height;
+        fmt_.fmt.pix_mp.pixelformat = cfg.pixelformat;
+        fmt_.fmt.pix_mp.field       = cfg.field;
+    } else {
+        fmt_.fmt.pix.width       = cfg.width;
+        fmt_.fmt.pix.height      = cfg.height;
+        fmt_.fmt.pix.pixelformat = cfg.pixelformat;
+        fmt_.fmt.pix.field       = cfg.field;
+    }
+    if (xioctl(fd_, VIDIOC_S_FMT, &fmt_) < 0) {
+        perror("VIDIOC_S_FMT");
+        return false;
+    }
+    if (pixelformat() != cfg.pixelformat) {
+        fprintf(stderr, "%s: driver chose %s instead of %s\n", cfg.device.c_str(),
+                fourcc_to_string(pixelformat()).c_str(),
+                fourcc_to_string(cfg.pixelformat).c_str());
+        return false;
+    }
+    if (cfg.fps > 0 &&
+        !set_frame_interval(fd_, {1000, uint32_t(cfg.fps * 1000 + 0.5)}, type))
+        return false;
+    return align_strides(cfg);
+}
+
+// Second S_FMT with the same format and padded strides. sizeimage is
+// cleared so the driver recomputes it for the new bytesperline.
+bool CaptureDevice::align_strides(const CaptureConfig& cfg) {
+    const uint32_t align = cfg.stride_align;
+    if (!align) return true;
+    auto round_up = [align](uint32_t v) { return (v + align - 1) & ~(align - 1); };
+
+    v4l2_format want = fmt_;
+    bool        pad  = false;
+    for (unsigned p = 0; p < num_planes(); ++p) {
+        const uint32_t bpl = bytesperline(p);
+        if (bpl % align == 0) continue;
+        if (mplane()) {
+            want.fmt.pix_mp.plane_fmt[p].bytesperline = round_up(bpl);
+            want.fmt.pix_mp.plane_fmt[p].sizeimage    = 0;
+        } else {
+            want.fmt.pix.bytesperline = round_up(bpl);
+            want.fmt.pix.sizeimage    = 0;
+        }
+        pad = true;
+    }
+    if (!pad) return true;
+    if (xioctl(fd_, VIDIOC_S_FMT, &want) < 0) {
+        perror("VIDIOC_S_FMT (stride)");
+        return false;
+    }
+    const bool same = mplane() ? want.fmt.pix_mp.pixelformat == pixelformat() &&
+                                     want.fmt.pix_mp.width == width() &&
+                                     want.fmt.pix_mp.height == height()
+                               : want.fmt.pix.pixelformat == pixelformat() &&
+                                     want.fmt.pix.width == width() &&
+                                     want.fmt.pix.height == height();
+    if (!same) {
+        fprintf(stderr, "%s: driver changed the format when asked for padded rows\n",
+                cfg.device.c_str());
+        return false;
+    }
+    fmt_ = want;
+    for (unsigned p = 0; p < num_planes(); ++p)
+        if (bytesperline(p) % align)
+            fprintf(stderr, "%s: driver keeps bytesperline %u for plane %u (asked for a "
+                    "multiple of %u)\n", cfg.device.c_str(), bytesperline(p), p, align);
+    return true;
+}
+
+bool CaptureDevice::map_buffer(uint32_t index) {
+    v4l2_plane  planes[VIDEO_MAX_PLANES]{};
+    v4l2_buffer buf{};
+    buf.type   = fmt_.type;
+    buf.memory = V4L2_MEMORY_MMAP;
+    buf.index  = index;
+    if (mplane()) {
+        buf.m.planes = planes;
+        buf.length   = VIDEO_MAX_PLANES;
+    }
+    if (xioctl(fd_, VIDIOC_QUERYBUF, &buf) < 0) {
+        perror("VIDIOC_QUERYBUF");
+        return false;
+    }
+
+    Buffer b{};
+    b.num_planes = mplane() ? buf.length : 1;
+    for (unsigned p = 0; p < b.num_planes; ++p) {
+        size_t length = mplane() ? planes[p].length : buf.length;
+        off_t  offset = mplane() ? planes[p].m.mem_offset : buf.m.offset;
+        void*  start  = mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                             MAP_SHARED, fd_, offset);
+        if (start == MAP_FAILED) {
+            perror("mmap");
+            for (unsigned q = 0; q < p; ++q) munmap(b.start[q], b.length[q]);
+            return false;
+        }
+        b.start[p]     = start;
+        b.length[p]    = length;
+        b.dmabuf_fd[p] = -1;
+        buffer_bytes_.fetch_add(length, std::memory_order_relaxed);
+    }
+    if (export_dmabuf_ && !export_buffer(index, b)) {
+        for (unsigned p = 0; p < b.num_planes; ++p) {
+            munmap(b.start[p], b.length[p]);
+            buffer_bytes_.fetch_sub(b.length[p], std::memory_order_relaxed);
+        }
+        return false;
+    }
+    buffers_.push_back(b);
+    nbuffers_.store(buffers_.size(), std::memory_order_relaxed);
+    return true;
+}
+
+// The exported dmabufs reference the same memory as the mapping above;
+// they stay valid after STREAMOFF and even after the buffers are freed, so
+// consumers holding a dup() are never left with a dangling fd.
+bool CaptureDevice::export_buffer(uint32_t index, Buffer& b) {
+    for (unsigned p = 0; p < b.num_planes; ++p) {
+        v4l2_exportbuffer exp{};
+        exp.type  = fmt_.type;
+        exp.index = index;
+        exp.plane = p;
+        exp.flags = O_CLOEXEC | O_RDWR;
+        if (xioctl(fd_, VIDIOC_EXPBUF, &exp) < 0) {
+            perror("VIDIOC_EXPBUF");
+            for (unsigned q = 0; q < p; ++q) ::close(b.dmabuf_fd[q]);
+            return false;
+        }
+        b.dmabuf_fd[p] = exp.fd;
+    }
+    return true;
+}
+
+bool CaptureDevice::set_userptr(uint32_t index, unsigned plane, void* start, size_t length) {
+    if (memory_ != V4L2_MEMORY_USERPTR || index >= buffers_.size() ||
+        plane >= buffers_[index].num_planes)
+        return false;
+    if (length < sizeimage(plane)) {
+        fprintf(stderr, "userptr buffer %u: %zu bytes, driver needs %u\n", index, length,
+                sizeimage(plane));
+        return false;
+    }
+    Buffer& b = buffers_[index];
+    buffer_bytes_.fetch_add(length - b.length[plane], std::memory_order_relaxed);
+    b.start[plane]  = start;
+    b.length[plane] = length;
+    return true;
+}
+
+bool CaptureDevice::add_buffers(unsigned count) {
+    if (fd_ < 0 || buffers_.size() + count > VIDEO_MAX_FRAME) return false;
+    if (memory_ != V4L2_MEMORY_MMAP) return false;
+
+    v4l2_create_buffers create{};
+    create.count  = count;
+    create.memory = V4L2_MEMORY_MMAP;
+    create.format = fmt_;
+    if (xioctl(fd_, VIDIOC_CREATE_BUFS, &create) < 0) {
+        perror("VIDIOC_CREATE_BUFS");
+        return false;
+    }
+    // Indices are handed out contiguously after the existing buffers.
+    if (create.index != buffers_.size()) {
+        fprintf(stderr, "VIDIOC_CREATE_BUFS: unexpected index %u\n", create.index);
+        return false;
+    }
+    for (uint32_t i = create.index; i < create.index + create.count; ++i) {
+        if (!map_buffer(i)) return false;
+        if (streaming_ && !queue(i)) return false;
+    }
+    return true;
+}
+
+// Adaptive mode: a sequence gap means the driver had no free buffer when a
+// frame arrived, so give it one more while the budget allows.
+void CaptureDevice::grow_if_starved(const frame_stats& s) {
+    if (!buffer_budget_ || s.dropped_driver == seen_driver_drops_) return;
+    seen_driver_drops_ = s.dropped_driver;
+
+    size_t per_buffer = 0;
+    for (unsigned p = 0; p < num_planes(); ++p)
+        per_buffer += mplane() ? fmt_.fmt.pix_mp.plane_fmt[p].sizeimage : fmt_.fmt.pix.sizeimage;
+    if (buffer_bytes() + per_buffer > buffer_budget_) return;
+    if (add_buffers(1))
+        fprintf(stderr, "%u drops so far, grew to %zu buffers (%zu bytes)\n",
+                (unsigned)s.dropped_driver, buffer_count(), buffer_bytes());
+}
+
+bool CaptureDevice::queue(uint32_t index) {
+    const Buffer& b = buffers_[index];
+    v4l2_plane  planes[VIDEO_MAX_PLANES]{};
+    v4l2_buffer buf{};
+    buf.type   = fmt_.type;
+    buf.memory = memory_;
+    buf.index  = index;
+    if (mplane()) {
+        buf.m.planes = planes;
+        buf.length   = b.num_planes;
+    }
+    if (memory_ == V4L2_MEMORY_USERPTR) {
+        for (unsigned p = 0; p < b.num_planes; ++p) {
+            if (!b.start[p]) {
+                fprintf(stderr, "userptr buffer %u plane %u has no memory\n", index, p);
+                return false;
+            }
+            if (mplane()) {
+                planes[p].m.userptr = reinterpret_cast<unsigned long>(b.start[p]);
+                planes[p].length    = b.length[p];
+            } else {
+                buf.m.userptr = reinterpret_cast<unsigned long>(b.start[p]);
+                buf.length    = b.length[p];
+            }
+        }
+    }
+    // For USERPTR this is where the driver pins the pages; memory it
+    // cannot DMA into (e.g. some GPU mappings) fails here with EFAULT.
+    if (xioctl(fd_, VIDIOC_QBUF, &buf) < 0) {
+        perror("VIDIOC_QBUF");
+        return false;
+    }
+    return true;
+}
+
+bool CaptureDevice::start() {
+    if (fd_ < 0) return false;
+    if (streaming_) return true;
+
+    for (uint32_t i = 0; i < buffers_.size(); ++i)
+        if (!queue(i)) return false;
+
+    int type = fmt_.type;
+    if (xioctl(fd_, VIDIOC_STREAMON, &type) < 0) {
+        perror("VIDIOC_STREAMON");
+        return false;
+    }
+    streaming_ = true;
+    {
+        std::lock_guard<std::mutex> lock(stats_lock_);
+        frame_stats_restart(&stats_);
+    }
+    return true;
+}
+
+void CaptureDevice::stop() {
+    if (!streaming_) return;
+    int type = fmt_.type;
+    if (xioctl(fd_, VIDIOC_STREAMOFF, &type) < 0)
+        perror("VIDIOC_STREAMOFF");
+    streaming_ = false;
+}
+
+void CaptureDevice::unmap() {
+    for (auto& b : buffers_)
+        for (unsigned p = 0; p < b.num_planes; ++p) {
+            if (memory_ == V4L2_MEMORY_MMAP && munmap(b.start[p], b.length[p]) < 0)
+                perror("munmap");
+            if (b.dmabuf_fd[p] >= 0) ::close(b.dmabuf_fd[p]);
+        }
+    buffers_.clear();
+    nbuffers_.store(0, std::memory_order_relaxed);
+    buffer_bytes_.store(0, std::memory_order_relaxed);
+}
+
+void CaptureDevice::close() {
+    if (fd_ < 0) return;
+    stop();
+    unmap();
+    ::close(fd_);
+    fd_ = -1;
+}
+
+Frame CaptureDevice::grab() {
+    if (!streaming_) return {};
+
+    v4l2_plane  planes[VIDEO_MAX_PLANES]{};
+    v4l2_buffer buf{};
+    buf.type   = fmt_.type;
+    buf.memory = memory_;
+    if (mplane()) {
+        buf.m.planes = planes;
+        buf.length   = VIDEO_MAX_PLANES;
+    }
+    if (xioctl(fd_, VIDIOC_DQBUF, &buf) < 0) {
+        if (errno != EAGAIN) perror("VIDIOC_DQBUF");
+        return {};
+    }
+    frame_stats snapshot;
+    {
+        std::lock_guard<std::mutex> lock(stats_lock_);
+        frame_stats_update(&stats_, &buf);
+        snapshot = stats_;
+    }
+    grow_if_starved(snapshot);
+    const Buffer& b = buffers_[buf.index];
+    return Frame(this, buf, planes, b.start, b.dmabuf_fd);
+}
+
+Frame CaptureDevice::grab_latest() {
+    Frame newest = grab();
+    if (!newest) return {};
+
+    unsigned stale = 0;
+    pollfd pfd{fd_, POLLIN, 0};
+    while (poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLIN)) {
+        Frame f = grab();
+        if (!f) break;
+        newest = std::move(f);
+        ++stale;
+    }
+    if (stale) count_app_drop(stale);
+    return newest;
+}
+
+frame_stats CaptureDevice::stats() const {
+    std::lock_guard<std::mutex> lock(stats_lock_);
+    return stats_;
+}
+
+void CaptureDevice::count_app_drop(unsigned n) {
+    std::lock_guard<std::mutex> lock(stats_lock_);
+    frame_stats_app_drop(&stats_, n);
+}
+
+void CaptureDevice::requeue(v4l2_buffer& buf) {
+    // STREAMOFF already returned every buffer to userspace.
+    if (!streaming_) return;
+    if (xioctl(fd_, VIDIOC_QBUF, &buf) < 0)
+        perror("VIDIOC_QBUF");
+}
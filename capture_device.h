@@ -0,0 +1,218 @@
+// capture_device.h
+//
+// Shared V4L2 capture engine used by the C++ demos.
+//
+// CaptureDevice owns the fd and the mmap'd driver buffers. grab() hands out
+// a move-only Frame that points straight into the mapped buffer; the buffer
+// is queued back to the driver when the Frame is destroyed (or release()d),
+// so consumers can read the camera memory in place without copying it.
+//
+// Devices that only implement the multi-planar API (most SoC ISPs and m2m
+// decoders) are driven through V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE; each
+// memory plane (e.g. the Y and CbCr planes of NV12M) is mapped separately
+// and exposed through Frame::plane().
+//
+// With CaptureConfig::export_dmabuf every plane is also exported as a
+// dmabuf fd (VIDIOC_EXPBUF) so a Frame can be handed to an encoder, a GPU
+// importer or another process (see dmabuf_share.h) without copying it.
+//
+// With CaptureConfig::userptr the driver captures into memory the
+// application provides (V4L2_MEMORY_USERPTR) instead of its own buffers,
+// e.g. GL buffers mapped into the process, so frames land where they are
+// consumed. Every buffer is given its memory with set_userptr() between
+// open() and start().
+//
+// All Frames must be released before the owning CaptureDevice is stopped
+// or destroyed.
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <linux/videodev2.h>
+#include "format_negotiator.h"
+#include "frame_stats.h"
+#include "frame_view.h"
+
+struct CaptureConfig {
+    std::string device      = "/dev/video0";
+    uint32_t    width       = 640;
+    uint32_t    height      = 480;
+    uint32_t    pixelformat = V4L2_PIX_FMT_YUYV;
+    uint32_t    field       = V4L2_FIELD_ANY;
+    unsigned    num_buffers = 4;
+    // Frame rate to request with VIDIOC_S_PARM; with a goal, the minimum
+    // acceptable rate. 0 leaves the driver default.
+    double      fps         = 0;
+    // With a goal other than None, width/height become the minimum wanted
+    // size and the negotiator picks format, size and rate among `formats`
+    // (empty = any format) instead of using pixelformat as given.
+    CaptureGoal           goal = CaptureGoal::None;
+    std::vector<uint32_t> formats;
+    // Adaptive mode: when > 0, start with num_buffers and add one more
+    // (VIDIOC_CREATE_BUFS) each time the driver drops a frame for lack of
+    // a free buffer, until the buffers would exceed this many bytes.
+    size_t      buffer_budget = 0;
+    // Export each buffer plane as a dmabuf fd; see Frame::dmabuf_fd().
+    bool        export_dmabuf = false;
+    // Capture into application memory; see set_userptr(). Excludes
+    // export_dmabuf and buffer_budget, which need driver-allocated buffers.
+    bool        userptr = false;
+    // When non-zero (a power of two), ask for every plane's bytesperline
+    // rounded up to a multiple of this many bytes, e.g. 64 so that SIMD
+    // rows start on a cache line. Drivers with a fixed stride (uvcvideo)
+    // keep theirs; that is reported, not an error.
+    uint32_t    stride_align = 0;
+};
+
+class CaptureDevice;
+
+// Handle to one dequeued driver buffer.
+class Frame {
+public:
+    Frame() = default;
+    ~Frame() { release(); }
+
+    Frame(Frame&& other) noexcept;
+    Frame& operator=(Frame&& other) noexcept;
+    Frame(const Frame&)            = delete;
+    Frame& operator=(const Frame&) = delete;
+
+    explicit operator bool() const { return dev_ != nullptr; }
+
+    // First (or only) plane.
+    const uint8_t*     data()  const { return plane_data_[0]; }
+    size_t             size()  const { return plane_size(0); }
+    uint32_t           index() const { return buf_.index; }
+    const v4l2_buffer& buffer() const { return buf_; }
+
+    // Memory planes: 1 for single-planar buffers and for multi-planar
+    // formats packed in one buffer (NV12), 2-3 for NV12M/YUV420M.
+    unsigned       num_planes() const { return num_planes_; }
+    const uint8_t* plane(unsigned p) const { return plane_data_[p]; }
+    size_t         plane_size(unsigned p) const;
+    // Pixel format, size and per-plane pointer and stride of the image,
+    // with planes that share a buffer split apart. Empty if the buffer is
+    // shorter than the negotiated format says it should be.
+    FrameView      view() const;
+    // dmabuf fd of plane p, or -1 if the device was opened without
+    // export_dmabuf. Owned by the CaptureDevice: dup() it to keep it.
+    int            dmabuf_fd(unsigned p = 0) const { return plane_fd_[p]; }
+
+    // Queue the buffer back to the driver now instead of on destruction.
+    void release();
+
+private:
+    friend class CaptureDevice;
+    Frame(CaptureDevice* dev, const v4l2_buffer& buf, const v4l2_plane* planes,
+          void* const* plane_starts, const int* plane_fds);
+    void take(Frame& other);
+
+    CaptureDevice* dev_ = nullptr;
+    v4l2_buffer    buf_{};
+    // buf_.m.planes is re-pointed here whenever the Frame moves.
+    v4l2_plane     planes_[VIDEO_MAX_PLANES]{};
+    const uint8_t* plane_data_[VIDEO_MAX_PLANES]{};
+    int            plane_fd_[VIDEO_MAX_PLANES]{};
+    unsigned       num_planes_ = 0;
+};
+
+class CaptureDevice {
+public:
+    CaptureDevice() = default;
+    ~CaptureDevice() { close(); }
+
+    CaptureDevice(const CaptureDevice&)            = delete;
+    CaptureDevice& operator=(const CaptureDevice&) = delete;
+
+    // Open the device, set the format and map the buffers. Errors are
+    // reported with perror() and leave the device closed.
+    bool open(const CaptureConfig& cfg);
+    // Queue every buffer and start streaming.
+    bool start();
+    void stop();
+    void close();
+
+    // Block until the next buffer is filled. Returns an empty Frame on
+    // error.
+    Frame grab();
+    // Like grab(), but then drains every other buffer that is already
+    // filled, re-queueing the stale ones and returning only the newest.
+    Frame grab_latest();
+
+    int                fd()          const { return fd_; }
+    const v4l2_format& format()      const { return fmt_; }
+    bool               mplane()      const { return V4L2_TYPE_IS_MULTIPLANAR(fmt_.type); }
+    uint32_t           width()       const { return mplane() ? fmt_.fmt.pix_mp.width : fmt_.fmt.pix.width; }
+    uint32_t           height()      const { return mplane() ? fmt_.fmt.pix_mp.height : fmt_.fmt.pix.height; }
+    uint32_t           pixelformat() const { return mplane() ? fmt_.fmt.pix_mp.pixelformat : fmt_.fmt.pix.pixelformat; }
+    unsigned           num_planes()  const { return mplane() ? fmt_.fmt.pix_mp.num_planes : 1; }
+    uint32_t           bytesperline(unsigned plane = 0) const {
+        return mplane() ? fmt_.fmt.pix_mp.plane_fmt[plane].bytesperline : fmt_.fmt.pix.bytesperline;
+    }
+    // Bytes the driver needs for one plane of a frame.
+    uint32_t           sizeimage(unsigned plane = 0) const {
+        return mplane() ? fmt_.fmt.pix_mp.plane_fmt[plane].sizeimage : fmt_.fmt.pix.sizeimage;
+    }
+    uint32_t           memory()      const { return memory_; }
+    size_t             buffer_count() const { return nbuffers_.load(std::memory_order_relaxed); }
+    size_t             buffer_bytes() const { return buffer_bytes_.load(std::memory_order_relaxed); }
+    // dmabuf fd of a buffer plane (-1 without export_dmabuf), e.g. to
+    // import every buffer into a consumer once up front.
+    int                dmabuf_fd(uint32_t index, unsigned plane = 0) const {
+        return buffers_[index].dmabuf_fd[plane];
+    }
+
+    // USERPTR mode: back plane `plane` of buffer `index` with `length`
+    // bytes at `start` (at least sizeimage(plane)). The memory must stay
+    // valid until close(); the driver may pin it while the buffer is
+    // queued.
+    bool set_userptr(uint32_t index, unsigned plane, void* start, size_t length);
+
+    // Allocate, map and (if streaming) queue `count` more buffers. Must be
+    // called from the thread that calls grab().
+    bool add_buffers(unsigned count);
+
+    // Snapshot of the running counters; safe to call from any thread.
+    frame_stats stats() const;
+    // Record frames the caller dequeued but discarded unseen.
+    void count_app_drop(unsigned n);
+
+private:
+    friend class Frame;
+
+    struct Buffer {
+        void*    start[VIDEO_MAX_PLANES];
+        size_t   length[VIDEO_MAX_PLANES];
+        int      dmabuf_fd[VIDEO_MAX_PLANES];
+        unsigned num_planes;
+    };
+
+    bool queue(uint32_t index);
+    bool set_format(const CaptureConfig& cfg);
+    bool align_strides(const CaptureConfig& cfg);
+    bool map_buffer(uint32_t index);
+    bool export_buffer(uint32_t index, Buffer& b);
+    void grow_if_starved(const frame_stats& s);
+    void requeue(v4l2_buffer& buf);
+    void unmap();
+
+    int                 fd_ = -1;
+    bool                streaming_ = false;
+    v4l2_format         fmt_{};
+    // Only the thread calling grab() appends to buffers_; capacity is
+    // reserved up front so Frames never see it reallocate.
+    std::vector<Buffer> buffers_;
+    std::atomic<size_t> nbuffers_{0};
+    std::atomic<size_t> buffer_bytes_{0};
+    size_t              buffer_budget_ = 0;
+    bool                export_dmabuf_ = false;
+    uint32_t            memory_ = V4L2_MEMORY_MMAP;
+    unsigned long long  seen_driver_drops_ = 0;
+
+    mutable std::mutex  stats_lock_;
+    frame_stats         stats_{};
+};
@@ -7,10 +7,13 @@
  * see http://linuxtv.org/docs.php for more information
  */
 
+ #define _GNU_SOURCE             /* memfd_create(), F_ADD_SEALS */
  #include <stdio.h>
  #include <stdlib.h>
  #include <string.h>
  #include <assert.h>
+ #include <signal.h>
+ #include <time.h>
  
  #include <getopt.h>             /* getopt_long() */
  
@@ -22,11 +25,19 @@
  #include <sys/time.h>
  #include <sys/mman.h>
  #include <sys/ioctl.h>
+ #include <sys/epoll.h>
+ #include <sys/timerfd.h>
+ #include <sys/signalfd.h>
  
  #include <linux/videodev2.h>
+ #include <linux/dma-buf.h>
+ #include <linux/udmabuf.h>
+ 
+ #include "frame_stats.h"
 
- //gcc capture_raw_frames.c -o capture_raw_frames
+ //gcc capture_raw_frames.c -o capture_raw_frames -lm
 //./capture_raw_frames -o -f -c  30
+//./capture_raw_frames -o -c 30 -d /dev/video0 -d /dev/video2
  
  #define CLEAR(x) memset(&(x), 0, sizeof(x))
  
@@ -34,26 +45,45 @@
  #define V4L2_PIX_FMT_H264     v4l2_fourcc('H', '2', '6', '4') /* H264 with start codes */
  #endif
  
+ #define MAX_DEVICES     32
+ #define TICK_MS         250     /* timerfd period for timeout checks */
+ 
  enum io_method {
          IO_METHOD_READ,
          IO_METHOD_MMAP,
          IO_METHOD_USERPTR,
+         IO_METHOD_DMABUF,
  };
  
  struct buffer {
          void   *start;
          size_t  length;
+         int     fd;             /* dmabuf, IO_METHOD_DMABUF only */
  };
  
- static char            *dev_name;
+ struct device {
+         unsigned int    index;
+         char           *name;
+         int             fd;
+         struct buffer  *buffers;
+         unsigned int    n_buffers;
+         int             frame_number;
+         int             done;
+         long long       last_frame_ms;  /* CLOCK_MONOTONIC */
+         struct frame_stats stats;
+         unsigned long long seen_drops;  /* dropped_driver at last growth check */
+         size_t          buffer_bytes;
+         int             no_grow;        /* CREATE_BUFS failed, stop growing */
+ };
+ 
+ static struct device    devices[MAX_DEVICES];
+ static unsigned int     n_devices;
  static enum io_method   io = IO_METHOD_MMAP;
- static int              fd = -1;
- struct buffer          *buffers;
- static unsigned int     n_buffers;
  static int              out_buf;
  static int              force_format;
  static int              frame_count = 200;
- static int              frame_number = 0;
+ static int              timeout_ms = 2000;
+ static size_t           buffer_budget;  /* bytes, 0 = fixed 4 buffers */
  
  static void errno_exit(const char *s)
  {
@@ -61,6 +91,15 @@
          exit(EXIT_FAILURE);
  }
  
+ /* Like errno_exit() for one camera's ioctls: report and return -1, so the
+  * caller can drop that device and keep capturing from the others. */
+ static int device_error(struct device *dev, const char *s)
+ {
+         fprintf(stderr, "%s: %s error %d, %s\n", dev->name, s, errno,
+                 strerror(errno));
+         return -1;
+ }
+ 
  static int xioctl(int fh, int request, void *arg)
  {
          int r;
@@ -72,18 +111,42 @@
          return r;
  }
  
- static void process_image(const void *p, int size)
+ static long long now_ms(void)
+ {
+         struct timespec ts;
+ 
+         clock_gettime(CLOCK_MONOTONIC, &ts);
+         return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+ }
+ 
+ /* Bracket CPU reads of a dmabuf the device has written. */
+ static void dmabuf_sync(int fd, __u64 flags)
+ {
+         struct dma_buf_sync sync;
+ 
+         CLEAR(sync);
+         sync.flags = flags | DMA_BUF_SYNC_READ;
+         if (-1 == xioctl(fd, DMA_BUF_IOCTL_SYNC, &sync))
+                 errno_exit("DMA_BUF_IOCTL_SYNC");
+ }
+ 
+ static void process_image(struct device *dev, const void *p, int size)
  {
-    frame_number++;
+    dev->frame_number++;
   
          
-         char filename[15];
-         sprintf(filename, "frame-%d.raw", frame_number);
+         char filename[64];
+         if (n_devices > 1)
+                 snprintf(filename, sizeof(filename), "cam%u-frame-%d.raw",
+                          dev->index, dev->frame_number);
+         else
+                 snprintf(filename, sizeof(filename), "frame-%d.raw",
+                          dev->frame_number);
          FILE *fp=fopen(filename,"wb");
-         
+ 
          if (out_buf)
          {
-            printf("Writing frame %d with size: %d\n", frame_number, size);
+            printf("%s: writing frame %d with size: %d\n", dev->name, dev->frame_number, size);
             fwrite(p, size, 1, fp);
          }
                  
@@ -92,29 +155,99 @@
          fclose(fp);
  }
  
- static int read_frame(void)
+ /* Adaptive mode: map one more MMAP buffer with VIDIOC_CREATE_BUFS and queue
+  * it, as long as the pool stays within buffer_budget. */
+ static void grow_mmap(struct device *dev)
+ {
+         struct v4l2_create_buffers create;
+         struct v4l2_buffer buf;
+         struct buffer *grown;
+ 
+         if (dev->no_grow || dev->stats.dropped_driver == dev->seen_drops)
+                 return;
+         dev->seen_drops = dev->stats.dropped_driver;
+ 
+         if (dev->n_buffers == VIDEO_MAX_FRAME ||
+             dev->buffer_bytes + dev->buffer_bytes / dev->n_buffers > buffer_budget)
+                 return;
+ 
+         CLEAR(create);
+         create.count = 1;
+         create.memory = V4L2_MEMORY_MMAP;
+         create.format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+         if (-1 == xioctl(dev->fd, VIDIOC_G_FMT, &create.format) ||
+             -1 == xioctl(dev->fd, VIDIOC_CREATE_BUFS, &create)) {
+                 fprintf(stderr, "%s: VIDIOC_CREATE_BUFS failed, keeping %u buffers\n",
+                         dev->name, dev->n_buffers);
+                 dev->no_grow = 1;
+                 return;
+         }
+         /* Buffers are indexed by position in dev->buffers; a driver that
+          * hands back anything but the next index cannot be grown into. */
+         if (create.index != dev->n_buffers || create.count != 1) {
+                 fprintf(stderr, "%s: VIDIOC_CREATE_BUFS returned index %u count %u, "
+                         "keeping %u buffers\n",
+                         dev->name, create.index, create.count, dev->n_buffers);
+                 dev->no_grow = 1;
+                 return;
+         }
+ 
+         grown = realloc(dev->buffers, (dev->n_buffers + 1) * sizeof(*dev->buffers));
+         if (!grown) {
+                 fprintf(stderr, "Out of memory\n");
+                 exit(EXIT_FAILURE);
+         }
+         dev->buffers = grown;
+ 
+         CLEAR(buf);
+         buf.type        = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+         buf.memory      = V4L2_MEMORY_MMAP;
+         buf.index       = create.index;
+ 
+         if (-1 == xioctl(dev->fd, VIDIOC_QUERYBUF, &buf))
+                 errno_exit("VIDIOC_QUERYBUF");
+ 
+         dev->buffers[buf.index].length = buf.length;
+         dev->buffers[buf.index].start =
+                 mmap(NULL, buf.length, PROT_READ | PROT_WRITE, MAP_SHARED,
+                      dev->fd, buf.m.offset);
+         if (MAP_FAILED == dev->buffers[buf.index].start)
+                 errno_exit("mmap");
+         dev->n_buffers++;
+         dev->buffer_bytes += buf.length;
+ 
+         if (-1 == xioctl(dev->fd, VIDIOC_QBUF, &buf))
+                 errno_exit("VIDIOC_QBUF");
+ 
+         fprintf(stderr, "%s: %llu frames dropped, grew to %u buffers (%zu bytes)\n",
+                 dev->name, dev->stats.dropped_driver, dev->n_buffers,
+                 dev->buffer_bytes);
+ }
+ 
+  static int read_frame(struct device *dev)
  {
          struct v4l2_buffer buf;
          unsigned int i;
  
          switch (io) {
          case IO_METHOD_READ:
-                 if (-1 == read(fd, buffers[0].start, buffers[0].length)) {
+                 if (-1 == read(dev->fd, dev->buffers[0].start, dev->buffers[0].length)) {
                          switch (errno) {
                          case EAGAIN:
                                  return 0;
  
                          case EIO:
-                                 /* Could ignore EIO, see spec. */
- 
-                                 /* fall through */
+                                 /* Transient (e.g. signal loss); if the
+                                  * stream stalls, the timeout restarts it. */
+                                 return 0;
  
                          default:
-                                 errno_exit("read");
+                                 return device_error(dev, "read");
                          }
                  }
  
-                 process_image(buffers[0].start, buffers[0].length);
+                 dev->stats.captured++;
+                 process_image(dev, dev->buffers[0].start, dev->buffers[0].length);
                  break;
  
          case IO_METHOD_MMAP:
@@ -123,27 +256,32 @@
                  buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
                  buf.memory = V4L2_MEMORY_MMAP;
  
-                 if (-1 == xioctl(fd, VIDIOC_DQBUF, &buf)) {
+                 if (-1 == xioctl(dev->fd, VIDIOC_DQBUF, &buf)) {
                          switch (errno) {
                          case EAGAIN:
                                  return 0;
  
                          case EIO:
-                                 /* Could ignore EIO, see spec. */
- 
-                                 /* fall through */
+                                 /* Transient (e.g. signal loss); if the
+                                  * stream stalls, the timeout restarts it. */
+                                 return 0;
  
                          default:
-                                 errno_exit("VIDIOC_DQBUF");
+                                 return device_error(dev, "VIDIOC_DQBUF");
                          }
                  }
  
-                 assert(buf.index < n_buffers);
+                 assert(buf.index < dev->n_buffers);
+ 
+                 frame_stats_update(&dev->stats, &buf);
+ 
+                 process_image(dev, dev->buffers[buf.index].start, buf.bytesused);
  
-                 process_image(buffers[buf.index].start, buf.bytesused);
+                 if (-1 == xioctl(dev->fd, VIDIOC_QBUF, &buf))
+                         return device_error(dev, "VIDIOC_QBUF");
  
-                 if (-1 == xioctl(fd, VIDIOC_QBUF, &buf))
-                         errno_exit("VIDIOC_QBUF");
+                 if (buffer_budget)
+                         grow_mmap(dev);
                  break;
  
          case IO_METHOD_USERPTR:
@@ -152,78 +290,237 @@
                  buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
                  buf.memory = V4L2_MEMORY_USERPTR;
  
-                 if (-1 == xioctl(fd, VIDIOC_DQBUF, &buf)) {
+                 if (-1 == xioctl(dev->fd, VIDIOC_DQBUF, &buf)) {
                          switch (errno) {
                          case EAGAIN:
                                  return 0;
  
                          case EIO:
-                                 /* Could ignore EIO, see spec. */
- 
-                                 /* fall through */
+                                 /* Transient (e.g. signal loss); if the
+                                  * stream stalls, the timeout restarts it. */
+                                 return 0;
  
                          default:
-                                 errno_exit("VIDIOC_DQBUF");
+                                 return device_error(dev, "VIDIOC_DQBUF");
                          }
                  }
  
-                 for (i = 0; i < n_buffers; ++i)
-                         if (buf.m.userptr == (unsigned long)buffers[i].start
-                             && buf.length == buffers[i].length)
+                 for (i = 0; i < dev->n_buffers; ++i)
+                         if (buf.m.userptr == (unsigned long)dev->buffers[i].start
+                             && buf.length == dev->buffers[i].length)
                                  break;
  
-                 assert(i < n_buffers);
+                 assert(i < dev->n_buffers);
  
-                 process_image((void *)buf.m.userptr, buf.bytesused);
+                 frame_stats_update(&dev->stats, &buf);
  
-                 if (-1 == xioctl(fd, VIDIOC_QBUF, &buf))
-                         errno_exit("VIDIOC_QBUF");
+                 process_image(dev, (void *)buf.m.userptr, buf.bytesused);
+ 
+                 if (-1 == xioctl(dev->fd, VIDIOC_QBUF, &buf))
+                         return device_error(dev, "VIDIOC_QBUF");
+                 break;
+ 
+         case IO_METHOD_DMABUF:
+                 CLEAR(buf);
+ 
+                 buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+                 buf.memory = V4L2_MEMORY_DMABUF;
+ 
+                 if (-1 == xioctl(dev->fd, VIDIOC_DQBUF, &buf)) {
+                         switch (errno) {
+                         case EAGAIN:
+                                 return 0;
+ 
+                         case EIO:
+                                 /* Transient (e.g. signal loss); if the
+                                  * stream stalls, the timeout restarts it. */
+                                 return 0;
+ 
+                         default:
+                                 return device_error(dev, "VIDIOC_DQBUF");
+                         }
+                 }
+ 
+                 assert(buf.index < dev->n_buffers);
+ 
+                 frame_stats_update(&dev->stats, &buf);
+ 
+                 dmabuf_sync(dev->buffers[buf.index].fd, DMA_BUF_SYNC_START);
+                 process_image(dev, dev->buffers[buf.index].start, buf.bytesused);
+                 dmabuf_sync(dev->buffers[buf.index].fd, DMA_BUF_SYNC_END);
+ 
+                 buf.m.fd = dev->buffers[buf.index].fd;
+                 if (-1 == xioctl(dev->fd, VIDIOC_QBUF, &buf))
+                         return device_error(dev, "VIDIOC_QBUF");
                  break;
          }
  
+         dev->last_frame_ms = now_ms();
          return 1;
  }
  
- static void mainloop(void)
+ static int stop_capturing(struct device *dev);
+ static int start_capturing(struct device *dev);
+ 
+ /* Called when a device has been silent for timeout_ms: cycle the stream
+  * so every buffer is re-queued, instead of giving up on all cameras.
+  * Returns -1 if the stream could not be restarted. */
+ static int recover_device(struct device *dev)
  {
-         unsigned int count;
+         fprintf(stderr, "%s: no frame for %d ms, restarting stream\n",
+                 dev->name, timeout_ms);
  
-         count = frame_count;
+         if (io != IO_METHOD_READ) {
+                 if (-1 == stop_capturing(dev) || -1 == start_capturing(dev))
+                         return -1;
+                 frame_stats_restart(&dev->stats);
+         }
+         dev->last_frame_ms = now_ms();
+         return 0;
+ }
  
-         while (count-- > 0) {
-                 for (;;) {
-                         fd_set fds;
-                         struct timeval tv;
-                         int r;
+ /* Take a device out of the loop, once it has all its frames or has
+  * failed. The caller counts it off. */
+ static void finish_device(int epfd, struct device *dev)
+ {
+         dev->done = 1;
+         if (-1 == epoll_ctl(epfd, EPOLL_CTL_DEL, dev->fd, NULL))
+                 errno_exit("EPOLL_CTL_DEL");
+ }
  
-                         FD_ZERO(&fds);
-                         FD_SET(fd, &fds);
+ static void drop_device(int epfd, struct device *dev)
+ {
+         fprintf(stderr, "%s: dropping device after %d frames\n",
+                 dev->name, dev->frame_number);
+         finish_device(epfd, dev);
+ }
  
-                         /* Timeout. */
-                         tv.tv_sec = 2;
-                         tv.tv_usec = 0;
+ /* Drain an edge-triggered device until the driver has nothing left. */
+ static void service_device(int epfd, struct device *dev)
+ {
+         int r = 0;
  
-                         r = select(fd + 1, &fds, NULL, NULL, &tv);
+         while (!dev->done && (r = read_frame(dev)) > 0) {
+                 if (dev->frame_number >= frame_count)
+                         finish_device(epfd, dev);
+         }
+         if (r < 0)
+                 drop_device(epfd, dev);
+ }
  
-                         if (-1 == r) {
-                                 if (EINTR == errno)
-                                         continue;
-                                 errno_exit("select");
+ static void mainloop(void)
+ {
+         struct epoll_event ev, events[MAX_DEVICES + 2];
+         struct itimerspec its;
+         sigset_t mask;
+         int epfd, tfd, sfd;
+         unsigned int i, active;
+ 
+         epfd = epoll_create1(EPOLL_CLOEXEC);
+         if (-1 == epfd)
+                 errno_exit("epoll_create1");
+ 
+         /* One edge-triggered entry per camera; data.ptr is the device. */
+         for (i = 0; i < n_devices; ++i) {
+                 CLEAR(ev);
+                 ev.events = EPOLLIN | EPOLLET;
+                 ev.data.ptr = &devices[i];
+                 if (-1 == epoll_ctl(epfd, EPOLL_CTL_ADD, devices[i].fd, &ev))
+                         errno_exit("EPOLL_CTL_ADD");
+                 devices[i].last_frame_ms = now_ms();
+         }
+ 
+         /* Periodic tick for per-device timeouts. */
+         tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+         if (-1 == tfd)
+                 errno_exit("timerfd_create");
+         CLEAR(its);
+         its.it_interval.tv_nsec = TICK_MS * 1000000L;
+         its.it_value = its.it_interval;
+         if (-1 == timerfd_settime(tfd, 0, &its, NULL))
+                 errno_exit("timerfd_settime");
+         CLEAR(ev);
+         ev.events = EPOLLIN;
+         ev.data.ptr = &tfd;
+         if (-1 == epoll_ctl(epfd, EPOLL_CTL_ADD, tfd, &ev))
+                 errno_exit("EPOLL_CTL_ADD");
+ 
+         /* Control fd: SIGINT/SIGTERM end the loop cleanly. */
+         sigemptyset(&mask);
+         sigaddset(&mask, SIGINT);
+         sigaddset(&mask, SIGTERM);
+         if (-1 == sigprocmask(SIG_BLOCK, &mask, NULL))
+                 errno_exit("sigprocmask");
+         sfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+         if (-1 == sfd)
+                 errno_exit("signalfd");
+         CLEAR(ev);
+         ev.events = EPOLLIN;
+         ev.data.ptr = &sfd;
+         if (-1 == epoll_ctl(epfd, EPOLL_CTL_ADD, sfd, &ev))
+                 errno_exit("EPOLL_CTL_ADD");
+ 
+         active = n_devices;
+         while (active > 0) {
+                 int n, k;
+ 
+                 n = epoll_wait(epfd, events, MAX_DEVICES + 2, -1);
+                 if (-1 == n) {
+                         if (EINTR == errno)
+                                 continue;
+                         errno_exit("epoll_wait");
+                 }
+ 
+                 for (k = 0; k < n; ++k) {
+                         void *ptr = events[k].data.ptr;
+ 
+                         if (ptr == &sfd) {
+                                 fprintf(stderr, "interrupted\n");
+                                 active = 0;
+                                 break;
                          }
  
-                         if (0 == r) {
-                                 fprintf(stderr, "select timeout\n");
-                                 exit(EXIT_FAILURE);
+                         if (ptr == &tfd) {
+                                 unsigned long long expirations;
+                                 long long now = now_ms();
+ 
+                                 if (-1 == read(tfd, &expirations, sizeof(expirations))
+                                     && EAGAIN != errno)
+                                         errno_exit("timerfd read");
+ 
+                                 for (i = 0; i < n_devices; ++i) {
+                                         if (devices[i].done ||
+                                             now - devices[i].last_frame_ms <= timeout_ms)
+                                                 continue;
+                                         if (-1 == recover_device(&devices[i])) {
+                                                 drop_device(epfd, &devices[i]);
+                                                 --active;
+                                         }
+                                 }
+                                 continue;
                          }
  
-                         if (read_frame())
-                                 break;
-                         /* EAGAIN - continue select loop. */
+                         /* EPOLLERR without EPOLLIN: nothing queued, left
+                          * to the timeout to recover. */
+                         if (events[k].events & EPOLLIN) {
+                                 struct device *dev = ptr;
+ 
+                                 /* Dropped by the tick earlier in this batch. */
+                                 if (dev->done)
+                                         continue;
+                                 service_device(epfd, dev);
+                                 if (dev->done)
+                                         --active;
+                         }
                  }
          }
+ 
+         close(sfd);
+         close(tfd);
+         close(epfd);
  }
  
- static void stop_capturing(void)
+ static int stop_capturing(struct device *dev)
  {
          enum v4l2_buf_type type;
  
@@ -234,14 +531,16 @@
  
          case IO_METHOD_MMAP:
          case IO_METHOD_USERPTR:
+         case IO_METHOD_DMABUF:
                  type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-                 if (-1 == xioctl(fd, VIDIOC_STREAMOFF, &type))
-                         errno_exit("VIDIOC_STREAMOFF");
+                 if (-1 == xioctl(dev->fd, VIDIOC_STREAMOFF, &type))
+                         return device_error(dev, "VIDIOC_STREAMOFF");
                  break;
          }
+         return 0;
  }
  
- static void start_capturing(void)
+ static int start_capturing(struct device *dev)
  {
          unsigned int i;
          enum v4l2_buf_type type;
@@ -252,7 +551,7 @@
                  break;
  
          case IO_METHOD_MMAP:
-                 for (i = 0; i < n_buffers; ++i) {
+                 for (i = 0; i < dev->n_buffers; ++i) {
                          struct v4l2_buffer buf;
  
                          CLEAR(buf);
@@ -260,91 +559,119 @@
                          buf.memory = V4L2_MEMORY_MMAP;
                          buf.index = i;
  
-                         if (-1 == xioctl(fd, VIDIOC_QBUF, &buf))
-                                 errno_exit("VIDIOC_QBUF");
+                         if (-1 == xioctl(dev->fd, VIDIOC_QBUF, &buf))
+                                 return device_error(dev, "VIDIOC_QBUF");
                  }
                  type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-                 if (-1 == xioctl(fd, VIDIOC_STREAMON, &type))
-                         errno_exit("VIDIOC_STREAMON");
+                 if (-1 == xioctl(dev->fd, VIDIOC_STREAMON, &type))
+                         return device_error(dev, "VIDIOC_STREAMON");
                  break;
  
          case IO_METHOD_USERPTR:
-                 for (i = 0; i < n_buffers; ++i) {
+                 for (i = 0; i < dev->n_buffers; ++i) {
                          struct v4l2_buffer buf;
  
                          CLEAR(buf);
                          buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
                          buf.memory = V4L2_MEMORY_USERPTR;
                          buf.index = i;
-                         buf.m.userptr = (unsigned long)buffers[i].start;
-                         buf.length = buffers[i].length;
+                         buf.m.userptr = (unsigned long)dev->buffers[i].start;
+                         buf.length = dev->buffers[i].length;
  
-                         if (-1 == xioctl(fd, VIDIOC_QBUF, &buf))
-                                 errno_exit("VIDIOC_QBUF");
+                         if (-1 == xioctl(dev->fd, VIDIOC_QBUF, &buf))
+                                 return device_error(dev, "VIDIOC_QBUF");
                  }
                  type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-                 if (-1 == xioctl(fd, VIDIOC_STREAMON, &type))
-                         errno_exit("VIDIOC_STREAMON");
+                 if (-1 == xioctl(dev->fd, VIDIOC_STREAMON, &type))
+                         return device_error(dev, "VIDIOC_STREAMON");
+                 break;
+ 
+         case IO_METHOD_DMABUF:
+                 for (i = 0; i < dev->n_buffers; ++i) {
+                         struct v4l2_buffer buf;
+ 
+                         CLEAR(buf);
+                         buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+                         buf.memory = V4L2_MEMORY_DMABUF;
+                         buf.index = i;
+                         buf.m.fd = dev->buffers[i].fd;
+ 
+                         if (-1 == xioctl(dev->fd, VIDIOC_QBUF, &buf))
+                                 return device_error(dev, "VIDIOC_QBUF");
+                 }
+                 type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+                 if (-1 == xioctl(dev->fd, VIDIOC_STREAMON, &type))
+                         return device_error(dev, "VIDIOC_STREAMON");
                  break;
          }
+         return 0;
  }
  
- static void uninit_device(void)
+ static void uninit_device(struct device *dev)
  {
          unsigned int i;
  
          switch (io) {
          case IO_METHOD_READ:
-                 free(buffers[0].start);
+                 free(dev->buffers[0].start);
                  break;
  
          case IO_METHOD_MMAP:
-                 for (i = 0; i < n_buffers; ++i)
-                         if (-1 == munmap(buffers[i].start, buffers[i].length))
+                 for (i = 0; i < dev->n_buffers; ++i)
+                         if (-1 == munmap(dev->buffers[i].start, dev->buffers[i].length))
                                  errno_exit("munmap");
                  break;
  
          case IO_METHOD_USERPTR:
-                 for (i = 0; i < n_buffers; ++i)
-                         free(buffers[i].start);
+                 for (i = 0; i < dev->n_buffers; ++i)
+                         free(dev->buffers[i].start);
+                 break;
+ 
+         case IO_METHOD_DMABUF:
+                 for (i = 0; i < dev->n_buffers; ++i) {
+                         if (-1 == munmap(dev->buffers[i].start, dev->buffers[i].length))
+                                 errno_exit("munmap");
+                         close(dev->buffers[i].fd);
+                 }
                  break;
          }
  
-         free(buffers);
+         free(dev->buffers);
  }
  
- static void init_read(unsigned int buffer_size)
+ static void init_read(struct device *dev, unsigned int buffer_size)
  {
-         buffers = calloc(1, sizeof(*buffers));
+         dev->buffers = calloc(1, sizeof(*dev->buffers));
  
-         if (!buffers) {
+         if (!dev->buffers) {
                  fprintf(stderr, "Out of memory\n");
                  exit(EXIT_FAILURE);
          }
  
-         buffers[0].length = buffer_size;
-         buffers[0].start = malloc(buffer_size);
+         dev->buffers[0].length = buffer_size;
+         dev->buffers[0].start = malloc(buffer_size);
  
-         if (!buffers[0].start) {
+         if (!dev->buffers[0].start) {
                  fprintf(stderr, "Out of memory\n");
                  exit(EXIT_FAILURE);
          }
  }
  
- static void init_mmap(void)
+ static void init_mmap(struct device *dev)
  {
          struct v4l2_requestbuffers req;
  
          CLEAR(req);
  
-         req.count = 4;
+         /* Adaptive mode starts small and grows on demand. */
+         req.count = buffer_budget ? 2 : 4;
          req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
          req.memory = V4L2_MEMORY_MMAP;
  
-         if (-1 == xioctl(fd, VIDIOC_REQBUFS, &req)) {
+         if (-1 == xioctl(dev->fd, VIDIOC_REQBUFS, &req)) {
                  if (EINVAL == errno) {
                          fprintf(stderr, "%s does not support "
-                                  "memory mapping\n", dev_name);
+                                  "memory mapping\n", dev->name);
                          exit(EXIT_FAILURE);
                  } else {
                          errno_exit("VIDIOC_REQBUFS");
@@ -353,43 +680,44 @@
  
          if (req.count < 2) {
                  fprintf(stderr, "Insufficient buffer memory on %s\n",
-                          dev_name);
+                          dev->name);
                  exit(EXIT_FAILURE);
          }
  
-         buffers = calloc(req.count, sizeof(*buffers));
+         dev->buffers = calloc(req.count, sizeof(*dev->buffers));
  
-         if (!buffers) {
+         if (!dev->buffers) {
                  fprintf(stderr, "Out of memory\n");
                  exit(EXIT_FAILURE);
          }
  
-         for (n_buffers = 0; n_buffers < req.count; ++n_buffers) {
+         for (dev->n_buffers = 0; dev->n_buffers < req.count; ++dev->n_buffers) {
                  struct v4l2_buffer buf;
  
                  CLEAR(buf);
  
                  buf.type        = V4L2_BUF_TYPE_VIDEO_CAPTURE;
                  buf.memory      = V4L2_MEMORY_MMAP;
-                 buf.index       = n_buffers;
+                 buf.index       = dev->n_buffers;
  
-                 if (-1 == xioctl(fd, VIDIOC_QUERYBUF, &buf))
+                 if (-1 == xioctl(dev->fd, VIDIOC_QUERYBUF, &buf))
                          errno_exit("VIDIOC_QUERYBUF");
  
-                 buffers[n_buffers].length = buf.length;
-                 buffers[n_buffers].start =
+                 dev->buffers[dev->n_buffers].length = buf.length;
+                 dev->buffers[dev->n_buffers].start =
                          mmap(NULL /* start anywhere */,
                                buf.length,
                                PROT_READ | PROT_WRITE /* required */,
                                MAP_SHARED /* recommended */,
-                               fd, buf.m.offset);
+                               dev->fd, buf.m.offset);
  
-                 if (MAP_FAILED == buffers[n_buffers].start)
+                 if (MAP_FAILED == dev->buffers[dev->n_buffers].start)
                          errno_exit("mmap");
+                 dev->buffer_bytes += buf.length;
          }
  }
  
- static void init_userp(unsigned int buffer_size)
+ static void init_userp(struct device *dev, unsigned int buffer_size)
  {
          struct v4l2_requestbuffers req;
  
@@ -399,35 +727,119 @@
          req.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
          req.memory = V4L2_MEMORY_USERPTR;
  
-         if (-1 == xioctl(fd, VIDIOC_REQBUFS, &req)) {
+         if (-1 == xioctl(dev->fd, VIDIOC_REQBUFS, &req)) {
                  if (EINVAL == errno) {
                          fprintf(stderr, "%s does not support "
-                                  "user pointer i/o\n", dev_name);
+                                  "user pointer i/o\n", dev->name);
                          exit(EXIT_FAILURE);
                  } else {
                          errno_exit("VIDIOC_REQBUFS");
                  }
          }
  
-         buffers = calloc(4, sizeof(*buffers));
+         dev->buffers = calloc(4, sizeof(*dev->buffers));
  
-         if (!buffers) {
+         if (!dev->buffers) {
                  fprintf(stderr, "Out of memory\n");
                  exit(EXIT_FAILURE);
          }
  
-         for (n_buffers = 0; n_buffers < 4; ++n_buffers) {
-                 buffers[n_buffers].length = buffer_size;
-                 buffers[n_buffers].start = malloc(buffer_size);
+         for (dev->n_buffers = 0; dev->n_buffers < 4; ++dev->n_buffers) {
+                 dev->buffers[dev->n_buffers].length = buffer_size;
+                 dev->buffers[dev->n_buffers].start = malloc(buffer_size);
  
-                 if (!buffers[n_buffers].start) {
+                 if (!dev->buffers[dev->n_buffers].start) {
                          fprintf(stderr, "Out of memory\n");
                          exit(EXIT_FAILURE);
                  }
          }
  }
  
- static void init_device(void)
+ /* Allocate one page-aligned dmabuf: a sealed memfd turned into a dmabuf
+  * by /dev/udmabuf. The application owns the pages; the fd can be queued
+  * to any V4L2 device or passed to another process. */
+ static int create_udmabuf(int udmabuf_dev, size_t size)
+ {
+         struct udmabuf_create create;
+         int memfd, fd;
+ 
+         memfd = memfd_create("v4l2-capture", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+         if (-1 == memfd)
+                 errno_exit("memfd_create");
+         if (-1 == ftruncate(memfd, size))
+                 errno_exit("ftruncate");
+         /* udmabuf insists the memfd can no longer shrink. */
+         if (-1 == fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK))
+                 errno_exit("F_ADD_SEALS");
+ 
+         CLEAR(create);
+         create.memfd  = memfd;
+         create.flags  = UDMABUF_FLAGS_CLOEXEC;
+         create.offset = 0;
+         create.size   = size;
+         fd = xioctl(udmabuf_dev, UDMABUF_CREATE, &create);
+         if (-1 == fd)
+                 errno_exit("UDMABUF_CREATE");
+ 
+         /* The dmabuf keeps the pages alive. */
+         close(memfd);
+         return fd;
+ }
+ 
+ static void init_dmabuf(struct device *dev, unsigned int buffer_size)
+ {
+         struct v4l2_requestbuffers req;
+         size_t page = sysconf(_SC_PAGESIZE);
+         size_t size = (buffer_size + page - 1) & ~(page - 1);
+         int udmabuf_dev;
+ 
+         udmabuf_dev = open("/dev/udmabuf", O_RDWR | O_CLOEXEC);
+         if (-1 == udmabuf_dev) {
+                 fprintf(stderr, "Cannot open /dev/udmabuf: %d, %s\n",
+                          errno, strerror(errno));
+                 exit(EXIT_FAILURE);
+         }
+ 
+         CLEAR(req);
+ 
+         req.count  = 4;
+         req.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+         req.memory = V4L2_MEMORY_DMABUF;
+ 
+         if (-1 == xioctl(dev->fd, VIDIOC_REQBUFS, &req)) {
+                 if (EINVAL == errno) {
+                         fprintf(stderr, "%s does not support "
+                                  "dmabuf i/o\n", dev->name);
+                         exit(EXIT_FAILURE);
+                 } else {
+                         errno_exit("VIDIOC_REQBUFS");
+                 }
+         }
+ 
+         dev->buffers = calloc(req.count, sizeof(*dev->buffers));
+ 
+         if (!dev->buffers) {
+                 fprintf(stderr, "Out of memory\n");
+                 exit(EXIT_FAILURE);
+         }
+ 
+         for (dev->n_buffers = 0; dev->n_buffers < req.count; ++dev->n_buffers) {
+                 struct buffer *b = &dev->buffers[dev->n_buffers];
+ 
+                 b->fd = create_udmabuf(udmabuf_dev, size);
+                 b->length = size;
+                 b->start = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                                 MAP_SHARED, b->fd, 0);
+ 
+                 if (MAP_FAILED == b->start)
+                         errno_exit("mmap");
+                 dev->buffer_bytes += size;
+         }
+ 
+         close(udmabuf_dev);
+ }
+ 
+ static void init_device(struct device *dev)
  {
          struct v4l2_capability cap;
          struct v4l2_cropcap cropcap;
@@ -435,10 +847,10 @@
          struct v4l2_format fmt;
          unsigned int min;
  
-         if (-1 == xioctl(fd, VIDIOC_QUERYCAP, &cap)) {
+         if (-1 == xioctl(dev->fd, VIDIOC_QUERYCAP, &cap)) {
                  if (EINVAL == errno) {
                          fprintf(stderr, "%s is no V4L2 device\n",
-                                  dev_name);
+                                  dev->name);
                          exit(EXIT_FAILURE);
                  } else {
                          errno_exit("VIDIOC_QUERYCAP");
@@ -447,7 +859,7 @@
  
          if (!(cap.capabilities & V4L2_CAP_VIDEO_CAPTURE)) {
                  fprintf(stderr, "%s is no video capture device\n",
-                          dev_name);
+                          dev->name);
                  exit(EXIT_FAILURE);
          }
  
@@ -455,16 +867,17 @@
          case IO_METHOD_READ:
                  if (!(cap.capabilities & V4L2_CAP_READWRITE)) {
                          fprintf(stderr, "%s does not support read i/o\n",
-                                  dev_name);
+                                  dev->name);
                          exit(EXIT_FAILURE);
                  }
                  break;
  
          case IO_METHOD_MMAP:
          case IO_METHOD_USERPTR:
+         case IO_METHOD_DMABUF:
                  if (!(cap.capabilities & V4L2_CAP_STREAMING)) {
                          fprintf(stderr, "%s does not support streaming i/o\n",
-                                  dev_name);
+                                  dev->name);
                          exit(EXIT_FAILURE);
                  }
                  break;
@@ -478,11 +891,11 @@
  
          cropcap.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
  
-         if (0 == xioctl(fd, VIDIOC_CROPCAP, &cropcap)) {
+         if (0 == xioctl(dev->fd, VIDIOC_CROPCAP, &cropcap)) {
                  crop.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
                  crop.c = cropcap.defrect; /* reset to default */
  
-                 if (-1 == xioctl(fd, VIDIOC_S_CROP, &crop)) {
+                 if (-1 == xioctl(dev->fd, VIDIOC_S_CROP, &crop)) {
                          switch (errno) {
                          case EINVAL:
                                  /* Cropping not supported. */
@@ -507,13 +920,13 @@
                  fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_H264; //replace
                  fmt.fmt.pix.field       = V4L2_FIELD_ANY;
  
-                 if (-1 == xioctl(fd, VIDIOC_S_FMT, &fmt))
+                 if (-1 == xioctl(dev->fd, VIDIOC_S_FMT, &fmt))
                          errno_exit("VIDIOC_S_FMT");
  
                  /* Note VIDIOC_S_FMT may change width and height. */
          } else {
                  /* Preserve original settings as set by v4l2-ctl for example */
-                 if (-1 == xioctl(fd, VIDIOC_G_FMT, &fmt))
+                 if (-1 == xioctl(dev->fd, VIDIOC_G_FMT, &fmt))
                          errno_exit("VIDIOC_G_FMT");
          }
  
@@ -527,47 +940,51 @@
  
          switch (io) {
          case IO_METHOD_READ:
-                 init_read(fmt.fmt.pix.sizeimage);
+                 init_read(dev, fmt.fmt.pix.sizeimage);
                  break;
  
          case IO_METHOD_MMAP:
-                 init_mmap();
+                 init_mmap(dev);
                  break;
  
          case IO_METHOD_USERPTR:
-                 init_userp(fmt.fmt.pix.sizeimage);
+                 init_userp(dev, fmt.fmt.pix.sizeimage);
+                 break;
+ 
+         case IO_METHOD_DMABUF:
+                 init_dmabuf(dev, fmt.fmt.pix.sizeimage);
                  break;
          }
  }
  
- static void close_device(void)
+ static void close_device(struct device *dev)
  {
-         if (-1 == close(fd))
+         if (-1 == close(dev->fd))
                  errno_exit("close");
  
-         fd = -1;
+         dev->fd = -1;
  }
  
- static void open_device(void)
+ static void open_device(struct device *dev)
  {
          struct stat st;
  
-         if (-1 == stat(dev_name, &st)) {
+         if (-1 == stat(dev->name, &st)) {
                  fprintf(stderr, "Cannot identify '%s': %d, %s\n",
-                          dev_name, errno, strerror(errno));
+                          dev->name, errno, strerror(errno));
                  exit(EXIT_FAILURE);
          }
  
          if (!S_ISCHR(st.st_mode)) {
-                 fprintf(stderr, "%s is no device\n", dev_name);
+                 fprintf(stderr, "%s is no device\n", dev->name);
                  exit(EXIT_FAILURE);
          }
  
-         fd = open(dev_name, O_RDWR /* required */ | O_NONBLOCK, 0);
+         dev->fd = open(dev->name, O_RDWR /* required */ | O_NONBLOCK, 0);
  
-         if (-1 == fd) {
+         if (-1 == dev->fd) {
                  fprintf(stderr, "Cannot open '%s': %d, %s\n",
-                          dev_name, errno, strerror(errno));
+                          dev->name, errno, strerror(errno));
                  exit(EXIT_FAILURE);
          }
  }
@@ -576,38 +993,45 @@
  {
          fprintf(fp,
                   "Usage: %s [options]\n\n"
-                  "Version 1.3\n"
+                  "Version 1.5\n"
                   "Options:\n"
-                  "-d | --device name   Video device name [%s]\n"
+                  "-d | --device name   Video device name, repeat for several [/dev/video0]\n"
                   "-h | --help          Print this message\n"
                   "-m | --mmap          Use memory mapped buffers [default]\n"
                   "-r | --read          Use read() calls\n"
                   "-u | --userp         Use application allocated buffers\n"
+                  "-b | --dmabuf        Use application owned dmabufs (udmabuf over memfd)\n"
                   "-o | --output        Outputs stream to stdout\n"
                   "-f | --format        Force format to 640x480 YUYV\n"
-                  "-c | --count         Number of frames to grab [%i]\n"
+                  "-c | --count         Number of frames to grab per device [%i]\n"
+                  "-t | --timeout ms    Restart a device silent for this long [%i]\n"
+                  "-a | --adaptive MB   Start with 2 mmap buffers, add more on driver\n"
+                  "                     drops up to MB megabytes per device\n"
                   "",
-                  argv[0], dev_name, frame_count);
+                  argv[0], frame_count, timeout_ms);
  }
  
- static const char short_options[] = "d:hmruofc:";
+ static const char short_options[] = "d:hmrubofc:t:a:";
  
  static const struct option
  long_options[] = {
-         { "device", required_argument, NULL, 'd' },
-         { "help",   no_argument,       NULL, 'h' },
-         { "mmap",   no_argument,       NULL, 'm' },
-         { "read",   no_argument,       NULL, 'r' },
-         { "userp",  no_argument,       NULL, 'u' },
-         { "output", no_argument,       NULL, 'o' },
-         { "format", no_argument,       NULL, 'f' },
-         { "count",  required_argument, NULL, 'c' },
+         { "device",  required_argument, NULL, 'd' },
+         { "help",    no_argument,       NULL, 'h' },
+         { "mmap",    no_argument,       NULL, 'm' },
+         { "read",    no_argument,       NULL, 'r' },
+         { "userp",   no_argument,       NULL, 'u' },
+         { "dmabuf",  no_argument,       NULL, 'b' },
+         { "output",  no_argument,       NULL, 'o' },
+         { "format",  no_argument,       NULL, 'f' },
+         { "count",   required_argument, NULL, 'c' },
+         { "timeout", required_argument, NULL, 't' },
+         { "adaptive", required_argument, NULL, 'a' },
          { 0, 0, 0, 0 }
  };
  
  int main(int argc, char **argv)
  {
-         dev_name = "/dev/video0";
+         unsigned int i;
  
          for (;;) {
                  int idx;
@@ -624,7 +1048,12 @@
                          break;
  
                  case 'd':
-                         dev_name = optarg;
+                         if (n_devices == MAX_DEVICES) {
+                                 fprintf(stderr, "At most %d devices\n",
+                                         MAX_DEVICES);
+                                 exit(EXIT_FAILURE);
+                         }
+                         devices[n_devices++].name = optarg;
                          break;
  
                  case 'h':
@@ -643,6 +1072,10 @@
                          io = IO_METHOD_USERPTR;
                          break;
  
+                 case 'b':
+                         io = IO_METHOD_DMABUF;
+                         break;
+ 
                  case 'o':
                          out_buf++;
                          break;
@@ -658,19 +1091,44 @@
                                  errno_exit(optarg);
                          break;
  
+                 case 't':
+                         errno = 0;
+                         timeout_ms = strtol(optarg, NULL, 0);
+                         if (errno)
+                                 errno_exit(optarg);
+                         break;
+ 
+                 case 'a':
+                         errno = 0;
+                         buffer_budget = strtoul(optarg, NULL, 0) << 20;
+                         if (errno)
+                                 errno_exit(optarg);
+                         break;
+ 
                  default:
                          usage(stderr, argc, argv);
                          exit(EXIT_FAILURE);
                  }
          }
  
-         open_device();
-         init_device();
-         start_capturing();
+         if (n_devices == 0)
+                 devices[n_devices++].name = "/dev/video0";
+ 
+         for (i = 0; i < n_devices; ++i) {
+                 devices[i].index = i;
+                 frame_stats_init(&devices[i].stats);
+                 open_device(&devices[i]);
+                 init_device(&devices[i]);
+                 if (-1 == start_capturing(&devices[i]))
+                         exit(EXIT_FAILURE);
+         }
          mainloop();
-         stop_capturing();
-         uninit_device();
-         close_device();
+         for (i = 0; i < n_devices; ++i) {
+                 frame_stats_print(stderr, devices[i].name, &devices[i].stats);
+                 stop_capturing(&devices[i]);
+                 uninit_device(&devices[i]);
+                 close_device(&devices[i]);
+         }
          fprintf(stderr, "\n");
          return 0;
  }
\ No newline at end of file
@@ -0,0 +1,52 @@
+// capture_thread.cpp
+#include "capture_thread.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <poll.h>
+
+bool CaptureThread::start() {
+    if (thread_.joinable()) return true;
+    if (!dev_.start()) return false;
+
+    stop_.store(false, std::memory_order_relaxed);
+    running_.store(true, std::memory_order_release);
+    thread_ = std::thread(&CaptureThread::run, this);
+    return true;
+}
+
+void CaptureThread::stop() {
+    if (!thread_.joinable()) return;
+    stop_.store(true, std::memory_order_relaxed);
+    thread_.join();
+
+    Frame f;
+    while (ring_.pop(f)) f.release();
+}
+
+void CaptureThread::run() {
+    // Wake up periodically so stop() never waits on a stalled camera.
+    pollfd pfd{dev_.fd(), POLLIN, 0};
+
+    while (!stop_.load(std::memory_order_relaxed)) {
+        int r = poll(&pfd, 1, 100);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            break;
+        }
+        if (r == 0) continue;
+        if (!(pfd.revents & POLLIN)) {
+            // Some drivers report POLLERR while the consumer holds every
+            // buffer; back off until one is queued again.
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+
+        Frame frame = dev_.grab();
+        if (!frame) break;
+        ring_.push(std::move(frame));
+    }
+    running_.store(false, std::memory_order_release);
+}
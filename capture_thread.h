@@ -0,0 +1,51 @@
+// capture_thread.h
+//
+// Runs CaptureDevice::grab() on a dedicated thread so buffers are dequeued
+// as soon as the driver fills them, independent of how long the consumer
+// takes to render or swap. Frames are handed over through an SPSC ring and
+// are re-queued by whichever thread finally drops them.
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include "capture_device.h"
+#include "frame_ring.h"
+
+class CaptureThread {
+public:
+    explicit CaptureThread(CaptureDevice& dev) : dev_(dev) {}
+    ~CaptureThread() { stop(); }
+
+    CaptureThread(const CaptureThread&)            = delete;
+    CaptureThread& operator=(const CaptureThread&) = delete;
+
+    // Start streaming (if needed) and spawn the capture thread.
+    bool start();
+    // Join the capture thread and re-queue any frames still in the ring.
+    void stop();
+
+    // Non-blocking; returns false when no new frame is ready.
+    bool pop(Frame& out) { return ring_.pop(out); }
+    // Drain the ring, keeping only the newest frame. Older ones are
+    // re-queued to the driver immediately.
+    bool pop_latest(Frame& out) {
+        unsigned got = 0;
+        while (ring_.pop(out)) ++got;
+        if (got > 1) dev_.count_app_drop(got - 1);
+        return got > 0;
+    }
+
+    // False once the capture thread has exited on a device error.
+    bool running() const { return running_.load(std::memory_order_acquire); }
+
+private:
+    void run();
+
+    // A device never has more than VIDEO_MAX_FRAME buffers, so the ring can
+    // hold every outstanding frame and push() cannot fail.
+    CaptureDevice&                     dev_;
+    SpscRing<Frame, VIDEO_MAX_FRAME>   ring_;
+    std::thread                        thread_;
+    std::atomic<bool>                  stop_{false};
+    std::atomic<bool>                  running_{false};
+};
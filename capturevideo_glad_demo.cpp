@@ -1,18 +1,23 @@
 // v4l2_glad_demo.cpp
 #include <iostream>
 #include <vector>
-#include <array>
+#include <deque>
+#include <memory>
 #include <algorithm>
 #include <cstring>
-#include <fcntl.h>
-#include <unistd.h>
-#include <sys/ioctl.h>
-#include <sys/mman.h>
-#include <linux/videodev2.h>
+#include <string>
+#include "capture_device.h"
+#include "capture_thread.h"
+#include "gl_upload.h"
+#include "worker_pool.h"
+#include "yuv_transform.h"
+#include "yuv16_convert.h"
+#include "pbo_ring.h"
+#include "mjpeg_decoder.h"
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
-//g++ capturevideo_glad_demo.cpp glad/src/glad.c -I./glad/include  -o v4l2_glad_demo     `pkg-config --cflags --libs glfw3` -lv4l2 -ldl
+//g++ capturevideo_glad_demo.cpp capture_device.cpp capture_thread.cpp format_negotiator.cpp yuv_convert.cpp yuv_transform.cpp yuv16_convert.cpp worker_pool.cpp pbo_ring.cpp gl_upload.cpp mjpeg_decoder.cpp glad/src/glad.c -I./glad/include  -o v4l2_glad_demo     `pkg-config --cflags --libs glfw3` -lv4l2 -ljpeg -ldl -pthread
 
 //
 // === V4L2 VIDEO CAPTURE SETUP ===
@@ -22,100 +27,223 @@ const int WIDTH  = 640;
 const int HEIGHT = 480;
 const int NUM_BUFFERS = 4;
 
-struct Buffer {
-    void*  start;
-    size_t length;
-};
-std::vector<Buffer> buffers;
-int v4l2_fd = -1;
+// --latest: show only the newest frame, dropping any that queued up while
+// rendering fell behind (lower latency instead of every frame).
+bool latest_only = false;
+
+// --budget MB: start with 2 buffers and let the capture engine add more
+// whenever the driver drops frames, up to MB megabytes of buffer memory.
+size_t buffer_budget = 0;
+
+// --goal latency|fps|bandwidth: let the negotiator pick the YUYV size and
+// frame rate (WIDTH×HEIGHT becomes the minimum) instead of forcing them.
+CaptureGoal goal = CaptureGoal::None;
+
+// --threads N: convert each frame in row stripes on N threads (0 = one per
+// CPU) instead of only on the render thread.
+unsigned convert_threads = 1;
+
+// --pbo N: stream uploads through a ring of N pixel unpack buffers, so
+// the CPU fills one while the GL copies another into the texture (0 =
+// glTexSubImage2D straight from client memory).
+unsigned pbo_count = 3;
+PboRing pbo_ring;
+
+// --userptr: capture with V4L2_MEMORY_USERPTR straight into persistently
+// mapped GL buffers, one per V4L2 buffer, and texture from them (implies
+// --gpu). No CPU touches the pixels; a frame stays dequeued until the
+// fence after its texture upload has signalled.
+bool userptr_capture = false;
+PersistentPbos camera_pbos;
+std::deque<Frame> in_flight;
+
+// --mjpeg: capture MJPEG and decode it with libjpeg-turbo on --decoders N
+// threads (0 = one per CPU), one whole frame per thread, shown in capture
+// order. Decodes to RGB, or with --gpu to Y/Cb/Cr planes that the shader
+// converts. --scale N decodes at 1/N size (2, 4, 8) with libjpeg-turbo's
+// scaled IDCT, for previews that only need a small image.
+unsigned decode_threads = 0;
+unsigned mjpeg_scale = 1;
+std::unique_ptr<MjpegDecoder> decoder;
+GLuint chroma_tex[2];
+
+// --gpu: upload the raw YUYV frame as a half-width RGBA8 texture and
+// convert in the fragment shader; no CPU conversion, 2 instead of 3 bytes
+// per pixel uploaded.
+//
+// --size WxH, --crop WxH+X+Y, --rotate 0|90|180|270, --flip h|v,
+// --filter box|bilinear: crop, resample, mirror and rotate the YUYV frame
+// in the same pass that converts it to RGB, so the texture and window are
+// the output size and no full-size RGB frame is built. CPU path only.
+//
+// --format y10|y12|y14|y16|p010: capture more than 8 bits per sample
+// instead of YUYV. Converted to the RGB texture on the CPU, or with --gpu
+// uploaded as 16-bit textures (GL_R16, plus GL_RG16 for P010's CbCr) that
+// the shader windows or converts, so no precision is lost on the way.
+// --window auto|BLACK:WHITE[:GAMMA]: greyscale display window in sample
+// units; auto (the default) follows the scene's histogram.
+//
+// These and --mjpeg land in `upload`, which lays out, fills and uploads every
+// frame (gl_upload.h).
+FrameUpload upload;
+
+// --align N: ask the driver for rows padded to a multiple of N bytes (e.g.
+// 64), so every row the converters read starts on a cache line.
+uint32_t stride_align = 0;
+
+CaptureDevice camera;
+CaptureThread capture(camera);
 
 void init_v4l2() {
-    v4l2_fd = open(VIDEO_DEVICE, O_RDWR);
-    if (v4l2_fd < 0) { perror("Opening V4L2 device"); exit(EXIT_FAILURE); }
-
-    // 1) Query capabilities
-    v4l2_capability caps{};
-    ioctl(v4l2_fd, VIDIOC_QUERYCAP, &caps);
-
-    // 2) Set format (YUYV @ WIDTH×HEIGHT)
-    v4l2_format fmt{};
-    fmt.type                = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    fmt.fmt.pix.width       = WIDTH;
-    fmt.fmt.pix.height      = HEIGHT;
-    fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_YUYV;
-    fmt.fmt.pix.field       = V4L2_FIELD_INTERLACED;
-    ioctl(v4l2_fd, VIDIOC_S_FMT, &fmt);
-
-    // 3) Request MMAP buffers
-    v4l2_requestbuffers req{};
-    req.count  = NUM_BUFFERS;
-    req.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    req.memory = V4L2_MEMORY_MMAP;
-    ioctl(v4l2_fd, VIDIOC_REQBUFS, &req);
-
-    buffers.resize(req.count);
-    for (int i = 0; i < (int)req.count; ++i) {
-        v4l2_buffer buf{};
-        buf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        buf.memory = V4L2_MEMORY_MMAP;
-        buf.index  = i;
-        ioctl(v4l2_fd, VIDIOC_QUERYBUF, &buf);
-
-        buffers[i].length = buf.length;
-        buffers[i].start = mmap(nullptr, buf.length,
-                                 PROT_READ | PROT_WRITE,
-                                 MAP_SHARED, v4l2_fd, buf.m.offset);
-    }
-
-    // 4) Queue all buffers
-    for (int i = 0; i < (int)buffers.size(); ++i) {
-        v4l2_buffer buf{};
-        buf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        buf.memory = V4L2_MEMORY_MMAP;
-        buf.index  = i;
-        ioctl(v4l2_fd, VIDIOC_QBUF, &buf);
-    }
-
-    // 5) Start streaming
-    int type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    ioctl(v4l2_fd, VIDIOC_STREAMON, &type);
+    CaptureConfig cfg;
+    cfg.device      = VIDEO_DEVICE;
+    cfg.width       = WIDTH;
+    cfg.height      = HEIGHT;
+    cfg.pixelformat = upload.mjpeg ? V4L2_PIX_FMT_MJPEG
+                    : upload.yuv16_fourcc ? upload.yuv16_fourcc : V4L2_PIX_FMT_YUYV;
+    cfg.field       = V4L2_FIELD_INTERLACED;
+    cfg.num_buffers = buffer_budget ? 2 : NUM_BUFFERS;
+    cfg.buffer_budget = buffer_budget;
+    cfg.goal        = goal;
+    cfg.formats     = {cfg.pixelformat};
+    cfg.userptr     = userptr_capture;
+    cfg.stride_align = stride_align;
+    if (userptr_capture) cfg.buffer_budget = 0;
+    if (!camera.open(cfg)) exit(EXIT_FAILURE);
+}
+
+// Back every V4L2 buffer with its own persistently mapped GL buffer.
+bool init_userptr() {
+    if (!camera_pbos.init(camera.sizeimage(), camera.buffer_count())) return false;
+    for (unsigned i = 0; i < camera_pbos.count(); ++i)
+        if (!camera.set_userptr(i, 0, camera_pbos.data(i), camera_pbos.size())) return false;
+    return true;
+}
+
+// Give buffers back to the driver once the GL has finished reading them.
+// Uploads complete in order, so stop at the first one still pending.
+void release_read_frames() {
+    while (!in_flight.empty() && camera_pbos.signalled(in_flight.front().index()))
+        in_flight.pop_front();
 }
 
-// Simple YUYV→RGB conversion
-void yuyv_to_rgb(const uint8_t* yuyv, uint8_t* rgb) {
-    for (int i = 0; i < WIDTH * HEIGHT * 2; i += 4) {
-        int y0 = yuyv[i+0] << 8, u = yuyv[i+1] - 128;
-        int y1 = yuyv[i+2] << 8, v = yuyv[i+3] - 128;
-        auto conv = [&](int Y){
-            int r = (Y + 359*v) >> 8;
-            int g = (Y -  88*u - 183*v) >> 8;
-            int b = (Y + 454*u) >> 8;
-            return std::array<uint8_t,3>{
-                (uint8_t)std::clamp(r,0,255),
-                (uint8_t)std::clamp(g,0,255),
-                (uint8_t)std::clamp(b,0,255)
-            };
-        };
-        auto p0 = conv(y0), p1 = conv(y1);
-        rgb[0]=p0[0]; rgb[1]=p0[1]; rgb[2]=p0[2];
-        rgb[3]=p1[0]; rgb[4]=p1[1]; rgb[5]=p1[2];
-        rgb += 6;
+// (Re)allocate a texture when the decoded size changes.
+void size_texture(GLuint tex, GLenum internal, GLenum format, int w, int h) {
+    GLint cur_w = 0, cur_h = 0;
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH,  &cur_w);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &cur_h);
+    if (cur_w != w || cur_h != h)
+        glTexImage2D(GL_TEXTURE_2D, 0, internal, w, h, 0, format, GL_UNSIGNED_BYTE, nullptr);
+}
+
+// RGB rows are padded to the default GL_UNPACK_ALIGNMENT of 4, which GL
+// derives by itself; a ROW_LENGTH of stride / 3 would truncate whenever
+// width * 3 is not a multiple of 4 and shear the image. The 1-byte Y/Cb/Cr
+// planes are padded to whole MCUs, so they need ROW_LENGTH.
+void upload_plane(GLuint tex, GLenum internal, GLenum format, const DecodedFrame& f,
+                  unsigned p, unsigned bytes_per_pixel) {
+    size_texture(tex, internal, format, f.plane_width[p], f.plane_height[p]);
+    if (bytes_per_pixel == 1) {
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, f.stride[p]);
     }
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, f.plane_width[p], f.plane_height[p],
+                    format, GL_UNSIGNED_BYTE, f.plane[p]);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 }
 
-// Grab one frame into rgb_buf
-bool grab_frame(std::vector<uint8_t>& rgb_buf) {
-    v4l2_buffer buf{};
-    buf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    buf.memory = V4L2_MEMORY_MMAP;
-    if (ioctl(v4l2_fd, VIDIOC_DQBUF, &buf) < 0) return false;
-    yuyv_to_rgb((uint8_t*)buffers[buf.index].start, rgb_buf.data());
-    ioctl(v4l2_fd, VIDIOC_QBUF, &buf);
+// MJPEG: hand the newest captured frame to the decoder, then upload the
+// next decoded one, if any.
+bool upload_mjpeg(GLuint tex) {
+    static DecodedFrame decoded;
+    Frame frame;
+    if (latest_only ? capture.pop_latest(frame) : capture.pop(frame)) {
+        if (!decoder->submit(frame.data(), frame.size(), frame.buffer().sequence, mjpeg_scale))
+            camera.count_app_drop(1);
+    }
+    frame.release();
+    if (!decoder->pop(decoded)) return false;
+    if (latest_only)
+        while (decoder->pop(decoded)) camera.count_app_drop(1);
+    if (upload.gpu_yuv) {
+        upload_plane(tex,           GL_R8, GL_RED, decoded, 0, 1);
+        upload_plane(chroma_tex[0], GL_R8, GL_RED, decoded, 1, 1);
+        upload_plane(chroma_tex[1], GL_R8, GL_RED, decoded, 2, 1);
+    } else {
+        upload_plane(tex, GL_RGB8, GL_RGB, decoded, 0, 3);
+    }
+    return true;
+}
+
+// Upload the next captured frame into `tex`, if one has arrived. With
+// --gpu the YUYV or 16-bit buffer is uploaded untouched; otherwise it is
+// converted to RGB on the CPU first.
+bool upload_frame(GLuint tex, std::vector<uint8_t>& rgb_buf) {
+    if (decoder) return upload_mjpeg(tex);
+    if (userptr_capture) release_read_frames();
+    Frame frame;
+    if (!(latest_only ? capture.pop_latest(frame) : capture.pop(frame))) return false;
+    // A buffer shorter than the format needs is dropped unseen.
+    const FrameView src = frame.view();
+    if (!src) {
+        camera.count_app_drop(1);
+        return false;
+    }
+    upload.update_grey_window(src);
+    const int height = upload.height();
+    const GLsizei tex_width  = upload.gpu_yuv ? camera.width() / 2 : upload.width();
+    const GLenum  tex_format = upload.gpu_yuv ? GL_RGBA : GL_RGB;
+    glBindTexture(GL_TEXTURE_2D, tex);
+    if (userptr_capture) {
+        // The camera wrote the frame into this buffer itself.
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, camera_pbos.buffer(frame.index()));
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, src.stride[0] / 4);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, tex_width, height,
+                        tex_format, GL_UNSIGNED_BYTE, nullptr);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        camera_pbos.fence(frame.index());
+        in_flight.push_back(std::move(frame));
+        return true;
+    }
+    if (pbo_ring.count()) {
+        // The texture copy runs asynchronously out of the buffer; the
+        // V4L2 buffer goes back to the driver as soon as it has been read.
+        uint8_t* dst = pbo_ring.map();
+        if (!dst) return false;
+        upload.fill(src, dst, upload.stride());
+        frame.release();
+        if (pbo_ring.unmap()) {
+            if (upload.gpu_yuv && upload.yuv16_fourcc)
+                upload.upload_yuv16(tex, chroma_tex[0], nullptr, upload.stride());
+            else
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, tex_width, height,
+                                tex_format, GL_UNSIGNED_BYTE, nullptr);
+        }
+        pbo_ring.submit();
+        return true;
+    }
+    if (upload.gpu_yuv && upload.yuv16_fourcc) {
+        upload.upload_yuv16(tex, chroma_tex[0], src.plane[0], src.stride[0]);
+        return true;
+    }
+    if (upload.gpu_yuv) {
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, src.stride[0] / 4);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, tex_width, height,
+                        tex_format, GL_UNSIGNED_BYTE, src.plane[0]);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        return true;
+    }
+    upload.fill(src, rgb_buf.data(), upload.stride());
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, tex_width, height,
+                    tex_format, GL_UNSIGNED_BYTE, rgb_buf.data());
     return true;
 }
 
 //
-// === GLAD + GLFW + OPENGL 4.6 SETUP ===
+// === GLAD + GLFW + OPENGL 4.5 SETUP ===
 //
 
 // Compile a shader of given type
@@ -151,18 +279,85 @@ GLuint linkProgram(const char* vs_src, const char* fs_src) {
     return p;
 }
 
-int main(){
+int main(int argc, char** argv){
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--latest")) latest_only = true;
+        else if (!strcmp(argv[i], "--budget") && i + 1 < argc)
+            buffer_budget = strtoul(argv[++i], nullptr, 0) << 20;
+        else if (!strcmp(argv[i], "--goal") && i + 1 < argc &&
+                 !parse_capture_goal(argv[++i], goal)) {
+            std::cerr<<"Unknown goal "<<argv[i]<<'\n'; return -1;
+        }
+        else if (!strcmp(argv[i], "--threads") && i + 1 < argc)
+            convert_threads = strtoul(argv[++i], nullptr, 0);
+        else if (!strcmp(argv[i], "--pbo") && i + 1 < argc)
+            pbo_count = strtoul(argv[++i], nullptr, 0);
+        else if (!strcmp(argv[i], "--userptr")) userptr_capture = upload.gpu_yuv = true;
+        else if (!strcmp(argv[i], "--gpu")) upload.gpu_yuv = true;
+        else if (!strcmp(argv[i], "--mjpeg")) upload.mjpeg = true;
+        else if (!strcmp(argv[i], "--align") && i + 1 < argc)
+            stride_align = strtoul(argv[++i], nullptr, 0);
+        else if (!strcmp(argv[i], "--decoders") && i + 1 < argc)
+            decode_threads = strtoul(argv[++i], nullptr, 0);
+        else if (!strcmp(argv[i], "--scale") && i + 1 < argc)
+            mjpeg_scale = strtoul(argv[++i], nullptr, 0);
+        else if (is_transform_option(argv[i]) && i + 1 < argc) {
+            if (!parse_transform_option(argv[i], argv[i + 1], upload.transform)) {
+                std::cerr<<"Bad value for "<<argv[i]<<": "<<argv[i + 1]<<'\n'; return -1;
+            }
+            upload.transforming = true;
+            ++i;
+        }
+        else if (!strcmp(argv[i], "--format") && i + 1 < argc) {
+            upload.yuv16_fourcc = yuv16_pixelformat(argv[++i]);
+            if (!yuv16_format(upload.yuv16_fourcc, upload.yuv16)) {
+                std::cerr<<"Unknown format "<<argv[i]<<'\n'; return -1;
+            }
+        }
+        else if (!strcmp(argv[i], "--window") && i + 1 < argc &&
+                 !parse_grey_window(argv[++i], upload.grey_window, upload.auto_window)) {
+            std::cerr<<"Bad window "<<argv[i]<<'\n'; return -1;
+        }
+    }
+    if (mjpeg_scale != 1 && mjpeg_scale != 2 && mjpeg_scale != 4 && mjpeg_scale != 8) {
+        std::cerr<<"--scale must be 1, 2, 4 or 8\n"; return -1;
+    }
+    if (upload.mjpeg && userptr_capture) {
+        std::cerr<<"--userptr needs a raw format, not --mjpeg\n"; return -1;
+    }
+    if (stride_align & (stride_align - 1)) {
+        std::cerr<<"--align must be a power of two\n"; return -1;
+    }
+    if (upload.transforming && (upload.gpu_yuv || upload.mjpeg || upload.yuv16_fourcc)) {
+        std::cerr<<"--size/--crop/--rotate/--flip/--filter need the CPU YUYV path\n"; return -1;
+    }
+    if (upload.yuv16_fourcc && (upload.mjpeg || userptr_capture)) {
+        std::cerr<<"--format takes neither --mjpeg nor --userptr\n"; return -1;
+    }
+    WorkerPool pool(convert_threads);
+    upload.pool   = &pool;
+    upload.camera = &camera;
+
     // 1) V4L2 init
     init_v4l2();
+    if (upload.transforming &&
+        !frame_transform_resolve(upload.transform, camera.width(), camera.height())) {
+        std::cerr<<"--crop is outside the "<<camera.width()<<"x"<<camera.height()<<" frame\n";
+        return -1;
+    }
+    const int width  = upload.width();   // what the driver negotiated, or transformed to
+    const int height = upload.height();
 
     // 2) GLFW + GLAD init
     if (!glfwInit()) exit(-1);
+    // 4.5 is the newest core profile Mesa's llvmpipe offers, so the demo
+    // also runs on a headless box.
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
     glfwWindowHint(GLFW_OPENGL_PROFILE,        GLFW_OPENGL_CORE_PROFILE);
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GLFW_TRUE);
 
-    GLFWwindow* win = glfwCreateWindow(WIDTH, HEIGHT, "V4L2 + OpenGL 4.6", nullptr, nullptr);
+    GLFWwindow* win = glfwCreateWindow(width, height, "V4L2 + OpenGL 4.5", nullptr, nullptr);
     if (!win) { glfwTerminate(); return -1; }
     glfwMakeContextCurrent(win);
     if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
@@ -171,7 +366,7 @@ int main(){
 
     // 3) Build shaders
     const char* vs_src = R"GLSL(
-        #version 460 core
+        #version 450 core
         layout(location=0) in vec2 aPos;
         layout(location=1) in vec2 aUV;
         out vec2 vUV;
@@ -180,16 +375,29 @@ int main(){
             gl_Position = vec4(aPos, 0.0, 1.0);
         }
     )GLSL";
-    const char* fs_src = R"GLSL(
-        #version 460 core
-        in vec2 vUV;
-        out vec4 FragColor;
-        uniform sampler2D tex;
+    // The YUV conversions are shared with the other demo (gl_upload.h).
+    const std::string fs_src = std::string(R"GLSL(
+        #version 450 core
+    )GLSL") + YUV_SHADER_FUNCTIONS + R"GLSL(
+        // planar == 1: tex holds Y, tex_cb and tex_cr the (subsampled)
+        // chroma planes of a decoded JPEG; linear filtering upsamples them.
+        uniform int  planar;
+        uniform sampler2D tex_cb;
+        uniform sampler2D tex_cr;
+        vec3 planar_to_rgb(){
+            vec3 yuv = vec3(texture(tex, vUV).r, texture(tex_cb, vUV).r, texture(tex_cr, vUV).r);
+            return clamp(yuv_matrix * (yuv - yuv_offset), 0.0, 1.0);
+        }
         void main(){
-            FragColor = texture(tex, vUV);
+            if (yuyv == 1)        FragColor = vec4(yuyv_to_rgb(), 1.0);
+            else if (planar == 1) FragColor = vec4(planar_to_rgb(), 1.0);
+            else if (grey == 1)   FragColor = vec4(grey_to_rgb(), 1.0);
+            else if (p010 == 1)   FragColor = vec4(p010_to_rgb(), 1.0);
+            else                  FragColor = texture(tex, vUV);
         }
     )GLSL";
-    GLuint program = linkProgram(vs_src, fs_src);
+    GLuint program = linkProgram(vs_src, fs_src.c_str());
+    upload.set_yuv_uniforms(program);
 
     // 4) Fullscreen quad setup
     float quad[] = {
@@ -215,20 +423,67 @@ int main(){
     GLuint texID;
     glGenTextures(1, &texID);
     glBindTexture(GL_TEXTURE_2D, texID);
-      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, WIDTH, HEIGHT, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+    if (upload.mjpeg) {
+      // Sized on the first decoded frame; chroma planes go to units 1, 2.
+      glGenTextures(2, chroma_tex);
+      for (GLuint t : {texID, chroma_tex[0], chroma_tex[1]}) {
+        glBindTexture(GL_TEXTURE_2D, t);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+      }
+      decoder = std::make_unique<MjpegDecoder>(
+          upload.gpu_yuv ? MjpegOutput::YuvPlanes : MjpegOutput::Rgb24, decode_threads);
+      std::cerr<<"MJPEG decode on "<<decoder->threads()<<" thread(s)\n";
+    } else if (upload.gpu_yuv && upload.yuv16_fourcc) {
+      // Normalised 16-bit, filtered before the shader windows or converts.
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_R16, width, height, 0, GL_RED, GL_UNSIGNED_SHORT, nullptr);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+      if (upload.yuv16.chroma) {
+        glGenTextures(1, chroma_tex);
+        glBindTexture(GL_TEXTURE_2D, chroma_tex[0]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16, width / 2, height / 2, 0, GL_RG, GL_UNSIGNED_SHORT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+      }
+    } else if (upload.gpu_yuv) {
+      // Two pixels per texel; the shader filters, so sample exact texels.
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, camera.width()/2, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    } else {
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
       glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
       glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    }
+
+    std::vector<uint8_t> rgb_buf;
+    if (userptr_capture) {
+        if (!init_userptr()) return -1;
+    } else if (pbo_count && !upload.mjpeg) {
+        if (!pbo_ring.init(upload.size(), pbo_count)) return -1;
+    } else if (!upload.gpu_yuv) {
+        rgb_buf.resize(upload.size());
+    }
+    if (upload.yuv16_fourcc && upload.gpu_yuv)
+        std::cerr<<fourcc_to_string(upload.yuv16_fourcc)<<": 16-bit textures\n";
+    else if (upload.yuv16_fourcc)
+        std::cerr<<fourcc_to_string(upload.yuv16_fourcc)<<": "<<yuv16_isa()<<" on "
+                 <<upload.pool->size()<<" thread(s)\n";
 
-    std::vector<uint8_t> rgb_buf(WIDTH*HEIGHT*3);
+    // Streaming starts once the GL side can take frames.
+    if (!capture.start()) return -1;
 
     // 6) Main loop
     while (!glfwWindowShouldClose(win)) {
-        if (!grab_frame(rgb_buf)) break;
+        if (!capture.running()) break;
 
-        // Upload new frame
-        glBindTexture(GL_TEXTURE_2D, texID);
-        glTexSubImage2D(GL_TEXTURE_2D,0,0,0,WIDTH,HEIGHT,
-                        GL_RGB,GL_UNSIGNED_BYTE,rgb_buf.data());
+        // Upload new frame; otherwise redraw the last one
+        upload_frame(texID, rgb_buf);
 
         // Render quad
         int w,h; glfwGetFramebufferSize(win,&w,&h);
@@ -239,6 +494,19 @@ int main(){
         glActiveTexture(GL_TEXTURE0);
         glBindTexture(GL_TEXTURE_2D, texID);
         glUniform1i(glGetUniformLocation(program,"tex"), 0);
+        upload.set_window_uniform(program);
+        if (upload.gpu_yuv && upload.yuv16.chroma) {
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, chroma_tex[0]);
+            glActiveTexture(GL_TEXTURE0);
+        }
+        if (upload.mjpeg && upload.gpu_yuv) {
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, chroma_tex[0]);
+            glActiveTexture(GL_TEXTURE2);
+            glBindTexture(GL_TEXTURE_2D, chroma_tex[1]);
+            glActiveTexture(GL_TEXTURE0);
+        }
         glBindVertexArray(VAO);
         glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 
@@ -246,6 +514,21 @@ int main(){
         glfwPollEvents();
     }
 
-    // Cleanup (stream off, munmap, close, glfwTerminate)…
+    // Cleanup
+    if (pbo_ring.count())
+        std::cerr<<"PBO ring: "<<pbo_ring.count()<<" buffers, "<<pbo_ring.stalls()<<" stalls\n";
+    pbo_ring.destroy();
+    in_flight.clear();
+    capture.stop();
+    if (decoder)
+        std::cerr<<"MJPEG: "<<decoder->errors()<<" frames failed to decode\n";
+    decoder.reset();
+    frame_stats stats = camera.stats();
+    frame_stats_print(stderr, VIDEO_DEVICE, &stats);
+    // After STREAMOFF the driver no longer holds the buffer memory.
+    camera.close();
+    camera_pbos.destroy();
+    glfwDestroyWindow(win);
+    glfwTerminate();
     return 0;
 }
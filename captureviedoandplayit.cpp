@@ -1,123 +1,326 @@
-#include <fcntl.h>
-#include <unistd.h>
-#include <sys/ioctl.h>
-#include <sys/mman.h>
-#include <linux/videodev2.h>
+#include "capture_device.h"
+#include "worker_pool.h"
+#include "yuv_convert.h"
+#include "yuv_transform.h"
+#include "bayer.h"
+#include "yuv16_convert.h"
+#include "mjpeg_decoder.h"
 #include <SDL2/SDL.h>
-#include <vector>
 #include <iostream>
-//g++ -o v4l2_sdl_capture captureviedoandplayit.cpp -lv4l2 -lSDL2
-struct Buffer { void* start; size_t length; };
+#include <cstring>
+#include <memory>
+//g++ -o v4l2_sdl_capture captureviedoandplayit.cpp capture_device.cpp format_negotiator.cpp yuv_convert.cpp yuv_transform.cpp bayer.cpp yuv16_convert.cpp worker_pool.cpp mjpeg_decoder.cpp -lv4l2 -lSDL2 -ljpeg -pthread
 
-static inline uint8_t clip(int v) {
-    return v < 0 ? 0 : (v > 255 ? 255 : v);
+// How captured frames reach the screen. The YUV modes hand the camera's
+// own layout to an SDL texture of the same format and let the renderer
+// convert; RGB24 converts YUYV on the CPU, optionally cropped, resized and
+// turned in the same pass. Raw Bayer is demosaiced to RGB24 on the CPU,
+// and 10- to 16-bit greyscale and P010 are brought down to RGB24 there too.
+// MJPEG is decoded to RGB24 on worker threads.
+struct RenderMode {
+    const char* name;
+    uint32_t    v4l2;
+    Uint32      sdl;
+};
+
+static const RenderMode render_modes[] = {
+    {"yuyv", V4L2_PIX_FMT_YUYV, SDL_PIXELFORMAT_YUY2},
+    {"uyvy", V4L2_PIX_FMT_UYVY, SDL_PIXELFORMAT_UYVY},
+    {"nv12", V4L2_PIX_FMT_NV12, SDL_PIXELFORMAT_NV12},
+    {"nv12", V4L2_PIX_FMT_NV12M, SDL_PIXELFORMAT_NV12},
+    {"mjpeg", V4L2_PIX_FMT_MJPEG, SDL_PIXELFORMAT_RGB24},
+};
+
+static const RenderMode* render_mode_for(uint32_t pixelformat) {
+    static const RenderMode bayer_mode = {"bayer", 0, SDL_PIXELFORMAT_RGB24};
+    static const RenderMode yuv16_mode = {"yuv16", 0, SDL_PIXELFORMAT_RGB24};
+    for (const RenderMode& m : render_modes)
+        if (m.v4l2 == pixelformat) return &m;
+    if (is_bayer(pixelformat)) return &bayer_mode;
+    return is_yuv16(pixelformat) ? &yuv16_mode : nullptr;
 }
 
-int main() {
-    // 1) Open & query device
-    int fd = open("/dev/video0", O_RDWR);
-    if (fd < 0) { perror("open"); return 1; }
-    v4l2_capability caps = {};
-    ioctl(fd, VIDIOC_QUERYCAP, &caps);
-
-    // 2) Set format
-    v4l2_format fmt = {};
-    fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    fmt.fmt.pix.width = 1280; fmt.fmt.pix.height = 720;
-    fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_YUYV;
-    fmt.fmt.pix.field = V4L2_FIELD_NONE;
-    ioctl(fd, VIDIOC_S_FMT, &fmt);
-
-    // 3) Request & mmap buffers
-    v4l2_requestbuffers req = {};
-    req.count = 4; req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    req.memory = V4L2_MEMORY_MMAP;
-    ioctl(fd, VIDIOC_REQBUFS, &req);
-    std::vector<Buffer> bufs(req.count);
-    for (auto i = 0u; i < req.count; ++i) {
-        v4l2_buffer buf = {}; buf.type = req.type;
-        buf.memory = req.memory; buf.index = i;
-        ioctl(fd, VIDIOC_QUERYBUF, &buf);
-        bufs[i].length = buf.length;
-        bufs[i].start = mmap(nullptr, buf.length,
-                             PROT_READ|PROT_WRITE,
-                             MAP_SHARED, fd, buf.m.offset);
+static void copy_plane(uint8_t* dst, int dst_pitch, const uint8_t* src, size_t src_stride,
+                       size_t row_bytes, int rows) {
+    for (int y = 0; y < rows; ++y)
+        memcpy(dst + size_t(y) * dst_pitch, src + y * src_stride, row_bytes);
+}
+
+// Write one frame straight into the locked texture, honouring both the
+// strides of the view and the texture pitch. With `transform` the RGB24
+// texture is the transform's output size; `window` is for greyscale.
+static bool upload_frame(SDL_Texture* tex, Uint32 sdl_format, const FrameView& src,
+                         YuvColorimetry cm, WorkerPool& pool, const FrameTransform* transform,
+                         Demosaic demosaic, GreyWindow window) {
+    const int width = src.width, height = src.height;
+    void* pixels;
+    int pitch;
+    if (SDL_LockTexture(tex, nullptr, &pixels, &pitch) < 0) {
+        std::cerr << "SDL_LockTexture: " << SDL_GetError() << "\n";
+        return false;
+    }
+    uint8_t* dst = static_cast<uint8_t*>(pixels);
+    switch (sdl_format) {
+    case SDL_PIXELFORMAT_RGB24: {
+        Yuv16Format yuv16;
+        if (bayer_to_rgb24(src, dst, pitch, demosaic, pool))
+            break;
+        if (yuv16_format(src.pixelformat, yuv16) && yuv16.chroma)
+            p010_to_rgb24(src, dst, pitch, cm, pool);
+        else if (is_yuv16(src.pixelformat))
+            grey16_to_rgb24(src, dst, pitch, window, pool);
+        else if (transform)
+            yuyv_to_rgb24_transform(src, dst, pitch, *transform, cm, pool);
+        else
+            yuyv_to_rgb24(src, dst, pitch, cm, pool);
+        break;
     }
+    case SDL_PIXELFORMAT_NV12:
+        // The view has the CbCr plane whether it follows the Y plane (NV12)
+        // or has a buffer plane of its own (NV12M). SDL's NV12 texture puts
+        // CbCr after `height` rows of `pitch`.
+        copy_plane(dst, pitch, src.plane[0], src.stride[0], width, height);
+        copy_plane(dst + size_t(pitch) * height, pitch, src.plane[1], src.stride[1], width,
+                   (height + 1) / 2);
+        break;
+    default:                            // YUY2, UYVY
+        copy_plane(dst, pitch, src.plane[0], src.stride[0], size_t(width) * 2, height);
+        break;
+    }
+    SDL_UnlockTexture(tex);
+    return true;
+}
 
-    // 4) SDL init
+static bool upload_decoded(SDL_Texture* tex, const DecodedFrame& f) {
+    void* pixels;
+    int pitch;
+    if (SDL_LockTexture(tex, nullptr, &pixels, &pitch) < 0) {
+        std::cerr << "SDL_LockTexture: " << SDL_GetError() << "\n";
+        return false;
+    }
+    copy_plane(static_cast<uint8_t*>(pixels), pitch, f.plane[0], f.stride[0],
+               size_t(f.width) * 3, f.height);
+    SDL_UnlockTexture(tex);
+    return true;
+}
+
+// SDL's YUV textures know three matrices; pick the closest to what the
+// driver reported. Full range is only available as BT.601 (JPEG).
+static SDL_YUV_CONVERSION_MODE sdl_yuv_mode(YuvColorimetry cm) {
+    if (cm.range == YuvRange::Full) return SDL_YUV_CONVERSION_JPEG;
+    return cm.matrix == YuvMatrix::Bt709 ? SDL_YUV_CONVERSION_BT709 : SDL_YUV_CONVERSION_BT601;
+}
+
+int main(int argc, char** argv) {
+    // --latest: drain every ready buffer and display only the newest
+    // --budget MB: start with 2 buffers, grow on driver drops up to MB
+    // --goal latency|fps|bandwidth: negotiate YUYV/UYVY/NV12/MJPEG/Bayer/16-bit
+    //   size/rate, 1280x720 min
+    // --format yuyv|uyvy|nv12|mjpeg|<bayer>|y10|y12|y14|y16|p010: capture format
+    //   without --goal (default yuyv); Bayer names are sbggr8, srggb10, sgrbg10p,
+    //   sgbrg12p, srggb16, ...
+    // --demosaic bilinear|edge: Bayer interpolation (default bilinear)
+    // --window auto|BLACK:WHITE[:GAMMA]: greyscale display window in sample
+    //   units (default auto, following the scene's histogram)
+    // --rgb: convert YUYV to RGB24 on the CPU instead of a YUV texture
+    // --threads N: convert in row stripes on N threads (0 = one per CPU)
+    // --decoders N: decode MJPEG frames on N threads (0 = one per CPU)
+    // --scale N: decode MJPEG at 1/N size (2, 4, 8) for a cheap preview
+    // --size WxH, --crop WxH+X+Y, --rotate 0|90|180|270, --flip h|v,
+    // --filter box|bilinear: convert YUYV straight to that geometry (implies --rgb)
+    // --align N: ask the driver for rows padded to a multiple of N bytes (e.g. 64)
+    bool latest_only = false;
+    size_t buffer_budget = 0;
+    CaptureGoal goal = CaptureGoal::None;
+    uint32_t pixelformat = V4L2_PIX_FMT_YUYV;
+    bool cpu_rgb = false;
+    unsigned threads = 1;
+    unsigned decode_threads = 0;
+    unsigned scale = 1;
+    Demosaic demosaic = Demosaic::Bilinear;
+    GreyWindow window;
+    bool auto_window = true;
+    bool window_seeded = false;
+    FrameTransform transform;
+    bool transforming = false;
+    uint32_t stride_align = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--latest")) latest_only = true;
+        else if (!strcmp(argv[i], "--budget") && i + 1 < argc)
+            buffer_budget = strtoul(argv[++i], nullptr, 0) << 20;
+        else if (!strcmp(argv[i], "--goal") && i + 1 < argc &&
+                 !parse_capture_goal(argv[++i], goal)) {
+            std::cerr << "Unknown goal " << argv[i] << "\n"; return 1;
+        }
+        else if (!strcmp(argv[i], "--format") && i + 1 < argc) {
+            const char* name = argv[++i];
+            const RenderMode* m = nullptr;
+            for (const RenderMode& r : render_modes)
+                if (!strcmp(r.name, name)) { m = &r; break; }
+            pixelformat = m ? m->v4l2 : bayer_pixelformat(name);
+            if (!pixelformat) pixelformat = yuv16_pixelformat(name);
+            if (!pixelformat) { std::cerr << "Unknown format " << name << "\n"; return 1; }
+        }
+        else if (!strcmp(argv[i], "--demosaic") && i + 1 < argc &&
+                 !parse_demosaic(argv[++i], demosaic)) {
+            std::cerr << "Unknown demosaic " << argv[i] << "\n"; return 1;
+        }
+        else if (!strcmp(argv[i], "--window") && i + 1 < argc &&
+                 !parse_grey_window(argv[++i], window, auto_window)) {
+            std::cerr << "Bad window " << argv[i] << "\n"; return 1;
+        }
+        else if (!strcmp(argv[i], "--rgb")) cpu_rgb = true;
+        else if (!strcmp(argv[i], "--threads") && i + 1 < argc)
+            threads = strtoul(argv[++i], nullptr, 0);
+        else if (!strcmp(argv[i], "--decoders") && i + 1 < argc)
+            decode_threads = strtoul(argv[++i], nullptr, 0);
+        else if (!strcmp(argv[i], "--scale") && i + 1 < argc)
+            scale = strtoul(argv[++i], nullptr, 0);
+        else if (!strcmp(argv[i], "--align") && i + 1 < argc)
+            stride_align = strtoul(argv[++i], nullptr, 0);
+        else if (is_transform_option(argv[i]) && i + 1 < argc) {
+            if (!parse_transform_option(argv[i], argv[i + 1], transform)) {
+                std::cerr << "Bad value for " << argv[i] << ": " << argv[i + 1] << "\n"; return 1;
+            }
+            transforming = cpu_rgb = true;
+            ++i;
+        }
+    }
+    if (scale != 1 && scale != 2 && scale != 4 && scale != 8) {
+        std::cerr << "--scale must be 1, 2, 4 or 8\n"; return 1;
+    }
+    if (stride_align & (stride_align - 1)) {
+        std::cerr << "--align must be a power of two\n"; return 1;
+    }
+    if (cpu_rgb && pixelformat != V4L2_PIX_FMT_YUYV) {
+        std::cerr << "--rgb needs YUYV capture\n"; return 1;
+    }
+    WorkerPool pool(threads);
+
+    // 1) Open device, set format, map buffers
+    CaptureConfig cfg;
+    cfg.width = 1280; cfg.height = 720;
+    cfg.pixelformat = pixelformat;
+    cfg.field = V4L2_FIELD_NONE;
+    cfg.goal = goal;
+    cfg.stride_align = stride_align;
+    if (cpu_rgb) cfg.formats = {V4L2_PIX_FMT_YUYV};
+    else {
+        cfg.formats = {V4L2_PIX_FMT_YUYV, V4L2_PIX_FMT_UYVY, V4L2_PIX_FMT_NV12, V4L2_PIX_FMT_NV12M,
+                       V4L2_PIX_FMT_MJPEG};
+        for (uint32_t f : bayer_pixelformats()) cfg.formats.push_back(f);
+        for (uint32_t f : yuv16_pixelformats()) cfg.formats.push_back(f);
+    }
+    if (buffer_budget) {
+        cfg.num_buffers = 2;
+        cfg.buffer_budget = buffer_budget;
+    }
+    CaptureDevice cam;
+    if (!cam.open(cfg)) return 1;
+    const int width  = cam.width();
+    const int height = cam.height();
+    const YuvColorimetry cm = yuv_colorimetry(cam.format());
+    if (transforming && !frame_transform_resolve(transform, width, height)) {
+        std::cerr << "--crop is outside the " << width << "x" << height << " frame\n"; return 1;
+    }
+
+    // MJPEG frames are decoded several at a time and shown in order.
+    std::unique_ptr<MjpegDecoder> decoder;
+    if (cam.pixelformat() == V4L2_PIX_FMT_MJPEG)
+        decoder = std::make_unique<MjpegDecoder>(MjpegOutput::Rgb24, decode_threads);
+    DecodedFrame decoded;
+    // A scaled decode fills a smaller texture; the renderer stretches it.
+    // A transformed one is already the size it is shown at.
+    const int tex_width  = decoder ? mjpeg_scaled(width, scale)
+                         : transforming ? transform.out_w : width;
+    const int tex_height = decoder ? mjpeg_scaled(height, scale)
+                         : transforming ? transform.out_h : height;
+
+    // The render mode follows whatever format was negotiated.
+    Uint32 tex_format = SDL_PIXELFORMAT_RGB24;
+    if (!cpu_rgb) {
+        const RenderMode* mode = render_mode_for(cam.pixelformat());
+        if (!mode) {
+            std::cerr << "No SDL texture format for " << fourcc_to_string(cam.pixelformat()) << "\n";
+            return 1;
+        }
+        tex_format = mode->sdl;
+    }
+
+    // 2) SDL init
     SDL_Init(SDL_INIT_VIDEO);
+    SDL_SetYUVConversionMode(sdl_yuv_mode(cm));
     SDL_Window* win = SDL_CreateWindow("Capture",
         SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
-        fmt.fmt.pix.width, fmt.fmt.pix.height, 0);
+        transforming ? tex_width : width, transforming ? tex_height : height, 0);
     SDL_Renderer* ren = SDL_CreateRenderer(win, -1, 0);
     SDL_Texture* tex = SDL_CreateTexture(
-        ren, SDL_PIXELFORMAT_RGB24, SDL_TEXTUREACCESS_STREAMING,
-        fmt.fmt.pix.width, fmt.fmt.pix.height);
-
-    // 5) Start capture
-    for (uint32_t i = 0; i < bufs.size(); ++i) {
-        v4l2_buffer buf{};
-        buf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        buf.memory = V4L2_MEMORY_MMAP;
-        buf.index  = i;
-        
-        ioctl(fd, VIDIOC_QBUF, &buf);
+        ren, tex_format, SDL_TEXTUREACCESS_STREAMING, tex_width, tex_height);
+    if (!tex) {
+        std::cerr << "SDL_CreateTexture: " << SDL_GetError() << "\n";
+        return 1;
     }
-    int type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    ioctl(fd, VIDIOC_STREAMON, &type);
 
-    // 6) Capture & display loop
+    // 3) Start capture
+    if (!cam.start()) return 1;
+    if (transforming)
+        std::cerr << "YUYV transform to " << tex_width << "x" << tex_height << ": "
+                  << yuv_transform_isa() << " on " << pool.size() << " thread(s)\n";
+    else if (cpu_rgb)
+        std::cerr << "YUYV conversion: " << yuv_convert_isa() << " on "
+                  << pool.size() << " thread(s)\n";
+    else if (is_bayer(cam.pixelformat()))
+        std::cerr << "Demosaicing " << fourcc_to_string(cam.pixelformat()) << ": "
+                  << (demosaic == Demosaic::Bilinear ? bayer_isa() : "edge-aware")
+                  << " on " << pool.size() << " thread(s)\n";
+    else if (is_yuv16(cam.pixelformat()))
+        std::cerr << "Converting " << fourcc_to_string(cam.pixelformat()) << ": "
+                  << yuv16_isa() << " on " << pool.size() << " thread(s)\n";
+    else if (decoder)
+        std::cerr << "MJPEG decode on " << decoder->threads() << " thread(s)\n";
+    else
+        std::cerr << "Rendering " << fourcc_to_string(cam.pixelformat()) << " as "
+                  << SDL_GetPixelFormatName(tex_format) << " texture\n";
+
+    // 4) Capture & display loop
     while (true) {
-        v4l2_buffer buf = { .type = req.type,
-                            .memory = req.memory };
-        ioctl(fd, VIDIOC_DQBUF, &buf);
-        // Convert YUYV→RGB
-        auto yuyv = (uint8_t*)bufs[buf.index].start;
-
-        int width  = fmt.fmt.pix.width;
-        int height = fmt.fmt.pix.height;
-        int frame_bytes = width * height * 2;          // YUYV is 2 bytes per pixel
-        std::vector<uint8_t> rgb(width * height * 3);  // 3 bytes per pixel for RGB
-
-        for (int i = 0, j = 0; i < frame_bytes; i += 4) {
-            int y0 = yuyv[i + 0];
-            int u  = yuyv[i + 1];
-            int y1 = yuyv[i + 2];
-            int v  = yuyv[i + 3];
-
-            // pixel 0
-            rgb[j++] = clip((298*(y0-16) + 409*(v-128) + 128) >> 8);
-            rgb[j++] = clip((298*(y0-16) - 100*(u-128) - 208*(v-128) + 128) >> 8);
-            rgb[j++] = clip((298*(y0-16) + 516*(u-128) + 128) >> 8);
-            // pixel 1
-            rgb[j++] = clip((298*(y1-16) + 409*(v-128) + 128) >> 8);
-            rgb[j++] = clip((298*(y1-16) - 100*(u-128) - 208*(v-128) + 128) >> 8);
-            rgb[j++] = clip((298*(y1-16) + 516*(u-128) + 128) >> 8);
+        Frame frame = latest_only ? cam.grab_latest() : cam.grab();
+        if (!frame) break;
+        if (decoder) {
+            if (!decoder->submit(frame.data(), frame.size(), frame.buffer().sequence, scale))
+                cam.count_app_drop(1);
+            frame.release();
+            // Until the next frame finishes decoding, redraw the last one.
+            if (decoder->pop(decoded) && !upload_decoded(tex, decoded)) break;
+        } else {
+            // A buffer shorter than the format needs is dropped unseen.
+            const FrameView view = frame.view();
+            if (!view) { cam.count_app_drop(1); continue; }
+            Yuv16Format yuv16;
+            if (auto_window && yuv16_format(view.pixelformat, yuv16) && !yuv16.chroma) {
+                // The first frame's window, then follow the scene smoothly.
+                GreyWindow target = grey16_auto_window(view, window.gamma);
+                window = window_seeded ? grey_window_follow(window, target) : target;
+                window_seeded = true;
+            }
+            if (!upload_frame(tex, tex_format, view, cm, pool,
+                              transforming ? &transform : nullptr, demosaic, window)) break;
+            frame.release();
         }
-        SDL_UpdateTexture(tex, nullptr, rgb.data(), 1280*3);
-
-// create a YUY2 texture instead of RGB24
-// SDL_Texture* tex = SDL_CreateTexture(
-//     ren,
-//     SDL_PIXELFORMAT_YUY2,
-//     SDL_TEXTUREACCESS_STREAMING,
-//     width, height);
-// // in the loop, after DQBUF:
-// SDL_UpdateTexture(tex, nullptr, yuyv, width * 2);
-
 
-        
         SDL_RenderClear(ren);
         SDL_RenderCopy(ren, tex, nullptr, nullptr);
         SDL_RenderPresent(ren);
-        ioctl(fd, VIDIOC_QBUF, &buf);
         SDL_Event e;
         if (SDL_PollEvent(&e) && e.type == SDL_QUIT) break;
     }
 
-    // 7) Cleanup
-    ioctl(fd, VIDIOC_STREAMOFF, &type);
-    close(fd);
+    // 5) Cleanup
+    frame_stats stats = cam.stats();
+    frame_stats_print(stderr, cfg.device.c_str(), &stats);
+    if (decoder) std::cerr << decoder->errors() << " MJPEG frames failed to decode\n";
+    decoder.reset();
+    cam.close();
     SDL_DestroyTexture(tex);
     SDL_DestroyRenderer(ren);
     SDL_DestroyWindow(win);
@@ -0,0 +1,216 @@
+// dmabuf_share.cpp
+#include "dmabuf_share.h"
+#include "capture_device.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <linux/dma-buf.h>
+
+static int xioctl(int fd, unsigned long request, void* arg) {
+    int r;
+    do {
+        r = ioctl(fd, request, arg);
+    } while (r == -1 && errno == EINTR);
+    return r;
+}
+
+static bool make_address(const char* path, sockaddr_un& addr) {
+    addr = {};
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "%s: socket path too long\n", path);
+        return false;
+    }
+    strcpy(addr.sun_path, path);
+    return true;
+}
+
+int dmabuf_listen(const char* path) {
+    sockaddr_un addr;
+    if (!make_address(path, addr)) return -1;
+
+    int sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (sock < 0) { perror("socket"); return -1; }
+    unlink(path);
+    if (bind(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 ||
+        listen(sock, 1) < 0) {
+        perror(path);
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+int dmabuf_connect(const char* path) {
+    sockaddr_un addr;
+    if (!make_address(path, addr)) return -1;
+
+    int sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (sock < 0) { perror("socket"); return -1; }
+    if (connect(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+        perror(path);
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+//
+// === Sender ===
+//
+
+bool dmabuf_send_frame(int sock, const CaptureDevice& dev, const Frame& frame) {
+    const v4l2_buffer& buf = frame.buffer();
+
+    DmabufFrameMsg msg{};
+    msg.index        = buf.index;
+    msg.sequence     = buf.sequence;
+    msg.timestamp_us = buf.timestamp.tv_sec * 1000000ULL + buf.timestamp.tv_usec;
+    msg.width        = dev.width();
+    msg.height       = dev.height();
+    msg.pixelformat  = dev.pixelformat();
+    msg.num_planes   = frame.num_planes();
+
+    int fds[VIDEO_MAX_PLANES];
+    for (unsigned p = 0; p < msg.num_planes; ++p) {
+        fds[p] = frame.dmabuf_fd(p);
+        if (fds[p] < 0) {
+            fprintf(stderr, "dmabuf_send_frame: buffers were not exported\n");
+            return false;
+        }
+        msg.bytesperline[p] = dev.bytesperline(p);
+        if (V4L2_TYPE_IS_MULTIPLANAR(buf.type)) {
+            msg.offset[p] = buf.m.planes[p].data_offset;
+            msg.length[p] = buf.m.planes[p].length;
+        } else {
+            msg.length[p] = buf.length;
+        }
+        msg.bytesused[p] = frame.plane_size(p);
+    }
+
+    iovec iov{&msg, sizeof(msg)};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(fds))] = {};
+    msghdr hdr{};
+    hdr.msg_iov        = &iov;
+    hdr.msg_iovlen     = 1;
+    hdr.msg_control    = control;
+    hdr.msg_controllen = CMSG_SPACE(msg.num_planes * sizeof(int));
+
+    cmsghdr* cmsg   = CMSG_FIRSTHDR(&hdr);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type  = SCM_RIGHTS;
+    cmsg->cmsg_len   = CMSG_LEN(msg.num_planes * sizeof(int));
+    memcpy(CMSG_DATA(cmsg), fds, msg.num_planes * sizeof(int));
+
+    ssize_t n;
+    do {
+        n = sendmsg(sock, &hdr, MSG_NOSIGNAL);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) { perror("sendmsg"); return false; }
+    return true;
+}
+
+bool dmabuf_recv_release(int sock, uint32_t& index) {
+    ssize_t n;
+    do {
+        n = recv(sock, &index, sizeof(index), 0);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) { perror("recv"); return false; }
+    if (n != sizeof(index)) { errno = 0; return false; }
+    return true;
+}
+
+//
+// === Receiver ===
+//
+
+bool dmabuf_recv_frame(int sock, DmabufFrameMsg& msg, int fds[VIDEO_MAX_PLANES]) {
+    iovec iov{&msg, sizeof(msg)};
+    alignas(cmsghdr) char control[CMSG_SPACE(VIDEO_MAX_PLANES * sizeof(int))];
+    msghdr hdr{};
+    hdr.msg_iov        = &iov;
+    hdr.msg_iovlen     = 1;
+    hdr.msg_control    = control;
+    hdr.msg_controllen = sizeof(control);
+
+    ssize_t n;
+    do {
+        n = recvmsg(sock, &hdr, MSG_CMSG_CLOEXEC);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) { perror("recvmsg"); return false; }
+
+    unsigned nfds = 0;
+    for (cmsghdr* c = CMSG_FIRSTHDR(&hdr); c; c = CMSG_NXTHDR(&hdr, c)) {
+        if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS) continue;
+        nfds = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        memcpy(fds, CMSG_DATA(c), nfds * sizeof(int));
+    }
+    if (n == sizeof(msg) && nfds == msg.num_planes && !(hdr.msg_flags & MSG_CTRUNC))
+        return true;
+
+    for (unsigned p = 0; p < nfds; ++p) close(fds[p]);
+    if (n == 0) { errno = 0; return false; }
+    fprintf(stderr, "dmabuf_recv_frame: malformed message\n");
+    errno = EPROTO;
+    return false;
+}
+
+bool dmabuf_send_release(int sock, uint32_t index) {
+    ssize_t n;
+    do {
+        n = send(sock, &index, sizeof(index), MSG_NOSIGNAL);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) { perror("send"); return false; }
+    return true;
+}
+
+bool dmabuf_sync(int fd, bool start, bool write) {
+    dma_buf_sync sync{};
+    sync.flags = (start ? DMA_BUF_SYNC_START : DMA_BUF_SYNC_END) |
+                 (write ? DMA_BUF_SYNC_RW : DMA_BUF_SYNC_READ);
+    if (xioctl(fd, DMA_BUF_IOCTL_SYNC, &sync) < 0) {
+        perror("DMA_BUF_IOCTL_SYNC");
+        return false;
+    }
+    return true;
+}
+
+//
+// === m2m ===
+//
+
+bool queue_dmabuf_frame(int m2m_fd, uint32_t type, uint32_t index, const Frame& frame) {
+    v4l2_plane  planes[VIDEO_MAX_PLANES]{};
+    v4l2_buffer buf{};
+    buf.type      = type;
+    buf.memory    = V4L2_MEMORY_DMABUF;
+    buf.index     = index;
+    buf.field     = frame.buffer().field;
+    buf.timestamp = frame.buffer().timestamp;
+    if (V4L2_TYPE_IS_MULTIPLANAR(type)) {
+        const bool src_mplane = V4L2_TYPE_IS_MULTIPLANAR(frame.buffer().type);
+        for (unsigned p = 0; p < frame.num_planes(); ++p) {
+            planes[p].m.fd        = frame.dmabuf_fd(p);
+            planes[p].data_offset = src_mplane ? frame.buffer().m.planes[p].data_offset : 0;
+            planes[p].bytesused   = planes[p].data_offset + frame.plane_size(p);
+            planes[p].length      = src_mplane ? frame.buffer().m.planes[p].length
+                                               : frame.buffer().length;
+        }
+        buf.m.planes = planes;
+        buf.length   = frame.num_planes();
+    } else {
+        buf.m.fd      = frame.dmabuf_fd(0);
+        buf.bytesused = frame.size();
+        buf.length    = frame.buffer().length;
+    }
+    if (xioctl(m2m_fd, VIDIOC_QBUF, &buf) < 0) {
+        perror("VIDIOC_QBUF (dmabuf)");
+        return false;
+    }
+    return true;
+}
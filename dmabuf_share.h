@@ -0,0 +1,60 @@
+// dmabuf_share.h
+//
+// Hand exported capture buffers (CaptureConfig::export_dmabuf) to
+// consumers without copying them:
+//
+//  - another process, over a SOCK_SEQPACKET Unix socket: each message is a
+//    DmabufFrameMsg with the plane fds attached (SCM_RIGHTS). The receiver
+//    maps or imports the fds and answers with the buffer index once it is
+//    done, at which point the sender releases the Frame.
+//  - an m2m encoder's OUTPUT queue set up with V4L2_MEMORY_DMABUF, via
+//    queue_dmabuf_frame().
+//
+// The receiving side only needs this header and the kernel headers, not
+// CaptureDevice.
+#pragma once
+
+#include <cstdint>
+#include <linux/videodev2.h>
+
+class Frame;
+class CaptureDevice;
+
+struct DmabufFrameMsg {
+    uint32_t index;                          // driver buffer index, echoed in the release
+    uint32_t sequence;
+    uint64_t timestamp_us;
+    uint32_t width;
+    uint32_t height;
+    uint32_t pixelformat;
+    uint32_t num_planes;                     // number of attached fds
+    uint32_t bytesperline[VIDEO_MAX_PLANES];
+    uint32_t offset[VIDEO_MAX_PLANES];       // start of the data inside the dmabuf
+    uint32_t bytesused[VIDEO_MAX_PLANES];    // payload, excluding offset
+    uint32_t length[VIDEO_MAX_PLANES];       // size of the dmabuf, for mmap()
+};
+
+// Bind/connect a SOCK_SEQPACKET Unix socket. dmabuf_listen() returns the
+// listening socket; accept() the consumer on it. -1 on error (perror'd).
+int dmabuf_listen(const char* path);
+int dmabuf_connect(const char* path);
+
+// Sender side. The Frame must stay alive until its index comes back from
+// dmabuf_recv_release().
+bool dmabuf_send_frame(int sock, const CaptureDevice& dev, const Frame& frame);
+bool dmabuf_recv_release(int sock, uint32_t& index);
+
+// Receiver side. On success `fds` holds msg.num_planes new descriptors
+// which the caller must close. Returns false on error or when the sender
+// went away (errno == 0).
+bool dmabuf_recv_frame(int sock, DmabufFrameMsg& msg, int fds[VIDEO_MAX_PLANES]);
+bool dmabuf_send_release(int sock, uint32_t index);
+
+// Bracket CPU access to a mapped dmabuf (DMA_BUF_IOCTL_SYNC) so caches
+// are kept coherent with the device.
+bool dmabuf_sync(int fd, bool start, bool write = false);
+
+// Queue `frame` on the DMABUF-backed OUTPUT queue of an m2m device (e.g.
+// an encoder) as buffer `index`. The Frame must be kept until the m2m
+// device returns that buffer with VIDIOC_DQBUF.
+bool queue_dmabuf_frame(int m2m_fd, uint32_t type, uint32_t index, const Frame& frame);
@@ -0,0 +1,279 @@
+// format_negotiator.cpp
+#include "format_negotiator.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <tuple>
+#include <sys/ioctl.h>
+
+#ifndef V4L2_PIX_FMT_H264
+#define V4L2_PIX_FMT_H264 v4l2_fourcc('H', '2', '6', '4')
+#endif
+
+static int xioctl(int fd, unsigned long request, void* arg) {
+    int r;
+    do {
+        r = ioctl(fd, request, arg);
+    } while (r == -1 && errno == EINTR);
+    return r;
+}
+
+bool parse_capture_goal(const char* name, CaptureGoal& goal) {
+    static const struct { const char* name; CaptureGoal goal; } goals[] = {
+        {"latency",    CaptureGoal::LowestLatency},
+        {"fps",        CaptureGoal::HighestFps},
+        {"bandwidth",  CaptureGoal::LowestBandwidth},
+        {"compressed", CaptureGoal::NativeCompressed},
+    };
+    for (const auto& g : goals)
+        if (!strcmp(name, g.name)) { goal = g.goal; return true; }
+    return false;
+}
+
+std::string fourcc_to_string(uint32_t f) {
+    char s[5] = {char(f & 0xff), char((f >> 8) & 0xff),
+                 char((f >> 16) & 0xff), char((f >> 24) & 0x7f), 0};
+    return s;
+}
+
+// Rough average bytes per pixel, compressed formats included.
+static double bytes_per_pixel(uint32_t fourcc) {
+    switch (fourcc) {
+    case V4L2_PIX_FMT_GREY:
+    case V4L2_PIX_FMT_SBGGR8:
+    case V4L2_PIX_FMT_SGBRG8:
+    case V4L2_PIX_FMT_SGRBG8:
+    case V4L2_PIX_FMT_SRGGB8:
+        return 1.0;
+    case V4L2_PIX_FMT_SBGGR10P:
+    case V4L2_PIX_FMT_SGBRG10P:
+    case V4L2_PIX_FMT_SGRBG10P:
+    case V4L2_PIX_FMT_SRGGB10P:
+        return 1.25;
+    case V4L2_PIX_FMT_NV12:
+    case V4L2_PIX_FMT_NV21:
+    case V4L2_PIX_FMT_NV12M:
+    case V4L2_PIX_FMT_NV21M:
+    case V4L2_PIX_FMT_YUV420:
+    case V4L2_PIX_FMT_YVU420:
+    case V4L2_PIX_FMT_YUV420M:
+    case V4L2_PIX_FMT_YVU420M:
+    case V4L2_PIX_FMT_SBGGR12P:
+    case V4L2_PIX_FMT_SGBRG12P:
+    case V4L2_PIX_FMT_SGRBG12P:
+    case V4L2_PIX_FMT_SRGGB12P:
+        return 1.5;
+    case V4L2_PIX_FMT_RGB24:
+    case V4L2_PIX_FMT_BGR24:
+    case V4L2_PIX_FMT_P010:         // 4:2:0 in 16-bit words
+        return 3.0;
+    case V4L2_PIX_FMT_RGB32:
+    case V4L2_PIX_FMT_BGR32:
+    case V4L2_PIX_FMT_XRGB32:
+    case V4L2_PIX_FMT_XBGR32:
+        return 4.0;
+    case V4L2_PIX_FMT_MJPEG:
+    case V4L2_PIX_FMT_JPEG:
+        return 0.3;
+    case V4L2_PIX_FMT_H264:
+        return 0.05;
+    default:
+        return 2.0;   // YUYV, UYVY, Y16, 10/12/16-bit Bayer, ...
+    }
+}
+
+double CaptureMode::bytes_per_second() const {
+    double per_frame = double(width) * height * bytes_per_pixel(pixelformat);
+    return per_frame * (fps() > 0 ? fps() : 1.0);
+}
+
+//
+// === Enumeration ===
+//
+
+static void add_intervals(int fd, CaptureMode mode, std::vector<CaptureMode>& out) {
+    v4l2_frmivalenum ival{};
+    ival.pixel_format = mode.pixelformat;
+    ival.width        = mode.width;
+    ival.height       = mode.height;
+
+    bool any = false;
+    for (ival.index = 0; xioctl(fd, VIDIOC_ENUM_FRAMEINTERVALS, &ival) == 0; ++ival.index) {
+        if (ival.type == V4L2_FRMIVAL_TYPE_DISCRETE) {
+            mode.interval = ival.discrete;
+        } else {
+            // Continuous/stepwise: the shortest interval is the interesting one.
+            mode.interval = ival.stepwise.min;
+        }
+        out.push_back(mode);
+        any = true;
+        if (ival.type != V4L2_FRMIVAL_TYPE_DISCRETE) break;
+    }
+    if (!any) {
+        mode.interval = {0, 0};
+        out.push_back(mode);
+    }
+}
+
+static uint32_t clamp_step(uint32_t v, uint32_t min, uint32_t max, uint32_t step) {
+    v = std::clamp(v, min, max);
+    if (step > 1) v = min + (v - min + step - 1) / step * step;
+    return std::min(v, max);
+}
+
+std::vector<CaptureMode> enumerate_modes(int fd, uint32_t req_width, uint32_t req_height,
+                                         uint32_t type) {
+    std::vector<CaptureMode> modes;
+
+    v4l2_fmtdesc desc{};
+    desc.type = type;
+    for (desc.index = 0; xioctl(fd, VIDIOC_ENUM_FMT, &desc) == 0; ++desc.index) {
+        CaptureMode mode;
+        mode.pixelformat = desc.pixelformat;
+        mode.compressed  = desc.flags & V4L2_FMT_FLAG_COMPRESSED;
+        mode.description = reinterpret_cast<const char*>(desc.description);
+
+        v4l2_frmsizeenum size{};
+        size.pixel_format = desc.pixelformat;
+        for (size.index = 0; xioctl(fd, VIDIOC_ENUM_FRAMESIZES, &size) == 0; ++size.index) {
+            if (size.type == V4L2_FRMSIZE_TYPE_DISCRETE) {
+                mode.width  = size.discrete.width;
+                mode.height = size.discrete.height;
+                add_intervals(fd, mode, modes);
+                continue;
+            }
+            const auto& sw = size.stepwise;
+            mode.width  = sw.max_width;
+            mode.height = sw.max_height;
+            add_intervals(fd, mode, modes);
+            if (req_width && req_height) {
+                mode.width  = clamp_step(req_width,  sw.min_width,  sw.max_width,  sw.step_width);
+                mode.height = clamp_step(req_height, sw.min_height, sw.max_height, sw.step_height);
+                if (mode.width != sw.max_width || mode.height != sw.max_height)
+                    add_intervals(fd, mode, modes);
+            }
+            break;
+        }
+    }
+    return modes;
+}
+
+//
+// === Scoring ===
+//
+
+static int compressed_rank(const CaptureMode& m) {
+    if (m.pixelformat == V4L2_PIX_FMT_H264) return 2;
+    return m.compressed ? 1 : 0;
+}
+
+// Larger tuples win. Meeting the requested size and rate always beats
+// the goal-specific criteria; among modes that do, the goal decides, and
+// the size closest to the request breaks ties.
+static auto score(const CaptureMode& m, const ModeRequest& req) {
+    const double area     = double(m.width) * m.height;
+    const double req_area = double(req.width) * req.height;
+    const bool   big      = m.width >= req.width && m.height >= req.height;
+    const bool   fast     = m.fps() >= req.min_fps;
+    const double closeness = -std::abs(area - req_area);
+
+    double primary = 0, secondary = 0;
+    switch (req.goal) {
+    case CaptureGoal::None:
+    case CaptureGoal::LowestLatency: {
+        // Waiting for the next frame plus, for compressed data, a decode
+        // roughly proportional to the pixel count.
+        double ms = m.fps() > 0 ? 1000.0 / m.fps() : 1000.0;
+        if (m.compressed) ms += 4.0 * area / 1e6;
+        primary = -ms;
+        break;
+    }
+    case CaptureGoal::HighestFps:
+        primary = m.fps();
+        break;
+    case CaptureGoal::LowestBandwidth:
+        primary = -m.bytes_per_second();
+        break;
+    case CaptureGoal::NativeCompressed:
+        primary   = compressed_rank(m);
+        secondary = m.fps();
+        break;
+    }
+    return std::make_tuple(big, fast, primary, secondary, closeness, m.fps());
+}
+
+int pick_mode(const std::vector<CaptureMode>& modes, const ModeRequest& req) {
+    int best = -1;
+    for (size_t i = 0; i < modes.size(); ++i) {
+        const auto& m = modes[i];
+        if (!req.formats.empty() &&
+            std::find(req.formats.begin(), req.formats.end(), m.pixelformat) == req.formats.end())
+            continue;
+        if (best < 0 || score(m, req) > score(modes[best], req)) best = int(i);
+    }
+    return best;
+}
+
+//
+// === Apply ===
+//
+
+bool set_frame_interval(int fd, v4l2_fract interval, uint32_t type) {
+    if (!interval.numerator || !interval.denominator) return true;
+
+    v4l2_streamparm parm{};
+    parm.type = type;
+    if (xioctl(fd, VIDIOC_G_PARM, &parm) < 0 ||
+        !(parm.parm.capture.capability & V4L2_CAP_TIMEPERFRAME))
+        return true;   // fixed-rate device, nothing to set
+
+    parm.parm.capture.timeperframe = interval;
+    if (xioctl(fd, VIDIOC_S_PARM, &parm) < 0) {
+        perror("VIDIOC_S_PARM");
+        return false;
+    }
+    return true;
+}
+
+bool negotiate_format(int fd, const ModeRequest& req, v4l2_format& fmt, CaptureMode* chosen,
+                      uint32_t type) {
+    std::vector<CaptureMode> modes = enumerate_modes(fd, req.width, req.height, type);
+    int best = pick_mode(modes, req);
+    if (best < 0) {
+        fprintf(stderr, "No capture mode matches the requested formats\n");
+        return false;
+    }
+    const CaptureMode& m = modes[best];
+
+    fmt = {};
+    fmt.type = type;
+    if (V4L2_TYPE_IS_MULTIPLANAR(type)) {
+        fmt.fmt.pix_mp.width       = m.width;
+        fmt.fmt.pix_mp.height      = m.height;
+        fmt.fmt.pix_mp.pixelformat = m.pixelformat;
+        fmt.fmt.pix_mp.field       = V4L2_FIELD_ANY;
+    } else {
+        fmt.fmt.pix.width       = m.width;
+        fmt.fmt.pix.height      = m.height;
+        fmt.fmt.pix.pixelformat = m.pixelformat;
+        fmt.fmt.pix.field       = V4L2_FIELD_ANY;
+    }
+    if (xioctl(fd, VIDIOC_S_FMT, &fmt) < 0) {
+        perror("VIDIOC_S_FMT");
+        return false;
+    }
+    const uint32_t got = V4L2_TYPE_IS_MULTIPLANAR(type) ? fmt.fmt.pix_mp.pixelformat
+                                                        : fmt.fmt.pix.pixelformat;
+    if (got != m.pixelformat) {
+        fprintf(stderr, "driver chose %s instead of %s\n", fourcc_to_string(got).c_str(),
+                fourcc_to_string(m.pixelformat).c_str());
+        return false;
+    }
+    if (!set_frame_interval(fd, m.interval, type)) return false;
+
+    if (chosen) *chosen = m;
+    return true;
+}
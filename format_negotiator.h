@@ -0,0 +1,70 @@
+// format_negotiator.h
+//
+// Enumerates every pixel format, frame size and frame interval a device
+// offers (VIDIOC_ENUM_FMT / ENUM_FRAMESIZES / ENUM_FRAMEINTERVALS), scores
+// each mode against a goal and programs the winner with VIDIOC_S_FMT and
+// VIDIOC_S_PARM.
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <linux/videodev2.h>
+
+enum class CaptureGoal {
+    None,             // no negotiation: use the configured format as-is
+    LowestLatency,    // shortest frame interval, avoid formats needing a decode
+    HighestFps,       // maximum frame rate at (at least) the requested size
+    LowestBandwidth,  // fewest bytes per second that still meets size and fps
+    NativeCompressed, // prefer what the camera encodes itself (H.264, MJPEG)
+};
+
+struct CaptureMode {
+    uint32_t    pixelformat = 0;
+    uint32_t    width       = 0;
+    uint32_t    height      = 0;
+    v4l2_fract  interval{};       // seconds per frame, {0,0} if unknown
+    bool        compressed  = false;
+    std::string description;
+
+    double fps() const {
+        return interval.numerator ? double(interval.denominator) / interval.numerator : 0.0;
+    }
+    // Estimated transfer rate, used for the bandwidth goal.
+    double bytes_per_second() const;
+};
+
+struct ModeRequest {
+    CaptureGoal           goal    = CaptureGoal::LowestLatency;
+    uint32_t              width   = 0;   // minimum wanted size, 0 = any
+    uint32_t              height  = 0;
+    double                min_fps = 0;
+    std::vector<uint32_t> formats;       // acceptable fourccs, empty = any
+};
+
+// "latency", "fps", "bandwidth" or "compressed"; false if unknown.
+bool parse_capture_goal(const char* name, CaptureGoal& goal);
+
+// Printable fourcc, e.g. "YUYV".
+std::string fourcc_to_string(uint32_t fourcc);
+
+// Every (format, size, interval) combination the device reports. Stepwise
+// and continuous ranges contribute their largest size, the requested size
+// and their shortest interval. `type` selects the single- or multi-planar
+// capture queue.
+std::vector<CaptureMode> enumerate_modes(int fd, uint32_t req_width = 0, uint32_t req_height = 0,
+                                         uint32_t type = V4L2_BUF_TYPE_VIDEO_CAPTURE);
+
+// Index of the best mode for `req`, or -1 if `modes` is empty.
+int pick_mode(const std::vector<CaptureMode>& modes, const ModeRequest& req);
+
+// Enumerate, pick and apply. On success `fmt` holds what VIDIOC_S_FMT
+// returned and `chosen` (if given) the selected mode. Errors are reported
+// with perror().
+bool negotiate_format(int fd, const ModeRequest& req, v4l2_format& fmt,
+                      CaptureMode* chosen = nullptr,
+                      uint32_t type = V4L2_BUF_TYPE_VIDEO_CAPTURE);
+
+// Set the frame interval with VIDIOC_S_PARM if the driver supports it.
+bool set_frame_interval(int fd, v4l2_fract interval,
+                        uint32_t type = V4L2_BUF_TYPE_VIDEO_CAPTURE);
@@ -0,0 +1,55 @@
+// frame_ring.h
+//
+// Bounded lock-free single-producer/single-consumer ring. One thread may
+// call push(), one other thread may call pop(); neither ever blocks.
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+template <typename T, size_t N>
+class SpscRing {
+    static_assert(N > 0 && (N & (N - 1)) == 0, "SpscRing size must be a power of two");
+
+public:
+    // Producer side. Moves from v only on success.
+    bool push(T&& v) {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        if (head - tail_cache_ == N) {
+            tail_cache_ = tail_.load(std::memory_order_acquire);
+            if (head - tail_cache_ == N) return false;
+        }
+        slots_[head & (N - 1)] = std::move(v);
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side.
+    bool pop(T& out) {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail == head_cache_) {
+            head_cache_ = head_.load(std::memory_order_acquire);
+            if (tail == head_cache_) return false;
+        }
+        out = std::move(slots_[tail & (N - 1)]);
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Approximate when called concurrently with push()/pop().
+    size_t size() const {
+        return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+    }
+
+    static constexpr size_t capacity() { return N; }
+
+private:
+    // Producer and consumer indices live on separate cache lines, each next
+    // to its private copy of the other side's index.
+    alignas(64) std::atomic<size_t> head_{0};
+    size_t                          tail_cache_ = 0;
+    alignas(64) std::atomic<size_t> tail_{0};
+    size_t                          head_cache_ = 0;
+    alignas(64) T                   slots_[N];
+};
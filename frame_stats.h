@@ -0,0 +1,117 @@
+/*
+ *  frame_stats.h
+ *
+ *  Running per-device capture counters built from what the driver reports
+ *  in every dequeued v4l2_buffer:
+ *
+ *    captured        buffers dequeued from the driver
+ *    dropped_driver  frames the driver never delivered, i.e. gaps in
+ *                    v4l2_buffer.sequence (usually: no free buffer queued)
+ *    dropped_app     frames we dequeued but discarded without consuming
+ *    errored         buffers flagged V4L2_BUF_FLAG_ERROR (corrupt data)
+ *
+ *  plus the mean/min/max/stddev of the inter-frame interval taken from
+ *  v4l2_buffer.timestamp. Header-only so the C tools and the C++ capture
+ *  library share one implementation.
+ */
+#ifndef FRAME_STATS_H
+#define FRAME_STATS_H
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <linux/videodev2.h>
+
+struct frame_stats {
+        unsigned long long captured;
+        unsigned long long dropped_driver;
+        unsigned long long dropped_app;
+        unsigned long long errored;
+
+        /* Inter-frame interval in microseconds (Welford running variance). */
+        unsigned long long intervals;
+        double             interval_mean_us;
+        double             interval_m2;
+        long long          interval_min_us;
+        long long          interval_max_us;
+
+        int                have_last;
+        unsigned int       last_sequence;
+        long long          last_timestamp_us;
+};
+
+static inline void frame_stats_init(struct frame_stats *s)
+{
+        memset(s, 0, sizeof(*s));
+}
+
+/* Account one buffer returned by VIDIOC_DQBUF. */
+static inline void frame_stats_update(struct frame_stats *s,
+                                      const struct v4l2_buffer *buf)
+{
+        long long ts = buf->timestamp.tv_sec * 1000000LL + buf->timestamp.tv_usec;
+
+        s->captured++;
+        if (buf->flags & V4L2_BUF_FLAG_ERROR)
+                s->errored++;
+
+        if (s->have_last) {
+                /* Unsigned subtraction handles the 32-bit wrap. */
+                unsigned int gap = buf->sequence - s->last_sequence - 1;
+                long long dt = ts - s->last_timestamp_us;
+                double delta;
+
+                /* A sequence that goes backwards means the stream was
+                 * restarted; only count forward gaps. */
+                if (gap < 0x80000000u)
+                        s->dropped_driver += gap;
+
+                if (dt > 0) {
+                        s->intervals++;
+                        delta = dt - s->interval_mean_us;
+                        s->interval_mean_us += delta / s->intervals;
+                        s->interval_m2 += delta * (dt - s->interval_mean_us);
+                        if (s->intervals == 1 || dt < s->interval_min_us)
+                                s->interval_min_us = dt;
+                        if (dt > s->interval_max_us)
+                                s->interval_max_us = dt;
+                }
+        }
+
+        s->have_last = 1;
+        s->last_sequence = buf->sequence;
+        s->last_timestamp_us = ts;
+}
+
+/* Account frames that were dequeued but thrown away by the application. */
+static inline void frame_stats_app_drop(struct frame_stats *s, unsigned int n)
+{
+        s->dropped_app += n;
+}
+
+/* Forget the last sequence/timestamp, e.g. after STREAMOFF/STREAMON. */
+static inline void frame_stats_restart(struct frame_stats *s)
+{
+        s->have_last = 0;
+}
+
+/* Standard deviation of the inter-frame interval, in microseconds. */
+static inline double frame_stats_jitter_us(const struct frame_stats *s)
+{
+        return s->intervals > 1 ? sqrt(s->interval_m2 / (s->intervals - 1)) : 0.0;
+}
+
+static inline void frame_stats_print(FILE *fp, const char *name,
+                                     const struct frame_stats *s)
+{
+        fprintf(fp, "%s: captured %llu, dropped by driver %llu, "
+                    "dropped by app %llu, errored %llu\n",
+                name, s->captured, s->dropped_driver, s->dropped_app, s->errored);
+        if (s->intervals)
+                fprintf(fp, "%s: interval mean %.1f us, min %lld us, "
+                            "max %lld us, jitter %.1f us\n",
+                        name, s->interval_mean_us, s->interval_min_us,
+                        s->interval_max_us, frame_stats_jitter_us(s));
+}
+
+#endif /* FRAME_STATS_H */
@@ -0,0 +1,50 @@
+// frame_view.h
+//
+// Non-owning description of one image in memory, the way every conversion
+// kernel takes its source: pixel format, visible size and, per plane, a
+// pointer and a stride in bytes. Rows are never assumed to be packed;
+// drivers pad bytesperline for DMA or cache alignment, and a view carries
+// that padding along instead of each caller re-deriving it.
+//
+// Frame::view() builds one for a captured buffer from the negotiated
+// bytesperline, splits formats whose planes share one buffer (NV12, P010,
+// YUV420, ...) at the offsets V4L2 defines for them, and checks that the
+// buffer really holds every row (sizeimage/bytesused) so a short transfer
+// cannot send a kernel past its end.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+struct FrameView {
+    uint32_t       pixelformat = 0;
+    int            width       = 0;
+    int            height      = 0;
+    unsigned       num_planes  = 0;
+    const uint8_t* plane[3]{};
+    size_t         stride[3]{};
+
+    explicit operator bool() const { return plane[0] != nullptr; }
+
+    // True if every plane starts on, and every row is a multiple of,
+    // `align` bytes (a power of two); e.g. 64 for rows whose loads never
+    // straddle a cache line.
+    bool aligned(size_t align) const {
+        for (unsigned p = 0; p < num_planes; ++p)
+            if ((uintptr_t(plane[p]) | stride[p]) & (align - 1)) return false;
+        return true;
+    }
+};
+
+// View of a single-plane image, e.g. a buffer the caller converted into.
+inline FrameView frame_view(const uint8_t* data, size_t stride, int width, int height,
+                            uint32_t pixelformat) {
+    FrameView v;
+    v.pixelformat = pixelformat;
+    v.width       = width;
+    v.height      = height;
+    v.num_planes  = 1;
+    v.plane[0]    = data;
+    v.stride[0]   = stride;
+    return v;
+}
@@ -0,0 +1,161 @@
+// gl_upload.cpp
+#include "gl_upload.h"
+#include "capture_device.h"
+#include "worker_pool.h"
+#include "yuv_convert.h"
+
+#include <cstring>
+
+int FrameUpload::width() const {
+    return transforming ? transform.out_w : int(camera->width());
+}
+
+int FrameUpload::height() const {
+    return transforming ? transform.out_h : int(camera->height());
+}
+
+// RGB rows are padded to the default GL_UNPACK_ALIGNMENT of 4; raw YUYV
+// and 16-bit rows are 2 bytes per pixel.
+size_t FrameUpload::stride() const {
+    return gpu_yuv ? size_t(camera->width()) * 2 : (size_t(width()) * 3 + 3) & ~size_t(3);
+}
+
+size_t FrameUpload::size() const {
+    const size_t rows = height() + (gpu_yuv && yuv16.chroma ? (camera->height() + 1) / 2 : 0);
+    return stride() * rows;
+}
+
+void FrameUpload::update_grey_window(const FrameView& src) {
+    if (!yuv16_fourcc || yuv16.chroma || !auto_window) return;
+    GreyWindow target = grey16_auto_window(src, grey_window.gamma);
+    grey_window = seeded_ ? grey_window_follow(grey_window, target) : target;
+    seeded_ = true;
+}
+
+void FrameUpload::fill(const FrameView& src, uint8_t* dst, size_t dst_stride) const {
+    if (gpu_yuv) {
+        // P010's CbCr plane is another height / 2 rows of the same width.
+        for (int y = 0; y < src.height; ++y)
+            memcpy(dst + y * dst_stride, src.plane[0] + y * src.stride[0], src.width * 2);
+        dst += dst_stride * src.height;
+        for (int y = 0; yuv16.chroma && y < (src.height + 1) / 2; ++y)
+            memcpy(dst + y * dst_stride, src.plane[1] + y * src.stride[1], src.width * 2);
+        return;
+    }
+    // Matrix and range follow the colorimetry the driver reports.
+    const YuvColorimetry cm = yuv_colorimetry(camera->format());
+    if (yuv16.chroma)
+        p010_to_rgb24(src, dst, dst_stride, cm, *pool);
+    else if (yuv16_fourcc)
+        grey16_to_rgb24(src, dst, dst_stride, grey_window, *pool);
+    else if (transforming)
+        yuyv_to_rgb24_transform(src, dst, dst_stride, transform, cm, *pool);
+    else
+        yuyv_to_rgb24(src, dst, dst_stride, cm, *pool);
+}
+
+void FrameUpload::upload_yuv16(GLuint tex, GLuint uv_tex, const uint8_t* data,
+                               size_t stride) const {
+    const int width = camera->width(), height = camera->height();
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, stride / 2);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RED, GL_UNSIGNED_SHORT, data);
+    if (yuv16.chroma) {
+        glBindTexture(GL_TEXTURE_2D, uv_tex);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, stride / 4);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width / 2, height / 2, GL_RG, GL_UNSIGNED_SHORT,
+                        reinterpret_cast<const void*>(uintptr_t(data) + stride * height));
+    }
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+}
+
+// The matrix is the same one the CPU kernels use. JPEG's YCbCr is always
+// full-range BT.601, whatever the driver reports. P010 samples are
+// normalised from 16-bit words: code v of 8 bits sits at 256 * v / 65535
+// rather than v / 255. Uniforms a shader does not declare are ignored.
+void FrameUpload::set_yuv_uniforms(GLuint program) const {
+    YuvColorimetry cm = mjpeg ? YuvColorimetry{YuvMatrix::Bt601, YuvRange::Full}
+                              : yuv_colorimetry(camera->format());
+    YuvCoeffs c = yuv_coeffs(cm.matrix, cm.range);
+    const bool  p010 = gpu_yuv && yuv16.chroma;
+    const float k = 1.0f / 256 * (p010 ? 65535.0f / 65280 : 1.0f);
+    const float o = p010 ? 256 / 65535.0f : 1 / 255.0f;
+    const float m[9] = {   // column-major: Y, U, V columns
+        c.cy * k,  c.cy * k,   c.cy * k,
+        0.0f,     -c.cgu * k,  c.cbu * k,
+        c.crv * k, -c.cgv * k, 0.0f,
+    };
+    glUseProgram(program);
+    glUniform1i(glGetUniformLocation(program, "yuyv"), gpu_yuv && !mjpeg && !yuv16_fourcc);
+    glUniform1i(glGetUniformLocation(program, "planar"), gpu_yuv && mjpeg);
+    glUniform1i(glGetUniformLocation(program, "grey"), gpu_yuv && yuv16_fourcc && !p010);
+    glUniform1i(glGetUniformLocation(program, "p010"), p010);
+    glUniform1i(glGetUniformLocation(program, "tex_cb"), 1);
+    glUniform1i(glGetUniformLocation(program, "tex_cr"), 2);
+    glUniform1i(glGetUniformLocation(program, "tex_uv"), 1);
+    glUniform2f(glGetUniformLocation(program, "size"), camera->width(), camera->height());
+    glUniform3f(glGetUniformLocation(program, "yuv_offset"), c.yoff * o, 128 * o, 128 * o);
+    glUniformMatrix3fv(glGetUniformLocation(program, "yuv_matrix"), 1, GL_FALSE, m);
+}
+
+// In GL_R16's normalised units.
+void FrameUpload::set_window_uniform(GLuint program) const {
+    glUniform3f(glGetUniformLocation(program, "window"), grey_window.black / 65535.0f,
+                grey_window.white / 65535.0f, 1.0f / grey_window.gamma);
+}
+
+const char* const YUV_SHADER_FUNCTIONS = R"GLSL(
+        in vec2 vUV;
+        out vec4 FragColor;
+        uniform sampler2D tex;
+        // yuyv == 1: tex is the raw YUYV frame, one Y0 U Y1 V pair per RGBA
+        // texel, converted here with the negotiated matrix and range.
+        uniform int  yuyv;
+        uniform vec2 size;          // frame size in pixels
+        uniform vec3 yuv_offset;    // (Y black, 128, 128) / 255
+        uniform mat3 yuv_matrix;
+        // grey == 1: tex is a 16-bit greyscale frame (GL_R16); window.xy
+        // is the display window, window.z 1 / gamma.
+        uniform int  grey;
+        uniform vec3 window;
+        // p010 == 1: tex is the 16-bit Y plane, tex_uv the half-size CbCr
+        // plane (GL_RG16).
+        uniform int  p010;
+        uniform sampler2D tex_uv;
+        float luma(int x, int y){
+            vec4 t = texelFetch(tex, ivec2(x >> 1, y), 0);
+            return (x & 1) == 0 ? t.r : t.b;
+        }
+        vec2 chroma(int x, int y){
+            return texelFetch(tex, ivec2(x, y), 0).ga;
+        }
+        vec3 yuyv_to_rgb(){
+            // Bilinear in luma pixels; texel centres sit at integer p.
+            vec2  p  = vUV * size - 0.5;
+            ivec2 i  = ivec2(floor(p));
+            vec2  f  = p - vec2(i);
+            ivec2 hi = ivec2(size) - 1;
+            ivec2 p0 = clamp(i,     ivec2(0), hi);
+            ivec2 p1 = clamp(i + 1, ivec2(0), hi);
+            float y = mix(mix(luma(p0.x, p0.y), luma(p1.x, p0.y), f.x),
+                          mix(luma(p0.x, p1.y), luma(p1.x, p1.y), f.x), f.y);
+            // Chroma is co-sited with the even luma pixels at half the
+            // horizontal rate, so interpolate it on its own grid.
+            float cx = p.x * 0.5;
+            int   ci = int(floor(cx));
+            float cf = cx - float(ci);
+            int   c0 = clamp(ci,     0, hi.x >> 1);
+            int   c1 = clamp(ci + 1, 0, hi.x >> 1);
+            vec2 uv = mix(mix(chroma(c0, p0.y), chroma(c1, p0.y), cf),
+                          mix(chroma(c0, p1.y), chroma(c1, p1.y), cf), f.y);
+            return clamp(yuv_matrix * (vec3(y, uv) - yuv_offset), 0.0, 1.0);
+        }
+        vec3 grey_to_rgb(){
+            float v = (texture(tex, vUV).r - window.x) / (window.y - window.x);
+            return vec3(pow(clamp(v, 0.0, 1.0), window.z));
+        }
+        vec3 p010_to_rgb(){
+            vec3 yuv = vec3(texture(tex, vUV).r, texture(tex_uv, vUV).rg);
+            return clamp(yuv_matrix * (yuv - yuv_offset), 0.0, 1.0);
+        }
+)GLSL";
@@ -0,0 +1,76 @@
+// gl_upload.h
+//
+// What the GL demos do between a captured frame and the texture their
+// fragment shader samples, kept in one place so both convert identically:
+//   - the layout of one upload: RGB24 converted on the CPU (rows padded to
+//     GL's default unpack alignment of 4), or with --gpu the raw YUYV or
+//     16-bit samples, P010's CbCr rows following its Y rows;
+//   - filling that layout from a FrameView, on a WorkerPool;
+//   - the 16-bit texture uploads and the automatic greyscale window;
+//   - the shader side: YUV_SHADER_FUNCTIONS (uniforms plus yuyv_to_rgb(),
+//     grey_to_rgb(), p010_to_rgb()) to paste after a #version line, and the
+//     uniforms it reads.
+//
+// Needs a current GL 3.3+ context for everything that touches GL.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <glad/glad.h>
+#include "frame_view.h"
+#include "yuv16_convert.h"
+#include "yuv_transform.h"
+
+class CaptureDevice;
+class WorkerPool;
+
+struct FrameUpload {
+    // Set from the command line before the first frame.
+    bool           gpu_yuv      = false;  // --gpu: convert in the shader
+    bool           mjpeg        = false;  // planes from the JPEG decoder
+    FrameTransform transform;             // --size/--crop/...: CPU YUYV only
+    bool           transforming = false;
+    uint32_t       yuv16_fourcc = 0;      // --format; 0 = YUYV
+    Yuv16Format    yuv16;
+    GreyWindow     grey_window;           // --window
+    bool           auto_window  = true;
+
+    // Set once the camera is open.
+    const CaptureDevice* camera = nullptr;
+    WorkerPool*          pool   = nullptr;
+
+    // Pixel size of the uploaded image: the transform's output, if any.
+    int width() const;
+    int height() const;
+    // Bytes per row, and in all, of one upload.
+    size_t stride() const;
+    size_t size() const;
+
+    // Track the scene with the automatic greyscale window: take the first
+    // frame's, then follow it smoothly.
+    void update_grey_window(const FrameView& src);
+
+    // Write the frame the way the texture wants it: raw YUYV or 16-bit
+    // samples with --gpu, converted to RGB otherwise.
+    void fill(const FrameView& src, uint8_t* dst, size_t dst_stride) const;
+
+    // --gpu with a 16-bit format: the Y (or grey) plane into `tex`, P010's
+    // CbCr plane into `uv_tex`. With an unpack buffer bound, `data` is null
+    // and the planes are offsets into it.
+    void upload_yuv16(GLuint tex, GLuint uv_tex, const uint8_t* data, size_t stride) const;
+
+    // Matrix, offsets and mode switches for YUV_SHADER_FUNCTIONS; sets the
+    // program current.
+    void set_yuv_uniforms(GLuint program) const;
+    // Greyscale window; it moves with the automatic window, so it is set
+    // every frame.
+    void set_window_uniform(GLuint program) const;
+
+private:
+    bool seeded_ = false;
+};
+
+// Fragment shader declarations and functions, GLSL 3.30 and later: `vUV`,
+// the samplers `tex` and `tex_uv` (texture unit 1) and the uniforms that
+// FrameUpload sets. The including shader supplies #version and main().
+extern const char* const YUV_SHADER_FUNCTIONS;
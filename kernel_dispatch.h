@@ -0,0 +1,45 @@
+// kernel_dispatch.h
+//
+// Plumbing shared by the SIMD conversion modules (yuv_convert,
+// yuv16_convert, bayer, luma):
+//   - each lists its kernels widest first; select_kernel() takes the first
+//     one the CPU supports, or the one named in the module's *_ISA
+//     environment variable;
+//   - in_stripes() splits a frame's rows over a WorkerPool.
+//
+// AVX2 row kernels hand the pixels after their last full block to the SSE
+// kernel of the same module, and call _mm256_zeroupper() right before it.
+// GCC does not always emit that ahead of a tail call into legacy-SSE code;
+// without it every SSE instruction there and after pays the AVX-to-SSE
+// transition penalty, which costs more than AVX2 gains.
+//
+// Internal to those modules.
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include "worker_pool.h"
+
+// First entry of `kernels` with `supported` set; if the environment
+// variable `env` names one (`name`), that one instead when supported. The
+// last entry, the scalar kernel, is the fallback.
+template <typename Kernel, size_t N>
+Kernel select_kernel(const Kernel (&kernels)[N], const char* env) {
+    const char* force = getenv(env);
+    for (const Kernel& k : kernels)
+        if (k.supported && (!force || !strcmp(force, k.name))) return k;
+    return kernels[N - 1];
+}
+
+// rows(y0, y1) over [0, height) in stripes of at least `min_rows` rows, a
+// few per thread so that uneven stripes still balance.
+template <typename RowsFn>
+void in_stripes(int height, int min_rows, WorkerPool& pool, RowsFn rows) {
+    const unsigned stripes = std::clamp<unsigned>(height / min_rows, 1, pool.size() * 4);
+    pool.run(stripes, [&](unsigned s) {
+        rows(int(int64_t(s) * height / stripes), int(int64_t(s + 1) * height / stripes));
+    });
+}
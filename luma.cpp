@@ -0,0 +1,209 @@
+// luma.cpp
+#include "luma.h"
+#include "kernel_dispatch.h"
+#include "worker_pool.h"
+#include "yuv16_convert.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <linux/videodev2.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define LUMA_X86 1
+#include <immintrin.h>
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+//
+// === Formats ===
+//
+
+struct LumaFourcc {
+    uint32_t    fourcc;
+    const char* name;      // for luma_pixelformat(); null for the ...M twins
+    bool        planar;
+    // Packed formats: a 16-bit little-endian word per pixel, Y = (word >>
+    // shift) & mask. The 16-bit formats are looked up in yuv16_convert.
+    int         shift;
+    uint16_t    mask;
+};
+
+static const LumaFourcc luma_fourccs[] = {
+    {V4L2_PIX_FMT_GREY,    "grey",    true,  0, 0},
+    {V4L2_PIX_FMT_NV12,    "nv12",    true,  0, 0},
+    {V4L2_PIX_FMT_NV21,    "nv21",    true,  0, 0},
+    {V4L2_PIX_FMT_NV16,    "nv16",    true,  0, 0},
+    {V4L2_PIX_FMT_NV61,    "nv61",    true,  0, 0},
+    {V4L2_PIX_FMT_YUV420,  "yuv420",  true,  0, 0},
+    {V4L2_PIX_FMT_YVU420,  "yvu420",  true,  0, 0},
+    {V4L2_PIX_FMT_YUV422P, "yuv422p", true,  0, 0},
+    {V4L2_PIX_FMT_NV12M,   nullptr,   true,  0, 0},
+    {V4L2_PIX_FMT_NV21M,   nullptr,   true,  0, 0},
+    {V4L2_PIX_FMT_NV16M,   nullptr,   true,  0, 0},
+    {V4L2_PIX_FMT_NV61M,   nullptr,   true,  0, 0},
+    {V4L2_PIX_FMT_YUV420M, nullptr,   true,  0, 0},
+    {V4L2_PIX_FMT_YVU420M, nullptr,   true,  0, 0},
+    {V4L2_PIX_FMT_YUV422M, nullptr,   true,  0, 0},
+    {V4L2_PIX_FMT_YUYV,    "yuyv",    false, 0, 0x00ff},
+    {V4L2_PIX_FMT_YVYU,    "yvyu",    false, 0, 0x00ff},
+    {V4L2_PIX_FMT_UYVY,    "uyvy",    false, 8, 0x00ff},
+    {V4L2_PIX_FMT_VYUY,    "vyuy",    false, 8, 0x00ff},
+};
+
+// Layout of `pixelformat`'s luma; false if it has none.
+static bool luma_fourcc(uint32_t pixelformat, LumaFourcc& out) {
+    for (const LumaFourcc& f : luma_fourccs)
+        if (f.fourcc == pixelformat) { out = f; return true; }
+    // Samples are LSB-aligned (Y10..Y16) or MSB-aligned (P010); either way
+    // keep the top 8 of the significant bits. The mask only has to keep
+    // them all: the pack saturates anything larger to 255.
+    Yuv16Format y16;
+    if (!yuv16_format(pixelformat, y16)) return false;
+    out = {pixelformat, nullptr, false, y16.msb ? 8 : y16.bits - 8, 0xffff};
+    return true;
+}
+
+bool has_luma(uint32_t pixelformat) {
+    LumaFourcc f;
+    return luma_fourcc(pixelformat, f);
+}
+
+bool luma_is_planar(uint32_t pixelformat) {
+    LumaFourcc f;
+    return luma_fourcc(pixelformat, f) && f.planar;
+}
+
+uint32_t luma_pixelformat(const char* name) {
+    for (const LumaFourcc& f : luma_fourccs)
+        if (f.name && !strcmp(f.name, name)) return f.fourcc;
+    return yuv16_pixelformat(name);
+}
+
+//
+// === Row kernels ===
+//
+// Pixels [x0, width) of one row of 16-bit words. Each SIMD kernel hands
+// the pixels left over after its last full block to the next narrower one.
+
+static void luma_row_scalar(const uint8_t* s, uint8_t* d, int x0, int width, int shift,
+                            uint16_t mask) {
+    for (int x = x0; x < width; ++x) {
+        const int v = ((s[2 * x] | s[2 * x + 1] << 8) >> shift) & mask;
+        d[x] = uint8_t(std::min(v, 255));
+    }
+}
+
+#ifdef LUMA_X86
+
+// 16 pixels: two loads, shift and mask each, one saturating pack.
+TARGET_SSE2 static void luma_row_sse2(const uint8_t* s, uint8_t* d, int x0, int width,
+                                      int shift, uint16_t mask) {
+    const __m128i count = _mm_cvtsi32_si128(shift);
+    const __m128i m     = _mm_set1_epi16(int16_t(mask));
+    int x = x0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 2 * x));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 2 * x + 16));
+        a = _mm_and_si128(_mm_srl_epi16(a, count), m);
+        b = _mm_and_si128(_mm_srl_epi16(b, count), m);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(d + x), _mm_packus_epi16(a, b));
+    }
+    luma_row_scalar(s, d, x, width, shift, mask);
+}
+
+// 32 pixels. The pack works within 128-bit lanes, so one vpermq puts the
+// four 8-pixel quarters back in order.
+TARGET_AVX2 static void luma_row_avx2(const uint8_t* s, uint8_t* d, int x0, int width,
+                                      int shift, uint16_t mask) {
+    const __m128i count = _mm_cvtsi32_si128(shift);
+    const __m256i m     = _mm256_set1_epi16(int16_t(mask));
+    int x = x0;
+    for (; x + 32 <= width; x += 32) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + 2 * x));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + 2 * x + 32));
+        a = _mm256_and_si256(_mm256_srl_epi16(a, count), m);
+        b = _mm256_and_si256(_mm256_srl_epi16(b, count), m);
+        __m256i y = _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xd8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(d + x), y);
+    }
+    _mm256_zeroupper();   // before the SSE tail, see kernel_dispatch.h
+    luma_row_sse2(s, d, x, width, shift, mask);
+}
+
+#endif // LUMA_X86
+
+//
+// === Dispatch ===
+//
+
+using LumaRowFn = void (*)(const uint8_t*, uint8_t*, int, int, int, uint16_t);
+
+struct LumaKernel {
+    const char* name;
+    LumaRowFn   row;
+    bool        supported;
+};
+
+static LumaKernel pick_kernel() {
+#ifdef LUMA_X86
+    __builtin_cpu_init();
+    const LumaKernel kernels[] = {
+        {"avx2",   luma_row_avx2,   bool(__builtin_cpu_supports("avx2"))},
+        {"sse2",   luma_row_sse2,   bool(__builtin_cpu_supports("sse2"))},
+        {"scalar", luma_row_scalar, true},
+    };
+#else
+    const LumaKernel kernels[] = {{"scalar", luma_row_scalar, true}};
+#endif
+    return select_kernel(kernels, "LUMA_ISA");
+}
+
+static const LumaKernel& kernel() {
+    static const LumaKernel k = pick_kernel();
+    return k;
+}
+
+const char* luma_isa() {
+    return kernel().name;
+}
+
+//
+// === Frame entry point ===
+//
+
+bool extract_luma(const FrameView& src, LumaPlane& out, WorkerPool& pool) {
+    LumaFourcc f;
+    out.view     = FrameView{};
+    out.borrowed = false;
+    if (!src || !luma_fourcc(src.pixelformat, f)) return false;
+
+    if (f.planar) {
+        out.view     = frame_view(src.plane[0], src.stride[0], src.width, src.height,
+                                  V4L2_PIX_FMT_GREY);
+        out.borrowed = true;
+        return true;
+    }
+
+    // Rows padded to 64 bytes, starting on a 64-byte boundary of storage.
+    const size_t stride = (size_t(src.width) + 63) & ~size_t(63);
+    out.storage.resize(stride * src.height + 63);
+    uint8_t* dst = out.storage.data() + (-uintptr_t(out.storage.data()) & 63);
+    out.view = frame_view(dst, stride, src.width, src.height, V4L2_PIX_FMT_GREY);
+
+    // With padded source rows (CaptureConfig::stride_align), run whole
+    // 32-pixel blocks to the end of every row; the extra bytes land in the
+    // padding of `storage`.
+    const int  span  = (src.width + 31) & ~31;
+    const int  width = src.stride[0] >= size_t(span) * 2 ? span : src.width;
+
+    // Each stripe streams its rows once.
+    const LumaRowFn row = kernel().row;
+    in_stripes(src.height, 16, pool, [&](int y0, int y1) {
+        for (int y = y0; y < y1; ++y)
+            row(src.plane[0] + size_t(y) * src.stride[0], dst + size_t(y) * stride, 0, width,
+                f.shift, f.mask);
+    });
+    return true;
+}
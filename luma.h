@@ -0,0 +1,54 @@
+// luma.h
+//
+// The Y channel alone, as 8-bit greyscale, for consumers that never look
+// at colour (motion detection, barcode reading, focus metrics):
+//   - planar formats (GREY, NV12, NV16, YUV420 and their ...M variants)
+//     already store it as a plane of bytes, so the result is a view of the
+//     frame itself and nothing is copied;
+//   - packed YUYV/UYVY/YVYU/VYUY are deinterleaved, every other byte of
+//     each row (SIMD: mask or shift, then pack);
+//   - 16-bit samples (Y10..Y16, P010's Y plane) keep their top 8
+//     significant bits, the same pack.
+// Deinterleaving reads 2 and writes 1 byte per pixel, against 2 and 3 for
+// RGB24, and the output is a third of the size for whatever reads it next.
+//
+// Copies go into the LumaPlane's own storage, with rows padded to 64 bytes
+// and 64-byte aligned for SIMD consumers; a consumer that keeps reusing one
+// LumaPlane (or a few, round robin) stops allocating after the first frame.
+//
+// Set LUMA_ISA=scalar|sse2|avx2 in the environment to force a narrower
+// kernel; they all produce the same bytes.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "frame_view.h"
+
+class WorkerPool;
+
+struct LumaPlane {
+    // One V4L2_PIX_FMT_GREY plane: either `storage` or, if `borrowed`,
+    // plane 0 of the source frame, valid only while that frame is held.
+    FrameView            view;
+    bool                 borrowed = false;
+    std::vector<uint8_t> storage;
+};
+
+// True if extract_luma() handles the format.
+bool has_luma(uint32_t pixelformat);
+// True if its luma comes without a copy.
+bool luma_is_planar(uint32_t pixelformat);
+
+// Fourcc for "grey", "yuyv", "uyvy", "yvyu", "vyuy", "nv12", "nv21",
+// "nv16", "nv61", "yuv420", "yvu420", "yuv422p" or a yuv16_convert.h name
+// ("y10", ..., "p010"); 0 if unknown.
+uint32_t luma_pixelformat(const char* name);
+
+// Fill `out` with the luma of `src`, deinterleaving in row stripes on
+// `pool` when it is not planar. False (and `out` left empty) for a format
+// without a luma channel, e.g. Bayer or MJPEG.
+bool extract_luma(const FrameView& src, LumaPlane& out, WorkerPool& pool);
+
+// Name of the kernel in use: "avx2", "sse2" or "scalar".
+const char* luma_isa();
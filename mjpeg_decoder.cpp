@@ -0,0 +1,228 @@
+// mjpeg_decoder.cpp
+#include "mjpeg_decoder.h"
+
+#include <algorithm>
+#include <csetjmp>
+#include <cstdio>
+#include <jpeglib.h>
+
+//
+// === libjpeg glue ===
+//
+
+// libjpeg reports fatal errors through error_exit, which must not return;
+// jump back into decode_jpeg() instead of exiting the process.
+struct JpegError {
+    jpeg_error_mgr mgr;
+    jmp_buf        jump;
+};
+
+static void jpeg_error_exit(j_common_ptr c) {
+    longjmp(reinterpret_cast<JpegError*>(c->err)->jump, 1);
+}
+
+// Corrupt-data warnings are routine with MJPEG over USB; keep them quiet.
+static void jpeg_output_message(j_common_ptr) {}
+
+static void layout_rgb(const jpeg_decompress_struct& c, DecodedFrame& f) {
+    f.width           = c.output_width;
+    f.height          = c.output_height;
+    f.num_planes      = 1;
+    // Rows padded to the default GL_UNPACK_ALIGNMENT.
+    f.stride[0]       = (size_t(f.width) * 3 + 3) & ~size_t(3);
+    f.plane_width[0]  = f.width;
+    f.plane_height[0] = f.height;
+    f.storage.resize(f.stride[0] * f.height);
+    f.plane[0]        = f.storage.data();
+}
+
+// Raw output is written a whole iMCU row at a time, so every plane is
+// allocated padded to full MCUs. When scaling, each block decodes to
+// DCT_scaled_size pixels square instead of 8; libjpeg-turbo may give the
+// chroma blocks a larger size than luma to save upsampling later, so the
+// plane sizes come from libjpeg rather than the sampling factors.
+static void layout_yuv(const jpeg_decompress_struct& c, DecodedFrame& f) {
+    f.width      = c.output_width;
+    f.height     = c.output_height;
+    f.num_planes = 3;
+    size_t offset[3], total = 0;
+    for (int i = 0; i < 3; ++i) {
+        const jpeg_component_info& comp = c.comp_info[i];
+        const size_t block = comp.DCT_scaled_size;
+        f.stride[i]       = size_t(c.MCUs_per_row) * comp.h_samp_factor * block;
+        offset[i]         = total;
+        total            += f.stride[i] * c.total_iMCU_rows * comp.v_samp_factor * block;
+        f.plane_width[i]  = comp.downsampled_width;
+        f.plane_height[i] = comp.downsampled_height;
+    }
+    f.storage.resize(total);
+    for (int i = 0; i < 3; ++i) f.plane[i] = f.storage.data() + offset[i];
+}
+
+static void read_rgb(jpeg_decompress_struct& c, DecodedFrame& f) {
+    JSAMPROW rows[16];
+    while (c.output_scanline < c.output_height) {
+        const JDIMENSION first = c.output_scanline;
+        const JDIMENSION n     = std::min<JDIMENSION>(16, c.output_height - first);
+        for (JDIMENSION r = 0; r < n; ++r) rows[r] = f.plane[0] + (first + r) * f.stride[0];
+        jpeg_read_scanlines(&c, rows, n);
+    }
+}
+
+static void read_yuv(jpeg_decompress_struct& c, DecodedFrame& f) {
+    // Up to 4 (sampling factor) x 8 rows per component per call.
+    JSAMPROW   rows[3][4 * DCTSIZE];
+    JSAMPARRAY planes[3] = {rows[0], rows[1], rows[2]};
+    const JDIMENSION step = c.max_v_samp_factor * c.min_DCT_scaled_size;
+    for (JDIMENSION imcu = 0; c.output_scanline < c.output_height; ++imcu) {
+        for (int i = 0; i < 3; ++i) {
+            const int    n     = c.comp_info[i].v_samp_factor * c.comp_info[i].DCT_scaled_size;
+            uint8_t*     first = f.plane[i] + size_t(imcu) * n * f.stride[i];
+            for (int r = 0; r < n; ++r) rows[i][r] = first + r * f.stride[i];
+        }
+        jpeg_read_raw_data(&c, planes, step);
+    }
+}
+
+// Returns false for data libjpeg cannot decode, or that does not fit the
+// requested output.
+static bool decode_jpeg(jpeg_decompress_struct& c, const std::vector<uint8_t>& jpeg,
+                        unsigned scale, MjpegOutput output, DecodedFrame& f) {
+    JpegError* err = reinterpret_cast<JpegError*>(c.err);
+    if (setjmp(err->jump)) {
+        jpeg_abort_decompress(&c);
+        return false;
+    }
+    // Most UVC cameras leave out the Huffman tables; libjpeg-turbo falls
+    // back to the standard ones from the spec, as MJPEG requires.
+    jpeg_mem_src(&c, jpeg.data(), jpeg.size());
+    if (jpeg_read_header(&c, TRUE) != JPEG_HEADER_OK) {
+        jpeg_abort_decompress(&c);
+        return false;
+    }
+    c.scale_num   = 1;
+    c.scale_denom = scale;
+    if (output == MjpegOutput::Rgb24) {
+        c.out_color_space = JCS_EXT_RGB;
+        jpeg_start_decompress(&c);
+        layout_rgb(c, f);
+        read_rgb(c, f);
+    } else {
+        if (c.num_components != 3 || c.jpeg_color_space != JCS_YCbCr ||
+            c.max_v_samp_factor > 4) {
+            jpeg_abort_decompress(&c);
+            return false;
+        }
+        c.raw_data_out = TRUE;
+        jpeg_start_decompress(&c);
+        layout_yuv(c, f);
+        read_yuv(c, f);
+    }
+    jpeg_finish_decompress(&c);
+    return true;
+}
+
+//
+// === MjpegDecoder ===
+//
+
+MjpegDecoder::MjpegDecoder(MjpegOutput output, unsigned threads, unsigned max_in_flight)
+    : output_(output) {
+    if (!threads) threads = std::max(1u, std::thread::hardware_concurrency());
+    if (!max_in_flight) max_in_flight = threads * 2;
+    jobs_.resize(max_in_flight);
+    for (unsigned i = 0; i < threads; ++i)
+        workers_.emplace_back(&MjpegDecoder::work, this);
+}
+
+MjpegDecoder::~MjpegDecoder() {
+    {
+        std::lock_guard<std::mutex> lk(lock_);
+        quit_ = true;
+    }
+    wake_.notify_all();
+    for (auto& t : workers_) t.join();
+}
+
+bool MjpegDecoder::submit(const uint8_t* jpeg, size_t size, uint32_t sequence, unsigned scale) {
+    if (scale != 1 && scale != 2 && scale != 4 && scale != 8) return false;
+    {
+        std::lock_guard<std::mutex> lk(lock_);
+        if (submitted_ - delivered_ == jobs_.size()) return false;
+        // Workers only touch slots between started_ and submitted_, and
+        // pop() only ones marked done, so this slot is ours until
+        // submitted_ moves past it.
+        Job& job = jobs_[submitted_ % jobs_.size()];
+        job.sequence = sequence;
+        job.scale    = scale;
+        job.jpeg.assign(jpeg, jpeg + size);
+        job.done = false;
+        ++submitted_;
+    }
+    wake_.notify_one();
+    return true;
+}
+
+bool MjpegDecoder::pop(DecodedFrame& out) {
+    std::lock_guard<std::mutex> lk(lock_);
+    return take(out);
+}
+
+bool MjpegDecoder::wait_pop(DecodedFrame& out) {
+    std::unique_lock<std::mutex> lk(lock_);
+    while (!take(out)) {
+        if (delivered_ == submitted_) return false;
+        decoded_.wait(lk, [&] { return jobs_[delivered_ % jobs_.size()].done; });
+    }
+    return true;
+}
+
+// Deliver the oldest job if it is done, skipping failed ones. Called with
+// lock_ held.
+bool MjpegDecoder::take(DecodedFrame& out) {
+    while (delivered_ < submitted_) {
+        Job& job = jobs_[delivered_ % jobs_.size()];
+        if (!job.done) return false;
+        ++delivered_;
+        if (!job.ok) {
+            ++errors_;
+            continue;
+        }
+        // The caller's old buffer goes back into the slot for reuse.
+        std::swap(out, job.out);
+        out.sequence = job.sequence;
+        return true;
+    }
+    return false;
+}
+
+uint64_t MjpegDecoder::errors() const {
+    std::lock_guard<std::mutex> lk(lock_);
+    return errors_;
+}
+
+void MjpegDecoder::work() {
+    jpeg_decompress_struct c{};
+    JpegError err;
+    c.err = jpeg_std_error(&err.mgr);
+    err.mgr.error_exit     = jpeg_error_exit;
+    err.mgr.output_message = jpeg_output_message;
+    jpeg_create_decompress(&c);
+
+    std::unique_lock<std::mutex> lk(lock_);
+    for (;;) {
+        wake_.wait(lk, [&] { return quit_ || started_ < submitted_; });
+        if (quit_) break;
+        Job& job = jobs_[started_++ % jobs_.size()];
+        lk.unlock();
+
+        bool ok = decode_jpeg(c, job.jpeg, job.scale, output_, job.out);
+
+        lk.lock();
+        job.ok   = ok;
+        job.done = true;
+        decoded_.notify_all();
+    }
+    lk.unlock();
+    jpeg_destroy_decompress(&c);
+}
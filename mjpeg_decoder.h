@@ -0,0 +1,103 @@
+// mjpeg_decoder.h
+//
+// Frame-parallel MJPEG decoding with libjpeg-turbo. Every worker thread
+// owns one decompressor and decodes whole frames, so N threads keep up
+// with N times the single-core decode rate; pop() still hands the frames
+// out in the order they were submitted.
+//
+// submit() copies the bitstream (a few hundred KB at most), so the V4L2
+// buffer can be queued back right away instead of being held for the
+// whole decode. Decoded frames are recycled: pop() returns the previous
+// contents of `out` to the decoder, so a consumer that keeps reusing one
+// DecodedFrame stops allocating after the first few frames.
+//
+// Output is either RGB24 or the raw Y, Cb and Cr planes at the JPEG's own
+// chroma subsampling (usually 4:2:2 from webcams) for a shader to convert;
+// JPEG YCbCr is full-range BT.601. Use plane_width/plane_height rather than
+// assuming a chroma ratio: scaled decodes can return fuller chroma.
+//
+// Each frame can also be decoded at 1/2, 1/4 or 1/8 size. libjpeg-turbo
+// then runs a reduced inverse DCT per block instead of decoding at full
+// size and scaling afterwards, so a 1/4 preview costs a fraction of a
+// full decode (entropy decoding still touches the whole bitstream).
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+enum class MjpegOutput { Rgb24, YuvPlanes };
+
+struct DecodedFrame {
+    uint32_t       sequence   = 0;
+    int            width      = 0;
+    int            height     = 0;
+    unsigned       num_planes = 0;          // 1 for RGB24, 3 for Y/Cb/Cr
+    uint8_t*       plane[3]{};
+    size_t         stride[3]{};
+    int            plane_width[3]{};        // visible size of each plane
+    int            plane_height[3]{};
+    std::vector<uint8_t> storage;
+};
+
+// Width or height of a frame decoded at 1/scale, rounded as libjpeg does.
+inline int mjpeg_scaled(int size, unsigned scale) {
+    return int((unsigned(size) + scale - 1) / scale);
+}
+
+class MjpegDecoder {
+public:
+    // threads == 0: one per CPU. At most `max_in_flight` frames may be
+    // submitted but not yet popped (0 = twice the thread count).
+    explicit MjpegDecoder(MjpegOutput output, unsigned threads = 0, unsigned max_in_flight = 0);
+    ~MjpegDecoder();
+
+    MjpegDecoder(const MjpegDecoder&)            = delete;
+    MjpegDecoder& operator=(const MjpegDecoder&) = delete;
+
+    // Queue one compressed frame, to be decoded at 1/scale size (1, 2, 4
+    // or 8). Returns false, without queueing it, when max_in_flight frames
+    // are already pending (the caller drops the frame) or for another
+    // scale.
+    bool submit(const uint8_t* jpeg, size_t size, uint32_t sequence, unsigned scale = 1);
+    // Next frame in submission order, if it has been decoded. Frames that
+    // failed to decode (truncated USB transfers are common) are skipped
+    // and counted in errors().
+    bool pop(DecodedFrame& out);
+    // Like pop(), but sleeps until the next frame has been decoded. False
+    // once nothing submitted is left to deliver.
+    bool wait_pop(DecodedFrame& out);
+
+    unsigned threads() const { return unsigned(workers_.size()); }
+    uint64_t errors() const;
+
+private:
+    struct Job {
+        uint32_t             sequence = 0;
+        unsigned             scale    = 1;
+        std::vector<uint8_t> jpeg;
+        DecodedFrame         out;
+        bool                 done = false;
+        bool                 ok   = false;
+    };
+
+    void work();
+    bool take(DecodedFrame& out);
+
+    const MjpegOutput        output_;
+    std::vector<std::thread> workers_;
+    // Ring of max_in_flight jobs; job n lives in jobs_[n % size]. A slot
+    // is reused only once its frame has been popped.
+    std::vector<Job>         jobs_;
+    mutable std::mutex       lock_;
+    std::condition_variable  wake_;
+    std::condition_variable  decoded_;   // a job finished
+    uint64_t                 submitted_ = 0;
+    uint64_t                 started_   = 0;
+    uint64_t                 delivered_ = 0;
+    uint64_t                 errors_    = 0;
+    bool                     quit_      = false;
+};
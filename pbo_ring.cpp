@@ -0,0 +1,136 @@
+// pbo_ring.cpp
+#include "pbo_ring.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <unistd.h>
+
+bool PboRing::init(size_t bytes, unsigned count) {
+    destroy();
+    count_ = std::clamp(count, 2u, MAX_BUFFERS);
+    bytes_ = bytes;
+    glGenBuffers(count_, pbo_);
+    for (unsigned i = 0; i < count_; ++i) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo_[i]);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes_, nullptr, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    if (glGetError() != GL_NO_ERROR) {
+        fprintf(stderr, "PboRing: cannot allocate %u x %zu bytes\n", count_, bytes_);
+        destroy();
+        return false;
+    }
+    return true;
+}
+
+void PboRing::destroy() {
+    if (!count_) return;
+    for (unsigned i = 0; i < count_; ++i) {
+        if (fence_[i]) glDeleteSync(fence_[i]);
+        fence_[i] = nullptr;
+    }
+    glDeleteBuffers(count_, pbo_);
+    std::fill(pbo_, pbo_ + count_, 0);
+    count_ = 0;
+    next_  = 0;
+}
+
+uint8_t* PboRing::map() {
+    if (GLsync& f = fence_[next_]) {
+        // Poll first so a stall is only counted when we really wait.
+        GLenum r = glClientWaitSync(f, 0, 0);
+        if (r == GL_TIMEOUT_EXPIRED) {
+            ++stalls_;
+            r = glClientWaitSync(f, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+        }
+        if (r == GL_WAIT_FAILED || r == GL_TIMEOUT_EXPIRED)
+            fprintf(stderr, "PboRing: fence wait failed (0x%x)\n", r);
+        glDeleteSync(f);
+        f = nullptr;
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo_[next_]);
+    // The fence already guarantees the GL is done with this buffer, so no
+    // implicit sync is needed; invalidate so the old contents are not kept.
+    void* p = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes_,
+                               GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT |
+                               GL_MAP_UNSYNCHRONIZED_BIT);
+    if (!p) {
+        fprintf(stderr, "PboRing: glMapBufferRange failed (0x%x)\n", glGetError());
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+    return static_cast<uint8_t*>(p);
+}
+
+bool PboRing::unmap() {
+    // False when the driver lost the mapping (e.g. on a mode switch); the
+    // buffer contents are undefined then.
+    return glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_TRUE;
+}
+
+void PboRing::submit() {
+    fence_[next_] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    next_ = (next_ + 1) % count_;
+}
+
+//
+// === PersistentPbos ===
+//
+
+bool PersistentPbos::init(size_t bytes, unsigned count) {
+    destroy();
+    if (!GLAD_GL_VERSION_4_4) {
+        fprintf(stderr, "PersistentPbos: needs GL 4.4 (buffer storage)\n");
+        return false;
+    }
+    const size_t page = sysconf(_SC_PAGESIZE);
+    bytes_ = (bytes + page - 1) / page * page;
+    count_ = std::min(count, unsigned(VIDEO_MAX_FRAME));
+    // Coherent, so writes land without explicit flushes; CLIENT_STORAGE
+    // asks for system memory, which a capture driver can pin and DMA into.
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT |
+                             GL_MAP_COHERENT_BIT;
+    glGenBuffers(count_, pbo_);
+    for (unsigned i = 0; i < count_; ++i) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo_[i]);
+        glBufferStorage(GL_PIXEL_UNPACK_BUFFER, bytes_, nullptr, flags | GL_CLIENT_STORAGE_BIT);
+        ptr_[i] = static_cast<uint8_t*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes_, flags));
+        if (!ptr_[i]) {
+            fprintf(stderr, "PersistentPbos: cannot map buffer %u (0x%x)\n", i, glGetError());
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            destroy();
+            return false;
+        }
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    return true;
+}
+
+void PersistentPbos::destroy() {
+    if (!count_) return;
+    for (unsigned i = 0; i < count_; ++i) {
+        if (fence_[i]) glDeleteSync(fence_[i]);
+        fence_[i] = nullptr;
+        // Deleting a buffer unmaps it.
+        ptr_[i] = nullptr;
+    }
+    glDeleteBuffers(count_, pbo_);
+    std::fill(pbo_, pbo_ + count_, 0);
+    count_ = 0;
+}
+
+void PersistentPbos::fence(unsigned i) {
+    if (fence_[i]) glDeleteSync(fence_[i]);
+    fence_[i] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+bool PersistentPbos::signalled(unsigned i) {
+    if (!fence_[i]) return true;
+    // Flush once so a fence that was never submitted cannot hang forever.
+    GLenum r = glClientWaitSync(fence_[i], GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+    if (r == GL_TIMEOUT_EXPIRED) return false;
+    if (r == GL_WAIT_FAILED) fprintf(stderr, "PersistentPbos: fence wait failed\n");
+    glDeleteSync(fence_[i]);
+    fence_[i] = nullptr;
+    return true;
+}
@@ -0,0 +1,91 @@
+// pbo_ring.h
+//
+// Ring of pixel unpack buffers for streaming texture uploads. The CPU
+// writes frame N+1 into one mapped buffer while the GL is still copying
+// frame N out of another into the texture; a fence per buffer keeps a slot
+// from being mapped again before the transfer that reads it has finished.
+//
+// Per frame:
+//   uint8_t* p = ring.map();        // waits only if the slot is in flight
+//   ... fill p ...
+//   if (ring.unmap())               // leaves the buffer bound for unpack
+//       glTexSubImage2D(..., nullptr);  // source is offset 0 of the buffer
+//   ring.submit();                  // fence, unbind, advance
+//
+// Needs a current GL 3.2+ context (glMapBufferRange and sync objects).
+//
+// PersistentPbos is the zero-copy variant for GL 4.4 (buffer storage):
+// buffers that stay mapped for their whole life, so something else (the
+// camera, via V4L2 USERPTR) can write into them directly. The owner
+// fences each buffer after the GL reads it and must not let anything write
+// to it again until signalled() says the read is done.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <glad/glad.h>
+#include <linux/videodev2.h>
+
+class PboRing {
+public:
+    static constexpr unsigned MAX_BUFFERS = 8;
+
+    PboRing() = default;
+    ~PboRing() { destroy(); }
+
+    PboRing(const PboRing&)            = delete;
+    PboRing& operator=(const PboRing&) = delete;
+
+    // `count` buffers of `bytes` each; count is clamped to 2..MAX_BUFFERS.
+    bool init(size_t bytes, unsigned count = 3);
+    void destroy();
+
+    size_t   size()  const { return bytes_; }
+    unsigned count() const { return count_; }
+    // Times map() had to block on a fence: the ring was too short for
+    // the upload latency.
+    uint64_t stalls() const { return stalls_; }
+
+    uint8_t* map();
+    bool     unmap();
+    void     submit();
+
+private:
+    GLuint   pbo_[MAX_BUFFERS]{};
+    GLsync   fence_[MAX_BUFFERS]{};
+    unsigned count_ = 0;
+    unsigned next_  = 0;
+    size_t   bytes_ = 0;
+    uint64_t stalls_ = 0;
+};
+
+class PersistentPbos {
+public:
+    PersistentPbos() = default;
+    ~PersistentPbos() { destroy(); }
+
+    PersistentPbos(const PersistentPbos&)            = delete;
+    PersistentPbos& operator=(const PersistentPbos&) = delete;
+
+    // `count` buffers of `bytes` each, rounded up to whole pages so they
+    // can be handed to a driver. Fails below GL 4.4.
+    bool init(size_t bytes, unsigned count);
+    void destroy();
+
+    size_t   size()  const { return bytes_; }
+    unsigned count() const { return count_; }
+    GLuint   buffer(unsigned i) const { return pbo_[i]; }
+    uint8_t* data(unsigned i)   const { return ptr_[i]; }
+
+    // Fence buffer i after the commands that read it.
+    void fence(unsigned i);
+    // True once the GL no longer reads buffer i (or it was never fenced).
+    bool signalled(unsigned i);
+
+private:
+    GLuint   pbo_[VIDEO_MAX_FRAME]{};
+    uint8_t* ptr_[VIDEO_MAX_FRAME]{};
+    GLsync   fence_[VIDEO_MAX_FRAME]{};
+    unsigned count_ = 0;
+    size_t   bytes_ = 0;
+};
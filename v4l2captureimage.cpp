@@ -1,93 +1,157 @@
-#include <fcntl.h>
-#include <sys/ioctl.h>
-#include <sys/mman.h>
-#include <linux/videodev2.h>
+#include "capture_device.h"
+#include "mjpeg_decoder.h"
+#include "bayer.h"
+#include "luma.h"
+#include "worker_pool.h"
 #include <cstdio>
-#include <unistd.h>
-
-int main() {
-    const char* dev_name = "/dev/video0";
-    const char* out_name = "output1.jpg";
-    const int width = 1280;
-    const int height = 720;
-
-    // Open device
-    int fd = open(dev_name, O_RDWR);
-    if (fd < 0) {
-        perror("Failed to open device");
-        return 1;
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+//g++ v4l2captureimage.cpp capture_device.cpp format_negotiator.cpp mjpeg_decoder.cpp bayer.cpp luma.cpp yuv16_convert.cpp worker_pool.cpp -o v4l2captureimage -ljpeg -pthread
+
+// Decode the JPEG at 1/scale size and write it as a binary PPM.
+static bool write_preview(const Frame& frame, unsigned scale, const char* name) {
+    MjpegDecoder decoder(MjpegOutput::Rgb24, 1, 1);
+    DecodedFrame rgb;
+    if (!decoder.submit(frame.data(), frame.size(), frame.buffer().sequence, scale)) return false;
+    if (!decoder.wait_pop(rgb)) {
+        fprintf(stderr, "Captured frame is not a decodable JPEG\n");
+        return false;
     }
-
-    // Set video format
-    v4l2_format fmt = {};
-    fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    fmt.fmt.pix.width = width;
-    fmt.fmt.pix.height = height;
-    fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_MJPEG;
-    fmt.fmt.pix.field = V4L2_FIELD_NONE;
-
-    if (ioctl(fd, VIDIOC_S_FMT, &fmt) < 0) {
-        perror("Failed to set format");
-        close(fd);
-        return 1;
+    FILE* fp = fopen(name, "wb");
+    if (!fp) {
+        perror("Failed to open preview file");
+        return false;
     }
+    fprintf(fp, "P6\n%d %d\n255\n", rgb.width, rgb.height);
+    for (int y = 0; y < rgb.height; ++y)
+        fwrite(rgb.plane[0] + y * rgb.stride[0], size_t(rgb.width) * 3, 1, fp);
+    fclose(fp);
+    printf("Preview written to %s (%dx%d)\n", name, rgb.width, rgb.height);
+    return true;
+}
 
-    // Request buffer
-    v4l2_requestbuffers req = {};
-    req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    req.memory = V4L2_MEMORY_MMAP;
-    req.count = 1;
+// Demosaic a raw Bayer frame and write it as a binary PPM.
+static bool write_demosaiced(const Frame& frame, Demosaic mode, const char* name) {
+    const FrameView src = frame.view();
+    if (!src) {
+        fprintf(stderr, "Captured frame is truncated\n");
+        return false;
+    }
+    const size_t stride = size_t(src.width) * 3;
+    std::vector<uint8_t> rgb(stride * src.height);
+    WorkerPool pool;
+    if (!bayer_to_rgb24(src, rgb.data(), stride, mode, pool)) {
+        fprintf(stderr, "Driver returned %s, not a Bayer format\n",
+                fourcc_to_string(src.pixelformat).c_str());
+        return false;
+    }
+    FILE* fp = fopen(name, "wb");
+    if (!fp) {
+        perror("Failed to open image file");
+        return false;
+    }
+    fprintf(fp, "P6\n%d %d\n255\n", src.width, src.height);
+    fwrite(rgb.data(), rgb.size(), 1, fp);
+    fclose(fp);
+    printf("Demosaiced image written to %s\n", name);
+    return true;
+}
 
-    if (ioctl(fd, VIDIOC_REQBUFS, &req) < 0) {
-        perror("Failed to request buffers");
-        close(fd);
-        return 1;
+// Write the frame's Y channel alone as a binary PGM.
+static bool write_luma(const Frame& frame, const char* name) {
+    const FrameView src = frame.view();
+    LumaPlane luma;
+    WorkerPool pool;
+    if (!extract_luma(src, luma, pool)) {
+        fprintf(stderr, "Captured frame is truncated or has no luma\n");
+        return false;
+    }
+    FILE* fp = fopen(name, "wb");
+    if (!fp) {
+        perror("Failed to open image file");
+        return false;
     }
+    const FrameView& y = luma.view;
+    fprintf(fp, "P5\n%d %d\n255\n", y.width, y.height);
+    for (int r = 0; r < y.height; ++r)
+        fwrite(y.plane[0] + r * y.stride[0], size_t(y.width), 1, fp);
+    fclose(fp);
+    printf("Luma written to %s (%s, %s)\n", name, luma.borrowed ? "in place" : "deinterleaved",
+           luma_isa());
+    return true;
+}
 
-    // Query and map buffer
-    v4l2_buffer buf = {};
-    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    buf.memory = V4L2_MEMORY_MMAP;
-    buf.index = 0;
+int main(int argc, char** argv) {
+    const char* dev_name = "/dev/video0";
+    const char* out_name = "output1.jpg";
+    const char* preview_name = "preview.ppm";
+    const int width = 1280;
+    const int height = 720;
 
-    if (ioctl(fd, VIDIOC_QUERYBUF, &buf) < 0) {
-        perror("Failed to query buffer");
-        close(fd);
-        return 1;
+    // --preview N: also decode the frame at 1/N size (1, 2, 4, 8) into
+    // preview.ppm; the reduced-size IDCT makes small previews cheap.
+    unsigned preview_scale = 0;
+    // --bayer NAME: capture a raw Bayer frame (sbggr8, srggb10, srggb10p,
+    // ...) instead of MJPEG, save it as output1.raw and demosaic it into
+    // output1.ppm; --demosaic bilinear|edge picks the interpolation
+    // (default edge, the better one for stills).
+    uint32_t bayer = 0;
+    Demosaic demosaic = Demosaic::EdgeAware;
+    // --luma NAME: capture a raw YUV or greyscale frame (yuyv, uyvy, nv12,
+    // grey, y10, p010, ...), save it as output1.raw and its Y channel alone
+    // as output1.pgm, the way analytics consumers would take it.
+    uint32_t luma = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--preview") && i + 1 < argc)
+            preview_scale = strtoul(argv[++i], nullptr, 0);
+        else if (!strcmp(argv[i], "--bayer") && i + 1 < argc &&
+                 !(bayer = bayer_pixelformat(argv[++i]))) {
+            fprintf(stderr, "Unknown Bayer format %s\n", argv[i]);
+            return 1;
+        }
+        else if (!strcmp(argv[i], "--luma") && i + 1 < argc &&
+                 !(luma = luma_pixelformat(argv[++i]))) {
+            fprintf(stderr, "Unknown luma format %s\n", argv[i]);
+            return 1;
+        }
+        else if (!strcmp(argv[i], "--demosaic") && i + 1 < argc &&
+                 !parse_demosaic(argv[++i], demosaic)) {
+            fprintf(stderr, "Unknown demosaic %s\n", argv[i]);
+            return 1;
+        }
     }
-
-    void* buffer = mmap(NULL, buf.length, 
-                       PROT_READ | PROT_WRITE, MAP_SHARED,
-                       fd, buf.m.offset);
-    if (buffer == MAP_FAILED) {
-        perror("Failed to map buffer");
-        close(fd);
+    if (bayer && luma) {
+        fprintf(stderr, "--bayer and --luma are exclusive\n");
         return 1;
     }
-
-    // Queue buffer
-    if (ioctl(fd, VIDIOC_QBUF, &buf) < 0) {
-        perror("Failed to queue buffer");
-        munmap(buffer, buf.length);
-        close(fd);
+    if (bayer || luma) out_name = "output1.raw";
+
+    // Open device, set video format and map a single buffer
+    CaptureConfig cfg;
+    cfg.device = dev_name;
+    cfg.width = width;
+    cfg.height = height;
+    cfg.pixelformat = bayer ? bayer : luma ? luma : V4L2_PIX_FMT_MJPEG;
+    cfg.field = V4L2_FIELD_NONE;
+    cfg.num_buffers = 1;
+
+    CaptureDevice cam;
+    if (!cam.open(cfg)) {
+        fprintf(stderr, "Failed to open %s\n", dev_name);
         return 1;
     }
 
-    // Start streaming
-    enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    if (ioctl(fd, VIDIOC_STREAMON, &type) < 0) {
-        perror("Failed to start streaming");
-        munmap(buffer, buf.length);
-        close(fd);
+    // Queue buffer and start streaming
+    if (!cam.start()) {
+        fprintf(stderr, "Failed to start streaming\n");
         return 1;
     }
 
     // Dequeue buffer (capture frame)
-    if (ioctl(fd, VIDIOC_DQBUF, &buf) < 0) {
-        perror("Failed to dequeue buffer");
-        ioctl(fd, VIDIOC_STREAMOFF, &type);
-        munmap(buffer, buf.length);
-        close(fd);
+    Frame frame = cam.grab();
+    if (!frame) {
+        fprintf(stderr, "Failed to dequeue buffer\n");
         return 1;
     }
 
@@ -95,20 +159,24 @@ int main() {
     FILE* fp = fopen(out_name, "wb");
     if (!fp) {
         perror("Failed to open output file");
-        ioctl(fd, VIDIOC_STREAMOFF, &type);
-        munmap(buffer, buf.length);
-        close(fd);
         return 1;
     }
 
-    fwrite(buffer, buf.bytesused, 1, fp);
+    fwrite(frame.data(), frame.size(), 1, fp);
     fclose(fp);
 
+    if (bayer && !write_demosaiced(frame, demosaic, "output1.ppm")) {
+        fprintf(stderr, "Failed to demosaic frame\n");
+    } else if (luma && !write_luma(frame, "output1.pgm")) {
+        fprintf(stderr, "Failed to extract luma\n");
+    } else if (!bayer && !luma && preview_scale && !write_preview(frame, preview_scale, preview_name)) {
+        fprintf(stderr, "Failed to write preview\n");
+    }
+
     // Cleanup
-    ioctl(fd, VIDIOC_STREAMOFF, &type);
-    munmap(buffer, buf.length);
-    close(fd);
+    frame.release();
+    cam.close();
 
-    printf("Image captured to %s\n", out_name);
+    printf("Image captured to %s (%ux%u)\n", out_name, cam.width(), cam.height());
     return 0;
 }
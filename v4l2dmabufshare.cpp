@@ -0,0 +1,131 @@
+#include "capture_device.h"
+#include "dmabuf_share.h"
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+//g++ v4l2dmabufshare.cpp capture_device.cpp format_negotiator.cpp dmabuf_share.cpp -o v4l2dmabufshare
+//
+// Zero-copy frame sharing between processes:
+//   ./v4l2dmabufshare serve /tmp/v4l2.sock [/dev/video0]
+//   ./v4l2dmabufshare view  /tmp/v4l2.sock [frames] [out.raw]
+// The server exports its capture buffers as dmabufs and passes the fds to
+// one viewer; the viewer maps them and writes the frames to a file.
+
+static int serve(const char* path, const char* device) {
+    CaptureConfig cfg;
+    cfg.device        = device;
+    cfg.width         = 1280;
+    cfg.height        = 720;
+    cfg.pixelformat   = V4L2_PIX_FMT_YUYV;
+    cfg.field         = V4L2_FIELD_NONE;
+    cfg.export_dmabuf = true;
+
+    CaptureDevice cam;
+    if (!cam.open(cfg)) return 1;
+
+    int lsock = dmabuf_listen(path);
+    if (lsock < 0) return 1;
+    printf("Waiting for a viewer on %s\n", path);
+    int sock = accept(lsock, nullptr, nullptr);
+    if (sock < 0) { perror("accept"); return 1; }
+    close(lsock);
+
+    if (!cam.start()) return 1;
+
+    // Frames lent to the viewer, by buffer index.
+    Frame    lent[VIDEO_MAX_FRAME];
+    unsigned nlent = 0;
+    for (;;) {
+        // Leave the camera out of the poll set while the viewer holds every
+        // buffer; there is nothing for it to fill.
+        pollfd pfd[2] = {{sock, POLLIN, 0}, {cam.fd(), POLLIN, 0}};
+        int n = poll(pfd, nlent < cam.buffer_count() ? 2 : 1, 1000);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            break;
+        }
+        if (pfd[0].revents) {
+            uint32_t index;
+            if (!dmabuf_recv_release(sock, index)) break;
+            if (index < VIDEO_MAX_FRAME && lent[index]) {
+                lent[index].release();
+                --nlent;
+            }
+        }
+        if (pfd[1].revents & POLLIN) {
+            Frame f = cam.grab();
+            if (!f) continue;
+            if (!dmabuf_send_frame(sock, cam, f)) break;
+            lent[f.index()] = std::move(f);
+            ++nlent;
+        }
+    }
+    printf("Viewer disconnected\n");
+
+    for (auto& f : lent) f.release();
+    cam.stop();
+    frame_stats s = cam.stats();
+    frame_stats_print(stdout, device, &s);
+    close(sock);
+    unlink(path);
+    return 0;
+}
+
+static int view(const char* path, int frames, const char* out_name) {
+    int sock = dmabuf_connect(path);
+    if (sock < 0) return 1;
+
+    FILE* fp = fopen(out_name, "wb");
+    if (!fp) { perror(out_name); return 1; }
+
+    for (int i = 0; i < frames; ++i) {
+        DmabufFrameMsg msg;
+        int fds[VIDEO_MAX_PLANES];
+        if (!dmabuf_recv_frame(sock, msg, fds)) break;
+
+        for (unsigned p = 0; p < msg.num_planes; ++p) {
+            void* map = mmap(nullptr, msg.length[p], PROT_READ, MAP_SHARED, fds[p], 0);
+            if (map == MAP_FAILED) {
+                perror("mmap dmabuf");
+            } else {
+                dmabuf_sync(fds[p], true);
+                fwrite(static_cast<const uint8_t*>(map) + msg.offset[p], msg.bytesused[p], 1, fp);
+                dmabuf_sync(fds[p], false);
+                munmap(map, msg.length[p]);
+            }
+            close(fds[p]);
+        }
+        printf("frame %u: buffer %u, %ux%u %s\n", msg.sequence, msg.index,
+               msg.width, msg.height, fourcc_to_string(msg.pixelformat).c_str());
+
+        if (!dmabuf_send_release(sock, msg.index)) break;
+    }
+
+    fclose(fp);
+    close(sock);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s serve SOCKET [DEVICE]\n"
+                        "       %s view SOCKET [FRAMES] [OUTPUT]\n", argv[0], argv[0]);
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    if (!strcmp(argv[1], "serve"))
+        return serve(argv[2], argc > 3 ? argv[3] : "/dev/video0");
+    if (!strcmp(argv[1], "view"))
+        return view(argv[2], argc > 3 ? atoi(argv[3]) : 100, argc > 4 ? argv[4] : "frames.raw");
+
+    fprintf(stderr, "Unknown mode %s\n", argv[1]);
+    return 1;
+}
@@ -0,0 +1,71 @@
+// worker_pool.cpp
+#include "worker_pool.h"
+
+WorkerPool::WorkerPool(unsigned threads) {
+    if (!threads) threads = std::thread::hardware_concurrency();
+    for (unsigned i = 1; i < threads; ++i)
+        workers_.emplace_back(&WorkerPool::work, this);
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lk(lock_);
+        quit_ = true;
+    }
+    wake_.notify_all();
+    for (auto& t : workers_) t.join();
+}
+
+unsigned WorkerPool::drain(const std::function<void(unsigned)>& fn, unsigned tasks) {
+    unsigned ran = 0;
+    for (unsigned i; (i = next_.fetch_add(1, std::memory_order_relaxed)) < tasks; ++ran)
+        fn(i);
+    return ran;
+}
+
+void WorkerPool::work() {
+    uint64_t seen = 0;
+    std::unique_lock<std::mutex> lk(lock_);
+    for (;;) {
+        wake_.wait(lk, [&] { return quit_ || generation_ != seen; });
+        if (quit_) return;
+        seen = generation_;
+        const std::function<void(unsigned)>* fn = fn_;
+        unsigned tasks = tasks_;
+        ++busy_;
+        lk.unlock();
+
+        unsigned ran = drain(*fn, tasks);
+
+        lk.lock();
+        finished_ += ran;
+        --busy_;
+        done_.notify_all();
+    }
+}
+
+void WorkerPool::run(unsigned tasks, const std::function<void(unsigned)>& fn) {
+    if (workers_.empty() || tasks < 2) {
+        for (unsigned i = 0; i < tasks; ++i) fn(i);
+        return;
+    }
+
+    {
+        // A worker that woke too late for the previous job may still be
+        // looking at it; let it finish before next_ is reset.
+        std::unique_lock<std::mutex> lk(lock_);
+        done_.wait(lk, [&] { return busy_ == 0; });
+        fn_       = &fn;
+        tasks_    = tasks;
+        finished_ = 0;
+        next_.store(0, std::memory_order_relaxed);
+        ++generation_;
+    }
+    wake_.notify_all();
+
+    unsigned ran = drain(fn, tasks);
+
+    std::unique_lock<std::mutex> lk(lock_);
+    finished_ += ran;
+    done_.wait(lk, [&] { return finished_ == tasks_; });
+}
@@ -0,0 +1,50 @@
+// worker_pool.h
+//
+// Persistent threads for fork/join work inside one frame. run(n, fn) calls
+// fn(0) .. fn(n-1) spread over the workers and the calling thread and
+// returns once all of them have finished. The threads are created once and
+// sleep between frames, so each fork costs a wake-up, not a thread spawn.
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WorkerPool {
+public:
+    // Total threads including the caller; 0 = one per CPU. A pool of 1 runs
+    // everything inline.
+    explicit WorkerPool(unsigned threads = 0);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&)            = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    unsigned size() const { return unsigned(workers_.size()) + 1; }
+
+    // Not reentrant: call from one thread at a time.
+    void run(unsigned tasks, const std::function<void(unsigned)>& fn);
+
+private:
+    void work();
+    // Claim and run tasks until none are left; returns how many ran.
+    unsigned drain(const std::function<void(unsigned)>& fn, unsigned tasks);
+
+    std::vector<std::thread>            workers_;
+    std::mutex                          lock_;
+    std::condition_variable             wake_;
+    std::condition_variable             done_;
+    // Current job, guarded by lock_. Workers copy it when they pick up a
+    // new generation and stay counted in busy_ until they stop touching it.
+    const std::function<void(unsigned)>* fn_ = nullptr;
+    unsigned                            tasks_ = 0;
+    unsigned                            finished_ = 0;
+    unsigned                            busy_ = 0;
+    uint64_t                            generation_ = 0;
+    bool                                quit_ = false;
+    std::atomic<unsigned>               next_{0};
+};
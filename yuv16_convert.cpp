@@ -0,0 +1,483 @@
+// yuv16_convert.cpp
+#include "yuv16_convert.h"
+#include "kernel_dispatch.h"
+#include "worker_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <linux/videodev2.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define YUV16_X86 1
+#include <immintrin.h>
+#define TARGET_SSE41 __attribute__((target("sse4.1")))
+#define TARGET_AVX2  __attribute__((target("avx2")))
+#include "yuv_simd.h"
+#endif
+
+//
+// === Formats ===
+//
+
+struct Yuv16Fourcc {
+    uint32_t    fourcc;
+    const char* name;
+    Yuv16Format fmt;
+};
+
+static const Yuv16Fourcc yuv16_fourccs[] = {
+    {V4L2_PIX_FMT_Y10,  "y10",  {10, false, false}},
+    {V4L2_PIX_FMT_Y12,  "y12",  {12, false, false}},
+    {V4L2_PIX_FMT_Y14,  "y14",  {14, false, false}},
+    {V4L2_PIX_FMT_Y16,  "y16",  {16, false, false}},
+    {V4L2_PIX_FMT_P010, "p010", {10, true,  true}},
+};
+
+bool yuv16_format(uint32_t pixelformat, Yuv16Format& fmt) {
+    for (const Yuv16Fourcc& f : yuv16_fourccs)
+        if (f.fourcc == pixelformat) { fmt = f.fmt; return true; }
+    return false;
+}
+
+uint32_t yuv16_pixelformat(const char* name) {
+    for (const Yuv16Fourcc& f : yuv16_fourccs)
+        if (!strcmp(f.name, name)) return f.fourcc;
+    return 0;
+}
+
+std::vector<uint32_t> yuv16_pixelformats() {
+    std::vector<uint32_t> all;
+    for (const Yuv16Fourcc& f : yuv16_fourccs) all.push_back(f.fourcc);
+    return all;
+}
+
+static inline unsigned load_word(const uint8_t* p) {
+    return p[0] | p[1] << 8;
+}
+
+static inline uint8_t clamp8(int v) {
+    return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+//
+// === Greyscale window ===
+//
+
+bool parse_grey_window(const char* s, GreyWindow& win, bool& automatic) {
+    GreyWindow w;
+    bool       is_auto = !strncmp(s, "auto", 4);
+    char*      end;
+    if (is_auto) {
+        s += 4;
+    } else {
+        const unsigned long black = strtoul(s, &end, 0);
+        if (end == s || *end != ':') return false;
+        s = end + 1;
+        const unsigned long white = strtoul(s, &end, 0);
+        if (end == s || white <= black || white > 0xffff) return false;
+        w.black = uint16_t(black);
+        w.white = uint16_t(white);
+        s = end;
+    }
+    if (*s == ':') {
+        w.gamma = strtof(s + 1, &end);
+        if (end == s + 1 || !(w.gamma > 0)) return false;
+        s = end;
+    }
+    if (*s) return false;
+    win       = w;
+    automatic = is_auto;
+    return true;
+}
+
+GreyWindow grey16_auto_window(const uint8_t* src, size_t src_stride, int width, int height,
+                              int bits, float gamma, double clip) {
+    const unsigned maxv = (1u << bits) - 1;
+    thread_local std::vector<uint32_t> hist;
+    hist.assign(size_t(maxv) + 1, 0);
+    uint32_t n = 0;
+    for (int y = 0; y < height; y += 4) {
+        const uint8_t* row = src + size_t(y) * src_stride;
+        for (int x = 0; x < width; x += 4, ++n)
+            ++hist[std::min(load_word(row + 2 * x), maxv)];
+    }
+    // Skip the bins holding the darkest and brightest `clip` of samples.
+    const uint32_t cut = uint32_t(n * clip);
+    unsigned lo = 0, hi = maxv;
+    for (uint32_t sum = 0; lo < maxv && (sum += hist[lo]) <= cut;) ++lo;
+    for (uint32_t sum = 0; hi > 0 && (sum += hist[hi]) <= cut;) --hi;
+    if (hi <= lo) {             // flat scene: a one-code window around it
+        hi = std::min(lo + 1, maxv);
+        lo = hi - 1;
+    }
+    GreyWindow win;
+    win.black = uint16_t(lo);
+    win.white = uint16_t(hi);
+    win.gamma = gamma;
+    return win;
+}
+
+// The window in 16-bit fixed point. With d the sample minus black,
+// clamped to 0..range, the level is ((d << shift) * k) >> 16: the shift
+// fills 16 bits, so k stays below 2^13 and it all fits pmulhuw. The SIMD
+// kernels shift with a pmullw by 1 << shift, which keeps it off the
+// shuffle port the RGB interleave saturates.
+struct GreyScale {
+    uint16_t black, range;
+    int      shift;
+    uint16_t k;
+};
+
+// k rounds up, so d = range reaches `top` and nothing exceeds it.
+static GreyScale grey_scale(GreyWindow w, unsigned top) {
+    GreyScale g;
+    g.black = w.black;
+    g.range = uint16_t(std::max(1, int(w.white) - int(w.black)));
+    g.shift = 0;
+    while ((unsigned(g.range) << (g.shift + 1)) <= 0xffff) ++g.shift;
+    const unsigned span = unsigned(g.range) << g.shift;
+    g.k = uint16_t((top * 65536u + span - 1) / span);
+    return g;
+}
+
+static inline unsigned grey_level(unsigned v, const GreyScale& g) {
+    const unsigned d = std::min<unsigned>(v > g.black ? v - g.black : 0, g.range);
+    return ((d << g.shift) * g.k) >> 16;
+}
+
+// Row kernels convert samples x..width-1, so a SIMD kernel hands its tail
+// to the next narrower one.
+static void grey_row_scalar(const uint8_t* s, uint8_t* d, int x, int width, const GreyScale& g) {
+    for (; x < width; ++x) {
+        const uint8_t l = uint8_t(grey_level(load_word(s + 2 * x), g));
+        d[3 * x] = d[3 * x + 1] = d[3 * x + 2] = l;
+    }
+}
+
+// Through a 4096-entry tone curve instead; scalar.
+static void grey_row_curve(const uint8_t* s, uint8_t* d, int width, const GreyScale& g,
+                           const uint8_t* curve) {
+    for (int x = 0; x < width; ++x) {
+        const uint8_t l = curve[grey_level(load_word(s + 2 * x), g)];
+        d[3 * x] = d[3 * x + 1] = d[3 * x + 2] = l;
+    }
+}
+
+static const uint8_t* gamma_curve(float gamma) {
+    thread_local float   built = 0;
+    thread_local uint8_t curve[4096];
+    if (built != gamma) {
+        for (int i = 0; i < 4096; ++i)
+            curve[i] = uint8_t(std::lround(255 * std::pow(i / 4095.0, 1.0 / gamma)));
+        built = gamma;
+    }
+    return curve;
+}
+
+//
+// === P010 ===
+//
+// yuv_convert.h's matrix on 10-bit samples: Y' = cy * (Y - 4*yoff),
+// U' = U - 512, V' = V - 512, and the sums are shifted by 10 rather than 8
+// (8 fractional bits, 2 extra bits of depth) with a matching rounding term.
+
+constexpr int P010_ROUND = 1 << 9;
+
+template <YuvMatrix M, YuvRange R>
+static void p010_row_scalar(const uint8_t* ys, const uint8_t* uvs, uint8_t* d, int x, int width) {
+    constexpr YuvCoeffs c = yuv_coeffs(M, R);
+    for (; x < width; x += 2) {
+        const int y0 = c.cy * (int(load_word(ys + 2 * x) >> 6) - 4 * c.yoff);
+        const int y1 = c.cy * (int(load_word(ys + 2 * x + 2) >> 6) - 4 * c.yoff);
+        const int u  = int(load_word(uvs + 2 * x) >> 6) - 512;
+        const int v  = int(load_word(uvs + 2 * x + 2) >> 6) - 512;
+        const int r = c.crv * v + P010_ROUND;
+        const int g = -c.cgu * u - c.cgv * v + P010_ROUND;
+        const int b = c.cbu * u + P010_ROUND;
+        uint8_t* o = d + 3 * x;
+        o[0] = clamp8((y0 + r) >> 10);
+        o[1] = clamp8((y0 + g) >> 10);
+        o[2] = clamp8((y0 + b) >> 10);
+        o[3] = clamp8((y1 + r) >> 10);
+        o[4] = clamp8((y1 + g) >> 10);
+        o[5] = clamp8((y1 + b) >> 10);
+    }
+}
+
+#ifdef YUV16_X86
+
+//
+// === SSE4.1 ===
+//
+// Greyscale is psubusw / pminuw / pmullw / pmulhuw on 8 samples per
+// register, then packuswb and three pshufb to spread 16 levels over 48
+// RGB bytes. P010 loads 8 Y words and the 4 CbCr pairs that go with them,
+// which after the >> 6 are exactly the 16-bit Y and UV lanes the YUYV
+// kernel builds, and runs the same pmaddwd arithmetic.
+
+TARGET_SSE41 static inline __m128i grey_levels_sse41(__m128i v, __m128i black, __m128i range,
+                                                     __m128i shift, __m128i k) {
+    __m128i d = _mm_min_epu16(_mm_subs_epu16(v, black), range);
+    return _mm_mulhi_epu16(_mm_mullo_epi16(d, shift), k);
+}
+
+TARGET_SSE41 static inline __m128i grey_spread0() {
+    return _mm_setr_epi8(0, 0, 0, 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, 4, 4, 5);
+}
+TARGET_SSE41 static inline __m128i grey_spread1() {
+    return _mm_setr_epi8(5, 5, 6, 6, 6, 7, 7, 7, 8, 8, 8, 9, 9, 9, 10, 10);
+}
+TARGET_SSE41 static inline __m128i grey_spread2() {
+    return _mm_setr_epi8(10, 11, 11, 11, 12, 12, 12, 13, 13, 13, 14, 14, 14, 15, 15, 15);
+}
+
+TARGET_SSE41 static void grey_row_sse41(const uint8_t* s, uint8_t* d, int x, int width,
+                                        const GreyScale& g) {
+    const __m128i black = _mm_set1_epi16(short(g.black));
+    const __m128i range = _mm_set1_epi16(short(g.range));
+    const __m128i shift = _mm_set1_epi16(short(1 << g.shift));
+    const __m128i k     = _mm_set1_epi16(short(g.k));
+    const __m128i m0 = grey_spread0(), m1 = grey_spread1(), m2 = grey_spread2();
+    for (; x + 16 <= width; x += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 2 * x));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 2 * x + 16));
+        __m128i l = _mm_packus_epi16(grey_levels_sse41(a, black, range, shift, k),
+                                     grey_levels_sse41(b, black, range, shift, k));
+        uint8_t* o = d + 3 * x;
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(o),      _mm_shuffle_epi8(l, m0));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(o + 16), _mm_shuffle_epi8(l, m1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(o + 32), _mm_shuffle_epi8(l, m2));
+    }
+    grey_row_scalar(s, d, x, width, g);
+}
+
+template <YuvMatrix M, YuvRange R>
+TARGET_SSE41 static void p010_row_sse41(const uint8_t* ys, const uint8_t* uvs, uint8_t* d,
+                                        int x, int width) {
+    constexpr YuvCoeffs c = yuv_coeffs(M, R);
+    const __m128i yoff  = _mm_set1_epi16(4 * c.yoff);
+    const __m128i c512  = _mm_set1_epi16(512);
+    const __m128i cy    = _mm_set1_epi16(c.cy);
+    const __m128i kr    = _mm_set1_epi32(coeff_pair(0, c.crv));
+    const __m128i kg    = _mm_set1_epi32(coeff_pair(-c.cgu, -c.cgv));
+    const __m128i kb    = _mm_set1_epi32(coeff_pair(c.cbu, 0));
+    const __m128i round = _mm_set1_epi32(P010_ROUND);
+    const __m128i m_rg0 = shuffle_rg0(), m_b0 = shuffle_b0();
+    const __m128i m_rg1 = shuffle_rg1(), m_b1 = shuffle_b1();
+
+    for (; x + 8 <= width; x += 8) {
+        __m128i y  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ys + 2 * x));
+        __m128i uv = _mm_loadu_si128(reinterpret_cast<const __m128i*>(uvs + 2 * x));
+        y  = _mm_sub_epi16(_mm_srli_epi16(y, 6), yoff);
+        uv = _mm_sub_epi16(_mm_srli_epi16(uv, 6), c512);
+        __m128i ml   = _mm_mullo_epi16(y, cy);
+        __m128i mh   = _mm_mulhi_epi16(y, cy);
+        __m128i y_lo = _mm_unpacklo_epi16(ml, mh);
+        __m128i y_hi = _mm_unpackhi_epi16(ml, mh);
+
+        __m128i r = channel_sse41<10>(uv, kr, round, y_lo, y_hi);
+        __m128i g = channel_sse41<10>(uv, kg, round, y_lo, y_hi);
+        __m128i b = channel_sse41<10>(uv, kb, round, y_lo, y_hi);
+
+        __m128i rg = _mm_packus_epi16(r, g);
+        __m128i bb = _mm_packus_epi16(b, b);
+        __m128i out0 = _mm_or_si128(_mm_shuffle_epi8(rg, m_rg0), _mm_shuffle_epi8(bb, m_b0));
+        __m128i out1 = _mm_or_si128(_mm_shuffle_epi8(rg, m_rg1), _mm_shuffle_epi8(bb, m_b1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(d + 3 * x), out0);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(d + 3 * x + 16), out1);
+    }
+    p010_row_scalar<M, R>(ys, uvs, d, x, width);
+}
+
+//
+// === AVX2: twice the samples, two independent 128-bit lanes ===
+//
+
+TARGET_AVX2 static inline __m256i grey_levels_avx2(__m256i v, __m256i black, __m256i range,
+                                                   __m256i shift, __m256i k) {
+    __m256i d = _mm256_min_epu16(_mm256_subs_epu16(v, black), range);
+    return _mm256_mulhi_epu16(_mm256_mullo_epi16(d, shift), k);
+}
+
+// 16 samples: the window runs on one 256-bit register, the interleave on
+// 128 bits as in the SSE4.1 kernel. Packing two registers instead would
+// need a cross-lane vpermq on the port the pshufbs already saturate.
+TARGET_AVX2 static void grey_row_avx2(const uint8_t* s, uint8_t* d, int x, int width,
+                                      const GreyScale& g) {
+    const __m256i black = _mm256_set1_epi16(short(g.black));
+    const __m256i range = _mm256_set1_epi16(short(g.range));
+    const __m256i shift = _mm256_set1_epi16(short(1 << g.shift));
+    const __m256i k     = _mm256_set1_epi16(short(g.k));
+    const __m128i m0 = grey_spread0(), m1 = grey_spread1(), m2 = grey_spread2();
+    for (; x + 16 <= width; x += 16) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + 2 * x));
+        __m256i l16 = grey_levels_avx2(v, black, range, shift, k);
+        __m128i l = _mm_packus_epi16(_mm256_castsi256_si128(l16), _mm256_extracti128_si256(l16, 1));
+        uint8_t* o = d + 3 * x;
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(o),      _mm_shuffle_epi8(l, m0));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(o + 16), _mm_shuffle_epi8(l, m1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(o + 32), _mm_shuffle_epi8(l, m2));
+    }
+    _mm256_zeroupper();   // before the SSE tail, see kernel_dispatch.h
+    grey_row_sse41(s, d, x, width, g);
+}
+
+template <YuvMatrix M, YuvRange R>
+TARGET_AVX2 static void p010_row_avx2(const uint8_t* ys, const uint8_t* uvs, uint8_t* d,
+                                      int x, int width) {
+    constexpr YuvCoeffs c = yuv_coeffs(M, R);
+    const __m256i yoff  = _mm256_set1_epi16(4 * c.yoff);
+    const __m256i c512  = _mm256_set1_epi16(512);
+    const __m256i cy    = _mm256_set1_epi16(c.cy);
+    const __m256i kr    = _mm256_set1_epi32(coeff_pair(0, c.crv));
+    const __m256i kg    = _mm256_set1_epi32(coeff_pair(-c.cgu, -c.cgv));
+    const __m256i kb    = _mm256_set1_epi32(coeff_pair(c.cbu, 0));
+    const __m256i round = _mm256_set1_epi32(P010_ROUND);
+    const __m256i m_rg0 = _mm256_broadcastsi128_si256(shuffle_rg0());
+    const __m256i m_b0  = _mm256_broadcastsi128_si256(shuffle_b0());
+    const __m256i m_rg1 = _mm256_broadcastsi128_si256(shuffle_rg1());
+    const __m256i m_b1  = _mm256_broadcastsi128_si256(shuffle_b1());
+
+    for (; x + 16 <= width; x += 16) {
+        __m256i y  = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ys + 2 * x));
+        __m256i uv = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(uvs + 2 * x));
+        y  = _mm256_sub_epi16(_mm256_srli_epi16(y, 6), yoff);
+        uv = _mm256_sub_epi16(_mm256_srli_epi16(uv, 6), c512);
+        __m256i ml   = _mm256_mullo_epi16(y, cy);
+        __m256i mh   = _mm256_mulhi_epi16(y, cy);
+        __m256i y_lo = _mm256_unpacklo_epi16(ml, mh);
+        __m256i y_hi = _mm256_unpackhi_epi16(ml, mh);
+
+        __m256i r = channel_avx2<10>(uv, kr, round, y_lo, y_hi);
+        __m256i g = channel_avx2<10>(uv, kg, round, y_lo, y_hi);
+        __m256i b = channel_avx2<10>(uv, kb, round, y_lo, y_hi);
+
+        __m256i rg = _mm256_packus_epi16(r, g);
+        __m256i bb = _mm256_packus_epi16(b, b);
+        __m256i out0 = _mm256_or_si256(_mm256_shuffle_epi8(rg, m_rg0), _mm256_shuffle_epi8(bb, m_b0));
+        __m256i out1 = _mm256_or_si256(_mm256_shuffle_epi8(rg, m_rg1), _mm256_shuffle_epi8(bb, m_b1));
+        uint8_t* o = d + 3 * x;
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(o),      _mm256_castsi256_si128(out0));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(o + 16), _mm256_castsi256_si128(out1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(o + 24), _mm256_extracti128_si256(out0, 1));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(o + 40), _mm256_extracti128_si256(out1, 1));
+    }
+    _mm256_zeroupper();   // before the SSE tail, see kernel_dispatch.h
+    p010_row_sse41<M, R>(ys, uvs, d, x, width);
+}
+
+#endif // YUV16_X86
+
+//
+// === Dispatch ===
+//
+
+using GreyRowFn = void (*)(const uint8_t*, uint8_t*, int, int, const GreyScale&);
+using P010RowFn = void (*)(const uint8_t*, const uint8_t*, uint8_t*, int, int);
+
+// One instantiation per [matrix][range].
+#define P010_ROWS(fn)                                                         \
+    {{fn<YuvMatrix::Bt601, YuvRange::Limited>, fn<YuvMatrix::Bt601, YuvRange::Full>}, \
+     {fn<YuvMatrix::Bt709, YuvRange::Limited>, fn<YuvMatrix::Bt709, YuvRange::Full>}}
+
+struct Yuv16Kernel {
+    const char* name;
+    GreyRowFn   grey_row;
+    P010RowFn   p010_rows[2][2];
+    bool        supported;
+    int         block;      // a width both loops cover without a tail
+};
+
+static Yuv16Kernel pick_kernel() {
+#ifdef YUV16_X86
+    __builtin_cpu_init();
+    const Yuv16Kernel kernels[] = {
+        {"avx2",   grey_row_avx2,   P010_ROWS(p010_row_avx2),   bool(__builtin_cpu_supports("avx2")), 16},
+        {"sse4.1", grey_row_sse41,  P010_ROWS(p010_row_sse41),  bool(__builtin_cpu_supports("sse4.1")), 16},
+        {"scalar", grey_row_scalar, P010_ROWS(p010_row_scalar), true, 2},
+    };
+#else
+    const Yuv16Kernel kernels[] = {
+        {"scalar", grey_row_scalar, P010_ROWS(p010_row_scalar), true, 2},
+    };
+#endif
+    return select_kernel(kernels, "YUV16_ISA");
+}
+
+static const Yuv16Kernel& kernel() {
+    static const Yuv16Kernel k = pick_kernel();
+    return k;
+}
+
+const char* yuv16_isa() {
+    return kernel().name;
+}
+
+//
+// === Frame entry points ===
+//
+
+// Rows are independent; any stripe of 16 or more is worth a wake-up.
+constexpr int STRIPE_ROWS = 16;
+
+void grey16_to_rgb24(const uint8_t* src, size_t src_stride, uint8_t* dst, size_t dst_stride,
+                     int width, int height, GreyWindow win, WorkerPool& pool) {
+    if (win.gamma == 1.0f) {
+        const GreyScale g   = grey_scale(win, 255);
+        const GreyRowFn row = kernel().grey_row;
+        in_stripes(height, STRIPE_ROWS, pool, [&](int y0, int y1) {
+            for (int y = y0; y < y1; ++y)
+                row(src + size_t(y) * src_stride, dst + size_t(y) * dst_stride, 0, width, g);
+        });
+        return;
+    }
+    const GreyScale g     = grey_scale(win, 4095);
+    const uint8_t*  curve = gamma_curve(win.gamma);
+    in_stripes(height, STRIPE_ROWS, pool, [&](int y0, int y1) {
+        for (int y = y0; y < y1; ++y)
+            grey_row_curve(src + size_t(y) * src_stride, dst + size_t(y) * dst_stride, width, g,
+                           curve);
+    });
+}
+
+void p010_to_rgb24(const uint8_t* y, size_t y_stride, const uint8_t* uv, size_t uv_stride,
+                   uint8_t* dst, size_t dst_stride, int width, int height, YuvColorimetry cm,
+                   WorkerPool& pool) {
+    const P010RowFn row = kernel().p010_rows[int(cm.matrix)][int(cm.range)];
+    in_stripes(height, STRIPE_ROWS, pool, [&](int y0, int y1) {
+        for (int r = y0; r < y1; ++r)
+            row(y + size_t(r) * y_stride, uv + size_t(r / 2) * uv_stride,
+                dst + size_t(r) * dst_stride, 0, width);
+    });
+}
+
+GreyWindow grey16_auto_window(const FrameView& src, float gamma, double clip) {
+    Yuv16Format fmt;
+    yuv16_format(src.pixelformat, fmt);
+    return grey16_auto_window(src.plane[0], src.stride[0], src.width, src.height, fmt.bits,
+                              gamma, clip);
+}
+
+// As for YUYV: padded rows on both sides let the kernels run whole blocks
+// to the end of every row, the extra pixels landing in the padding.
+static int padded_width(const FrameView& src, size_t dst_stride) {
+    const int block  = kernel().block;
+    const int padded = (src.width + block - 1) / block * block;
+    for (unsigned p = 0; p < src.num_planes; ++p)
+        if (src.stride[p] < size_t(padded) * 2) return src.width;
+    return dst_stride >= size_t(padded) * 3 ? padded : src.width;
+}
+
+void grey16_to_rgb24(const FrameView& src, uint8_t* dst, size_t dst_stride, GreyWindow win,
+                     WorkerPool& pool) {
+    grey16_to_rgb24(src.plane[0], src.stride[0], dst, dst_stride, padded_width(src, dst_stride),
+                    src.height, win, pool);
+}
+
+void p010_to_rgb24(const FrameView& src, uint8_t* dst, size_t dst_stride, YuvColorimetry cm,
+                   WorkerPool& pool) {
+    p010_to_rgb24(src.plane[0], src.stride[0], src.plane[1], src.stride[1], dst, dst_stride,
+                  padded_width(src, dst_stride), src.height, cm, pool);
+}
@@ -0,0 +1,106 @@
+// yuv16_convert.h
+//
+// Formats with more than 8 bits per sample, to RGB24 for display:
+//   - Y10, Y12, Y14, Y16: greyscale (thermal and scientific cameras), one
+//     sample per 16-bit little-endian word, LSB-aligned. A display window
+//     maps [black, white] onto 0..255, optionally through a gamma curve;
+//     grey16_auto_window() picks the window from the frame's histogram
+//     (automatic gain control).
+//   - P010: 10-bit 4:2:0, a Y plane followed by an interleaved CbCr plane
+//     at half height, each sample MSB-aligned in a 16-bit word. Converted
+//     with the same matrices as yuv_convert.h at 10-bit precision, rounding
+//     once at the end; chroma is taken from the nearest row.
+//
+// Both stay in 16-bit SIMD lanes the way the 8-bit kernels do, so a pixel
+// costs about what a YUYV one does although it is twice the bytes. The
+// frame entry points pick the widest kernel the CPU supports (AVX2,
+// SSE4.1, scalar); every kernel produces the same bytes as the scalar
+// one. Set YUV16_ISA=scalar|sse4.1|avx2 in the environment to force one.
+#pragma once
+
+#include "yuv_convert.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class WorkerPool;
+
+struct Yuv16Format {
+    int  bits   = 16;     // significant bits per sample
+    bool msb    = false;  // samples in the top `bits` of each word (P010)
+    bool chroma = false;  // a CbCr plane follows the Y plane (P010)
+};
+
+// Layout of Y10/Y12/Y14/Y16 and P010; false for anything else.
+bool yuv16_format(uint32_t pixelformat, Yuv16Format& fmt);
+inline bool is_yuv16(uint32_t pixelformat) {
+    Yuv16Format f;
+    return yuv16_format(pixelformat, f);
+}
+
+// Fourcc for "y10", "y12", "y14", "y16" or "p010"; 0 if unknown.
+uint32_t yuv16_pixelformat(const char* name);
+// Every fourcc yuv16_format() accepts, e.g. for CaptureConfig::formats.
+std::vector<uint32_t> yuv16_pixelformats();
+
+// Greyscale display window, in sample units: `black` and below show as 0,
+// `white` and above as 255. A gamma other than 1 bends the ramp in
+// between (output = input^(1/gamma), so > 1 lifts the shadows).
+struct GreyWindow {
+    uint16_t black = 0;
+    uint16_t white = 0xffff;
+    float    gamma = 1.0f;
+};
+
+// "auto", "auto:GAMMA", "BLACK:WHITE" or "BLACK:WHITE:GAMMA"; false if
+// malformed. `automatic` tells whether black and white are to come from
+// grey16_auto_window().
+bool parse_grey_window(const char* s, GreyWindow& win, bool& automatic);
+
+// Window spanning the frame's samples minus the darkest and brightest
+// `clip` fraction, from a histogram of every 4th sample of every 4th row.
+GreyWindow grey16_auto_window(const uint8_t* src, size_t src_stride, int width, int height,
+                              int bits, float gamma = 1.0f, double clip = 0.005);
+
+// Same, for a view of a greyscale format.
+GreyWindow grey16_auto_window(const FrameView& src, float gamma = 1.0f, double clip = 0.005);
+
+// Move `cur` a quarter of the way towards `target`, so an automatic
+// window follows the scene without flickering from frame to frame.
+inline GreyWindow grey_window_follow(GreyWindow cur, GreyWindow target) {
+    auto step = [](uint16_t c, uint16_t t) {
+        const int d = (int(t) - int(c)) / 4;
+        return uint16_t(d ? c + d : t);
+    };
+    cur.black = step(cur.black, target.black);
+    cur.white = step(cur.white, target.white);
+    cur.gamma = target.gamma;
+    return cur;
+}
+
+// Window `width` x `height` greyscale samples into RGB24 (R = G = B), in
+// row stripes on `pool`. Strides are in bytes. A gamma of 1 is the
+// vectorised path; any other goes through a 4096-entry curve table.
+void grey16_to_rgb24(const uint8_t* src, size_t src_stride, uint8_t* dst, size_t dst_stride,
+                     int width, int height, GreyWindow win, WorkerPool& pool);
+
+// Same, for a greyscale view; `dst` holds `height` rows of `dst_stride`
+// bytes, which lets padded rows skip the kernels' tail (see yuv_convert.h).
+void grey16_to_rgb24(const FrameView& src, uint8_t* dst, size_t dst_stride, GreyWindow win,
+                     WorkerPool& pool);
+
+// Convert `width` (even) x `height` P010 pixels into RGB24, in row stripes
+// on `pool`. For a single-plane P010 buffer `uv` is `y` + y_stride *
+// height and both strides are bytesperline.
+void p010_to_rgb24(const uint8_t* y, size_t y_stride, const uint8_t* uv, size_t uv_stride,
+                   uint8_t* dst, size_t dst_stride, int width, int height, YuvColorimetry cm,
+                   WorkerPool& pool);
+
+// Same, for a P010 view (Frame::view() splits off the CbCr plane), with
+// `dst` as for grey16_to_rgb24().
+void p010_to_rgb24(const FrameView& src, uint8_t* dst, size_t dst_stride, YuvColorimetry cm,
+                   WorkerPool& pool);
+
+// Name of the kernel in use: "avx2", "sse4.1" or "scalar".
+const char* yuv16_isa();
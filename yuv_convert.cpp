@@ -0,0 +1,340 @@
+// yuv_convert.cpp
+#include "yuv_convert.h"
+#include "kernel_dispatch.h"
+#include "worker_pool.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define YUV_X86 1
+// GCC 12's AVX-512 headers trip -W(maybe-)uninitialized on their own
+// _mm512_undefined_*() placeholders (GCC PR 105593).
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#include <immintrin.h>
+#pragma GCC diagnostic pop
+#define TARGET_SSE41  __attribute__((target("sse4.1")))
+#define TARGET_AVX2   __attribute__((target("avx2")))
+#define TARGET_AVX512 __attribute__((target("avx512f,avx512bw")))
+#include "yuv_simd.h"
+#endif
+
+static inline uint8_t clamp8(int v) {
+    return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+// Every kernel is instantiated per (matrix, range), so the coefficients
+// are compile-time constants folded into the code.
+template <YuvMatrix M, YuvRange R>
+static void row_scalar(const uint8_t* s, uint8_t* d, int width) {
+    constexpr YuvCoeffs c = yuv_coeffs(M, R);
+    for (int x = 0; x < width; x += 2, s += 4, d += 6) {
+        int y0 = c.cy * (s[0] - c.yoff), u = s[1] - 128;
+        int y1 = c.cy * (s[2] - c.yoff), v = s[3] - 128;
+        int r = c.crv * v + c.round;
+        int g = -c.cgu * u - c.cgv * v + c.round;
+        int b = c.cbu * u + c.round;
+        d[0] = clamp8((y0 + r) >> 8);
+        d[1] = clamp8((y0 + g) >> 8);
+        d[2] = clamp8((y0 + b) >> 8);
+        d[3] = clamp8((y1 + r) >> 8);
+        d[4] = clamp8((y1 + g) >> 8);
+        d[5] = clamp8((y1 + b) >> 8);
+    }
+}
+
+#ifdef YUV_X86
+
+// The SIMD kernels mirror row_scalar() exactly, 8 pixels per 128-bit lane:
+//  - Y and UV are split into 16-bit lanes; cy*Y' is widened to 32 bits
+//    with mullo/mulhi, so nothing can overflow.
+//  - each chroma term is one pmaddwd of the (U', V') pair against a
+//    (U coeff, V coeff) pair, then duplicated to both pixels of the pair.
+//  - >> 8 is an arithmetic shift and the clamp is the saturating packs, as
+//    in the scalar code.
+//  - pshufb interleaves the R, G and B bytes into 24 bytes of RGB24.
+
+//
+// === SSE4.1: 8 pixels per iteration ===
+//
+
+template <YuvMatrix M, YuvRange R>
+TARGET_SSE41 static void row_sse41(const uint8_t* s, uint8_t* d, int width) {
+    constexpr YuvCoeffs c = yuv_coeffs(M, R);
+    const __m128i lo8   = _mm_set1_epi16(0x00ff);
+    const __m128i yoff  = _mm_set1_epi16(c.yoff);
+    const __m128i c128  = _mm_set1_epi16(128);
+    const __m128i cy    = _mm_set1_epi16(c.cy);
+    const __m128i kr    = _mm_set1_epi32(coeff_pair(0, c.crv));
+    const __m128i kg    = _mm_set1_epi32(coeff_pair(-c.cgu, -c.cgv));
+    const __m128i kb    = _mm_set1_epi32(coeff_pair(c.cbu, 0));
+    const __m128i round = _mm_set1_epi32(c.round);
+    const __m128i m_rg0 = shuffle_rg0(), m_b0 = shuffle_b0();
+    const __m128i m_rg1 = shuffle_rg1(), m_b1 = shuffle_b1();
+
+    int x = 0;
+    for (; x + 8 <= width; x += 8, s += 16, d += 24) {
+        __m128i in   = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s));
+        __m128i y    = _mm_sub_epi16(_mm_and_si128(in, lo8), yoff);
+        __m128i uv   = _mm_sub_epi16(_mm_srli_epi16(in, 8), c128);
+        __m128i ml   = _mm_mullo_epi16(y, cy);
+        __m128i mh   = _mm_mulhi_epi16(y, cy);
+        __m128i y_lo = _mm_unpacklo_epi16(ml, mh);
+        __m128i y_hi = _mm_unpackhi_epi16(ml, mh);
+
+        __m128i r = channel_sse41<8>(uv, kr, round, y_lo, y_hi);
+        __m128i g = channel_sse41<8>(uv, kg, round, y_lo, y_hi);
+        __m128i b = channel_sse41<8>(uv, kb, round, y_lo, y_hi);
+
+        __m128i rg = _mm_packus_epi16(r, g);
+        __m128i bb = _mm_packus_epi16(b, b);
+        __m128i out0 = _mm_or_si128(_mm_shuffle_epi8(rg, m_rg0), _mm_shuffle_epi8(bb, m_b0));
+        __m128i out1 = _mm_or_si128(_mm_shuffle_epi8(rg, m_rg1), _mm_shuffle_epi8(bb, m_b1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(d), out0);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(d + 16), out1);
+    }
+    row_scalar<M, R>(s, d, width - x);
+}
+
+//
+// === AVX2: 16 pixels per iteration, two independent 128-bit lanes ===
+//
+
+template <YuvMatrix M, YuvRange R>
+TARGET_AVX2 static void row_avx2(const uint8_t* s, uint8_t* d, int width) {
+    constexpr YuvCoeffs c = yuv_coeffs(M, R);
+    const __m256i lo8   = _mm256_set1_epi16(0x00ff);
+    const __m256i yoff  = _mm256_set1_epi16(c.yoff);
+    const __m256i c128  = _mm256_set1_epi16(128);
+    const __m256i cy    = _mm256_set1_epi16(c.cy);
+    const __m256i kr    = _mm256_set1_epi32(coeff_pair(0, c.crv));
+    const __m256i kg    = _mm256_set1_epi32(coeff_pair(-c.cgu, -c.cgv));
+    const __m256i kb    = _mm256_set1_epi32(coeff_pair(c.cbu, 0));
+    const __m256i round = _mm256_set1_epi32(c.round);
+    const __m256i m_rg0 = _mm256_broadcastsi128_si256(shuffle_rg0());
+    const __m256i m_b0  = _mm256_broadcastsi128_si256(shuffle_b0());
+    const __m256i m_rg1 = _mm256_broadcastsi128_si256(shuffle_rg1());
+    const __m256i m_b1  = _mm256_broadcastsi128_si256(shuffle_b1());
+
+    int x = 0;
+    for (; x + 16 <= width; x += 16, s += 32, d += 48) {
+        __m256i in   = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s));
+        __m256i y    = _mm256_sub_epi16(_mm256_and_si256(in, lo8), yoff);
+        __m256i uv   = _mm256_sub_epi16(_mm256_srli_epi16(in, 8), c128);
+        __m256i ml   = _mm256_mullo_epi16(y, cy);
+        __m256i mh   = _mm256_mulhi_epi16(y, cy);
+        __m256i y_lo = _mm256_unpacklo_epi16(ml, mh);
+        __m256i y_hi = _mm256_unpackhi_epi16(ml, mh);
+
+        __m256i r = channel_avx2<8>(uv, kr, round, y_lo, y_hi);
+        __m256i g = channel_avx2<8>(uv, kg, round, y_lo, y_hi);
+        __m256i b = channel_avx2<8>(uv, kb, round, y_lo, y_hi);
+
+        __m256i rg = _mm256_packus_epi16(r, g);
+        __m256i bb = _mm256_packus_epi16(b, b);
+        __m256i out0 = _mm256_or_si256(_mm256_shuffle_epi8(rg, m_rg0), _mm256_shuffle_epi8(bb, m_b0));
+        __m256i out1 = _mm256_or_si256(_mm256_shuffle_epi8(rg, m_rg1), _mm256_shuffle_epi8(bb, m_b1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(d),      _mm256_castsi256_si128(out0));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(d + 16), _mm256_castsi256_si128(out1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(d + 24), _mm256_extracti128_si256(out0, 1));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(d + 40), _mm256_extracti128_si256(out1, 1));
+    }
+    _mm256_zeroupper();   // before the SSE tail, see kernel_dispatch.h
+    row_sse41<M, R>(s, d, width - x);
+}
+
+//
+// === AVX-512BW: 32 pixels per iteration, four 128-bit lanes ===
+//
+
+TARGET_AVX512 static inline __m512i channel_avx512(__m512i uv, __m512i k, __m512i round,
+                                                   __m512i y_lo, __m512i y_hi) {
+    __m512i ch = _mm512_add_epi32(_mm512_madd_epi16(uv, k), round);
+    __m512i lo = _mm512_add_epi32(y_lo, _mm512_shuffle_epi32(ch, _MM_PERM_BBAA));
+    __m512i hi = _mm512_add_epi32(y_hi, _mm512_shuffle_epi32(ch, _MM_PERM_DDCC));
+    return _mm512_packs_epi32(_mm512_srai_epi32(lo, 8), _mm512_srai_epi32(hi, 8));
+}
+
+template <YuvMatrix M, YuvRange R>
+TARGET_AVX512 static void row_avx512(const uint8_t* s, uint8_t* d, int width) {
+    constexpr YuvCoeffs c = yuv_coeffs(M, R);
+    const __m512i lo8   = _mm512_set1_epi16(0x00ff);
+    const __m512i yoff  = _mm512_set1_epi16(c.yoff);
+    const __m512i c128  = _mm512_set1_epi16(128);
+    const __m512i cy    = _mm512_set1_epi16(c.cy);
+    const __m512i kr    = _mm512_set1_epi32(coeff_pair(0, c.crv));
+    const __m512i kg    = _mm512_set1_epi32(coeff_pair(-c.cgu, -c.cgv));
+    const __m512i kb    = _mm512_set1_epi32(coeff_pair(c.cbu, 0));
+    const __m512i round = _mm512_set1_epi32(c.round);
+    const __m512i m_rg0 = _mm512_broadcast_i32x4(shuffle_rg0());
+    const __m512i m_b0  = _mm512_broadcast_i32x4(shuffle_b0());
+    const __m512i m_rg1 = _mm512_broadcast_i32x4(shuffle_rg1());
+    const __m512i m_b1  = _mm512_broadcast_i32x4(shuffle_b1());
+
+    int x = 0;
+    for (; x + 32 <= width; x += 32, s += 64, d += 96) {
+        __m512i in   = _mm512_loadu_si512(s);
+        __m512i y    = _mm512_sub_epi16(_mm512_and_si512(in, lo8), yoff);
+        __m512i uv   = _mm512_sub_epi16(_mm512_srli_epi16(in, 8), c128);
+        __m512i ml   = _mm512_mullo_epi16(y, cy);
+        __m512i mh   = _mm512_mulhi_epi16(y, cy);
+        __m512i y_lo = _mm512_unpacklo_epi16(ml, mh);
+        __m512i y_hi = _mm512_unpackhi_epi16(ml, mh);
+
+        __m512i r = channel_avx512(uv, kr, round, y_lo, y_hi);
+        __m512i g = channel_avx512(uv, kg, round, y_lo, y_hi);
+        __m512i b = channel_avx512(uv, kb, round, y_lo, y_hi);
+
+        __m512i rg = _mm512_packus_epi16(r, g);
+        __m512i bb = _mm512_packus_epi16(b, b);
+        __m512i out0 = _mm512_or_si512(_mm512_shuffle_epi8(rg, m_rg0), _mm512_shuffle_epi8(bb, m_b0));
+        __m512i out1 = _mm512_or_si512(_mm512_shuffle_epi8(rg, m_rg1), _mm512_shuffle_epi8(bb, m_b1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(d),      _mm512_extracti32x4_epi32(out0, 0));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(d + 16), _mm512_extracti32x4_epi32(out1, 0));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(d + 24), _mm512_extracti32x4_epi32(out0, 1));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(d + 40), _mm512_extracti32x4_epi32(out1, 1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(d + 48), _mm512_extracti32x4_epi32(out0, 2));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(d + 64), _mm512_extracti32x4_epi32(out1, 2));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(d + 72), _mm512_extracti32x4_epi32(out0, 3));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(d + 88), _mm512_extracti32x4_epi32(out1, 3));
+    }
+    row_avx2<M, R>(s, d, width - x);
+}
+
+#endif // YUV_X86
+
+//
+// === Dispatch ===
+//
+
+using RowFn = void (*)(const uint8_t*, uint8_t*, int);
+
+// One instantiation per [matrix][range].
+#define YUV_ROWS(fn)                                                          \
+    {{fn<YuvMatrix::Bt601, YuvRange::Limited>, fn<YuvMatrix::Bt601, YuvRange::Full>}, \
+     {fn<YuvMatrix::Bt709, YuvRange::Limited>, fn<YuvMatrix::Bt709, YuvRange::Full>}}
+
+struct Kernel {
+    const char* name;
+    RowFn       rows[2][2];
+    bool        supported;
+    int         block;      // pixels per iteration of the widest loop
+};
+
+static Kernel pick_kernel() {
+#ifdef YUV_X86
+    __builtin_cpu_init();
+    const Kernel kernels[] = {
+        {"avx512", YUV_ROWS(row_avx512),
+         __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"), 32},
+        {"avx2",   YUV_ROWS(row_avx2),   bool(__builtin_cpu_supports("avx2")), 16},
+        {"sse4.1", YUV_ROWS(row_sse41),  bool(__builtin_cpu_supports("sse4.1")), 8},
+        {"scalar", YUV_ROWS(row_scalar), true, 2},
+    };
+#else
+    const Kernel kernels[] = {{"scalar", YUV_ROWS(row_scalar), true, 2}};
+#endif
+    return select_kernel(kernels, "YUV_CONVERT_ISA");
+}
+
+static const Kernel& kernel() {
+    static const Kernel k = pick_kernel();
+    return k;
+}
+
+static RowFn row_for(const Kernel& k, YuvColorimetry cm) {
+    return k.rows[int(cm.matrix)][int(cm.range)];
+}
+
+const char* yuv_convert_isa() {
+    return kernel().name;
+}
+
+YuvColorimetry yuv_colorimetry(uint32_t colorspace, uint32_t ycbcr_enc, uint32_t quantization) {
+    // Resolve the DEFAULT values the way the V4L2 spec defines them.
+    if (ycbcr_enc == V4L2_YCBCR_ENC_DEFAULT)
+        ycbcr_enc = V4L2_MAP_YCBCR_ENC_DEFAULT(colorspace);
+    if (quantization == V4L2_QUANTIZATION_DEFAULT)
+        quantization = V4L2_MAP_QUANTIZATION_DEFAULT(false, colorspace, ycbcr_enc);
+
+    YuvColorimetry cm;
+    switch (ycbcr_enc) {
+    case V4L2_YCBCR_ENC_709:
+    case V4L2_YCBCR_ENC_XV709:
+    case V4L2_YCBCR_ENC_SMPTE240M:   // within a code value of BT.709
+    case V4L2_YCBCR_ENC_BT2020:      // no wide-gamut output; 709 is closest
+    case V4L2_YCBCR_ENC_BT2020_CONST_LUM:
+        cm.matrix = YuvMatrix::Bt709;
+        break;
+    default:                         // 601, XV601
+        cm.matrix = YuvMatrix::Bt601;
+        break;
+    }
+    cm.range = quantization == V4L2_QUANTIZATION_FULL_RANGE ? YuvRange::Full : YuvRange::Limited;
+    return cm;
+}
+
+YuvColorimetry yuv_colorimetry(const v4l2_format& fmt) {
+    if (V4L2_TYPE_IS_MULTIPLANAR(fmt.type))
+        return yuv_colorimetry(fmt.fmt.pix_mp.colorspace, fmt.fmt.pix_mp.ycbcr_enc,
+                               fmt.fmt.pix_mp.quantization);
+    return yuv_colorimetry(fmt.fmt.pix.colorspace, fmt.fmt.pix.ycbcr_enc,
+                           fmt.fmt.pix.quantization);
+}
+
+void yuyv_to_rgb24(const uint8_t* src, size_t src_stride, uint8_t* dst, size_t dst_stride,
+                   int width, int height, YuvColorimetry cm) {
+    RowFn row = row_for(kernel(), cm);
+    for (int y = 0; y < height; ++y)
+        row(src + y * src_stride, dst + y * dst_stride, width);
+}
+
+// Rows per stripe: source plus destination of one stripe should take about
+// half of L2, leaving the rest for prefetch and the other hyperthread.
+static int stripe_rows(int width, int height, unsigned threads) {
+    static const long l2 = [] {
+        long size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+        return size > 0 ? size : 1L << 20;
+    }();
+    const long row_bytes = long(width) * (2 + 3);
+    int rows = int(std::max(4L, l2 / 2 / row_bytes));
+    // Still give every thread something to do on small frames.
+    return std::min(rows, std::max(1, int((height + threads - 1) / threads)));
+}
+
+void yuyv_to_rgb24(const uint8_t* src, size_t src_stride, uint8_t* dst, size_t dst_stride,
+                   int width, int height, YuvColorimetry cm, WorkerPool& pool) {
+    if (width <= 0 || height <= 0) return;
+    const int rows    = stripe_rows(width, height, pool.size());
+    const int stripes = (height + rows - 1) / rows;
+    pool.run(stripes, [&](unsigned i) {
+        const int y0 = int(i) * rows;
+        yuyv_to_rgb24(src + y0 * src_stride, src_stride, dst + y0 * dst_stride, dst_stride,
+                      width, std::min(rows, height - y0), cm);
+    });
+}
+
+// Padded rows are put to use: when both buffers have room past `width`,
+// convert up to a whole number of the widest kernel's blocks so every row
+// runs in that loop alone, with no narrower kernel for the tail. The extra
+// pixels only ever land in the destination's own padding.
+void yuyv_to_rgb24(const FrameView& src, uint8_t* dst, size_t dst_stride, YuvColorimetry cm,
+                   WorkerPool& pool) {
+    const int block  = kernel().block;
+    const int padded = (src.width + block - 1) / block * block;
+    const bool room  = src.stride[0] >= size_t(padded) * 2 && dst_stride >= size_t(padded) * 3;
+    yuyv_to_rgb24(src.plane[0], src.stride[0], dst, dst_stride, room ? padded : src.width,
+                  src.height, cm, pool);
+}
+
+void yuyv_to_rgb24_scalar(const uint8_t* src, size_t src_stride, uint8_t* dst,
+                          size_t dst_stride, int width, int height, YuvColorimetry cm) {
+    static const RowFn rows[2][2] = YUV_ROWS(row_scalar);
+    RowFn row = rows[int(cm.matrix)][int(cm.range)];
+    for (int y = 0; y < height; ++y)
+        row(src + y * src_stride, dst + y * dst_stride, width);
+}
@@ -0,0 +1,91 @@
+// yuv_convert.h
+//
+// Packed YUYV (YUY2) to RGB24 conversion. The frame entry point picks the
+// widest kernel the CPU supports (AVX-512BW, AVX2, SSE4.1, scalar) once,
+// via cpuid; every kernel produces exactly the same bytes as the scalar
+// reference.
+//
+// Each kernel is a template instantiated per colour matrix and range, so
+// the coefficients are immediates in the generated code; yuv_colorimetry()
+// picks the instantiation matching what the driver reports in v4l2_format.
+//
+// Set YUV_CONVERT_ISA=scalar|sse4.1|avx2|avx512 in the environment to force
+// a narrower kernel, e.g. to compare them.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <linux/videodev2.h>
+#include "frame_view.h"
+
+class WorkerPool;
+
+enum class YuvMatrix { Bt601, Bt709 };
+enum class YuvRange  { Limited, Full };   // Y 16..235 / 0..255
+
+struct YuvColorimetry {
+    YuvMatrix matrix = YuvMatrix::Bt601;
+    YuvRange  range  = YuvRange::Limited;
+};
+
+// Fixed-point matrix, 8 fractional bits:
+//   Y' = cy * (Y - yoff),  U' = U - 128,  V' = V - 128
+//   R = (Y' + crv*V'              + round) >> 8
+//   G = (Y' - cgu*U' - cgv*V'     + round) >> 8
+//   B = (Y' + cbu*U'              + round) >> 8
+// each clamped to 0..255.
+struct YuvCoeffs {
+    int16_t cy, yoff;
+    int16_t crv, cgu, cgv, cbu;
+    int32_t round;
+};
+
+constexpr int16_t yuv_fix8(double v) {
+    return int16_t(v * 256 + 0.5);
+}
+
+// Derived from the matrix's Kr/Kb; limited range stretches luma by
+// 255/219 and chroma by 255/224. BT.601 limited gives the classic
+// 298/409/100/208/516.
+constexpr YuvCoeffs yuv_coeffs(YuvMatrix m, YuvRange r) {
+    const double kr = m == YuvMatrix::Bt601 ? 0.299 : 0.2126;
+    const double kb = m == YuvMatrix::Bt601 ? 0.114 : 0.0722;
+    const double kg = 1 - kr - kb;
+    const double ys = r == YuvRange::Limited ? 255.0 / 219 : 1.0;
+    const double cs = r == YuvRange::Limited ? 255.0 / 224 : 1.0;
+    return {yuv_fix8(ys), int16_t(r == YuvRange::Limited ? 16 : 0),
+            yuv_fix8(2 * (1 - kr) * cs),
+            yuv_fix8(2 * kb * (1 - kb) / kg * cs),
+            yuv_fix8(2 * kr * (1 - kr) / kg * cs),
+            yuv_fix8(2 * (1 - kb) * cs),
+            128};
+}
+
+// Matrix and range for a negotiated format, resolving V4L2's *_DEFAULT
+// values. BT.2020 and SMPTE 240M map to BT.709, the closest supported.
+YuvColorimetry yuv_colorimetry(uint32_t colorspace, uint32_t ycbcr_enc, uint32_t quantization);
+YuvColorimetry yuv_colorimetry(const v4l2_format& fmt);
+
+// Convert `width` x `height` pixels; strides are in bytes, width must be
+// even.
+void yuyv_to_rgb24(const uint8_t* src, size_t src_stride, uint8_t* dst, size_t dst_stride,
+                   int width, int height, YuvColorimetry cm);
+
+// Same, split into row stripes that run in parallel on `pool`. Stripes are
+// sized so the rows one thread is working on stay in its L2 cache.
+void yuyv_to_rgb24(const uint8_t* src, size_t src_stride, uint8_t* dst, size_t dst_stride,
+                   int width, int height, YuvColorimetry cm, WorkerPool& pool);
+
+// Same, for a YUYV view. `dst` holds `height` rows of `dst_stride` bytes;
+// with rows padded to 64 bytes (CaptureConfig::stride_align) on both sides
+// no row needs a scalar tail.
+void yuyv_to_rgb24(const FrameView& src, uint8_t* dst, size_t dst_stride, YuvColorimetry cm,
+                   WorkerPool& pool);
+
+// Reference implementation the SIMD kernels are checked against.
+void yuyv_to_rgb24_scalar(const uint8_t* src, size_t src_stride, uint8_t* dst,
+                          size_t dst_stride, int width, int height, YuvColorimetry cm);
+
+// Name of the kernel yuyv_to_rgb24() uses: "avx512", "avx2", "sse4.1" or
+// "scalar".
+const char* yuv_convert_isa();
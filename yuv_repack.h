@@ -0,0 +1,413 @@
+/*
+ *  yuv_repack.h
+ *
+ *  Packed 4:2:2 (YUYV or UYVY) to planar 4:2:0 (NV12 or I420), the input
+ *  most software encoders want. Each pass reads two source rows and writes
+ *  two luma rows plus one chroma row, the chroma being the rounded average
+ *  of both rows (pavgb), so the frame is touched once.
+ *
+ *  Output goes into frames from a planar_pool: a fixed set of buffers with
+ *  64-byte aligned planes and strides, allocated once per stream. A pool is
+ *  not thread-safe; one thread gets and puts its frames.
+ *
+ *  yuv_repack() picks the widest kernel the CPU supports (AVX2, SSE2,
+ *  scalar) once, via cpuid; all of them produce the same bytes. Set
+ *  YUV_REPACK_ISA=scalar|sse2|avx2 in the environment to force one.
+ *  Header-only so the C tools and the C++ capture library share one
+ *  implementation.
+ */
+#ifndef YUV_REPACK_H
+#define YUV_REPACK_H
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <linux/videodev2.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define YUV_REPACK_X86 1
+#include <immintrin.h>
+#define YUV_REPACK_SSE2 __attribute__((target("sse2")))
+#define YUV_REPACK_AVX2 __attribute__((target("avx2")))
+#endif
+
+#define PLANAR_POOL_MAX 8
+#define PLANAR_ALIGN    64
+
+struct planar_frame {
+        __u32           fourcc;         /* V4L2_PIX_FMT_NV12 or _YUV420 */
+        int             width;
+        int             height;
+        unsigned int    num_planes;     /* 2 for NV12, 3 for I420 */
+        uint8_t        *plane[3];
+        size_t          stride[3];
+        size_t          size;           /* of the whole allocation */
+        int             in_use;
+        void           *mem;
+};
+
+struct planar_pool {
+        struct planar_frame frames[PLANAR_POOL_MAX];
+        unsigned int    count;
+};
+
+static inline size_t planar_align(size_t n)
+{
+        return (n + PLANAR_ALIGN - 1) & ~(size_t)(PLANAR_ALIGN - 1);
+}
+
+static inline void planar_pool_destroy(struct planar_pool *pool)
+{
+        unsigned int i;
+
+        for (i = 0; i < pool->count; ++i)
+                free(pool->frames[i].mem);
+        memset(pool, 0, sizeof(*pool));
+}
+
+/* `count` frames (at most PLANAR_POOL_MAX) of `width` x `height`; the
+ * width must be even. Returns 0, or -1 with errno set. */
+static inline int planar_pool_init(struct planar_pool *pool, __u32 fourcc,
+                                   int width, int height, unsigned int count)
+{
+        size_t chroma_rows = (height + 1) / 2;
+        size_t offset[3], stride[3];
+        unsigned int i, num_planes;
+
+        memset(pool, 0, sizeof(*pool));
+        if (width <= 0 || height <= 0 || (width & 1) ||
+            count == 0 || count > PLANAR_POOL_MAX) {
+                errno = EINVAL;
+                return -1;
+        }
+
+        stride[0] = planar_align(width);
+        offset[0] = 0;
+        offset[1] = stride[0] * height;
+        switch (fourcc) {
+        case V4L2_PIX_FMT_NV12:
+                num_planes = 2;
+                stride[1] = stride[0];
+                stride[2] = 0;
+                offset[2] = offset[1] + stride[1] * chroma_rows;
+                break;
+        case V4L2_PIX_FMT_YUV420:
+                num_planes = 3;
+                stride[1] = stride[2] = planar_align(width / 2);
+                offset[2] = offset[1] + stride[1] * chroma_rows;
+                break;
+        default:
+                errno = EINVAL;
+                return -1;
+        }
+
+        for (i = 0; i < count; ++i) {
+                struct planar_frame *f = &pool->frames[i];
+                unsigned int p;
+                int r;
+
+                f->size = offset[num_planes - 1] + stride[num_planes - 1] * chroma_rows;
+                r = posix_memalign(&f->mem, PLANAR_ALIGN, f->size);
+                if (r) {
+                        planar_pool_destroy(pool);
+                        errno = r;
+                        return -1;
+                }
+                pool->count++;
+                f->fourcc = fourcc;
+                f->width = width;
+                f->height = height;
+                f->num_planes = num_planes;
+                for (p = 0; p < num_planes; ++p) {
+                        f->plane[p] = (uint8_t *)f->mem + offset[p];
+                        f->stride[p] = stride[p];
+                }
+        }
+        return 0;
+}
+
+/* A free frame, or NULL while all of them are in use. */
+static inline struct planar_frame *planar_pool_get(struct planar_pool *pool)
+{
+        unsigned int i;
+
+        for (i = 0; i < pool->count; ++i)
+                if (!pool->frames[i].in_use) {
+                        pool->frames[i].in_use = 1;
+                        return &pool->frames[i];
+                }
+        return NULL;
+}
+
+static inline void planar_pool_put(struct planar_pool *pool,
+                                   struct planar_frame *f)
+{
+        (void)pool;
+        f->in_use = 0;
+}
+
+/*
+ * Row-pair kernels: s0/s1 are two packed source rows, y0/y1 the matching
+ * luma rows. For the last row of an odd-height frame s1 == s0 and
+ * y1 == y0. `uyvy` selects UYVY (luma in the odd bytes) over YUYV.
+ * Packed 4:2:2 stores chroma as U V U V..., which is already the NV12 order.
+ */
+typedef void (*repack_nv12_fn)(const uint8_t *s0, const uint8_t *s1,
+                               uint8_t *y0, uint8_t *y1, uint8_t *uv,
+                               int width, int uyvy);
+typedef void (*repack_i420_fn)(const uint8_t *s0, const uint8_t *s1,
+                               uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v,
+                               int width, int uyvy);
+
+static inline void repack_nv12_scalar(const uint8_t *s0, const uint8_t *s1,
+                                      uint8_t *y0, uint8_t *y1, uint8_t *uv,
+                                      int width, int uyvy)
+{
+        int l = uyvy, c = !uyvy;
+        int x;
+
+        for (x = 0; x < width; x += 2) {
+                const uint8_t *a = s0 + 2 * x, *b = s1 + 2 * x;
+
+                y0[x]     = a[l];
+                y0[x + 1] = a[l + 2];
+                y1[x]     = b[l];
+                y1[x + 1] = b[l + 2];
+                uv[x]     = (a[c] + b[c] + 1) >> 1;
+                uv[x + 1] = (a[c + 2] + b[c + 2] + 1) >> 1;
+        }
+}
+
+static inline void repack_i420_scalar(const uint8_t *s0, const uint8_t *s1,
+                                      uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v,
+                                      int width, int uyvy)
+{
+        int l = uyvy, c = !uyvy;
+        int x;
+
+        for (x = 0; x < width; x += 2) {
+                const uint8_t *a = s0 + 2 * x, *b = s1 + 2 * x;
+
+                y0[x]     = a[l];
+                y0[x + 1] = a[l + 2];
+                y1[x]     = b[l];
+                y1[x + 1] = b[l + 2];
+                u[x / 2]  = (a[c] + b[c] + 1) >> 1;
+                v[x / 2]  = (a[c + 2] + b[c + 2] + 1) >> 1;
+        }
+}
+
+#ifdef YUV_REPACK_X86
+/*
+ * SSE2, 16 pixels per iteration: masking and shifting each 16-bit lane
+ * splits the even bytes from the odd ones, packus narrows them back to 16
+ * luma and 16 interleaved chroma bytes, and pavgb averages the two rows'
+ * chroma. I420 splits the chroma once more the same way.
+ */
+static inline YUV_REPACK_SSE2 void repack_split_sse2(const uint8_t *s, int uyvy,
+                                                     __m128i *luma, __m128i *chroma)
+{
+        const __m128i even = _mm_set1_epi16(0x00ff);
+        __m128i p0 = _mm_loadu_si128((const __m128i *)s);
+        __m128i p1 = _mm_loadu_si128((const __m128i *)(s + 16));
+        __m128i lo = _mm_packus_epi16(_mm_and_si128(p0, even), _mm_and_si128(p1, even));
+        __m128i hi = _mm_packus_epi16(_mm_srli_epi16(p0, 8), _mm_srli_epi16(p1, 8));
+
+        *luma   = uyvy ? hi : lo;
+        *chroma = uyvy ? lo : hi;
+}
+
+static YUV_REPACK_SSE2 void repack_nv12_sse2(const uint8_t *s0, const uint8_t *s1,
+                                             uint8_t *y0, uint8_t *y1, uint8_t *uv,
+                                             int width, int uyvy)
+{
+        __m128i la, ca, lb, cb;
+        int x;
+
+        for (x = 0; x + 16 <= width; x += 16) {
+                repack_split_sse2(s0 + 2 * x, uyvy, &la, &ca);
+                repack_split_sse2(s1 + 2 * x, uyvy, &lb, &cb);
+                _mm_storeu_si128((__m128i *)(y0 + x), la);
+                _mm_storeu_si128((__m128i *)(y1 + x), lb);
+                _mm_storeu_si128((__m128i *)(uv + x), _mm_avg_epu8(ca, cb));
+        }
+        repack_nv12_scalar(s0 + 2 * x, s1 + 2 * x, y0 + x, y1 + x, uv + x,
+                           width - x, uyvy);
+}
+
+static YUV_REPACK_SSE2 void repack_i420_sse2(const uint8_t *s0, const uint8_t *s1,
+                                             uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v,
+                                             int width, int uyvy)
+{
+        const __m128i even = _mm_set1_epi16(0x00ff);
+        const __m128i zero = _mm_setzero_si128();
+        __m128i la, ca, lb, cb, c;
+        int x;
+
+        for (x = 0; x + 16 <= width; x += 16) {
+                repack_split_sse2(s0 + 2 * x, uyvy, &la, &ca);
+                repack_split_sse2(s1 + 2 * x, uyvy, &lb, &cb);
+                _mm_storeu_si128((__m128i *)(y0 + x), la);
+                _mm_storeu_si128((__m128i *)(y1 + x), lb);
+                c = _mm_avg_epu8(ca, cb);
+                _mm_storel_epi64((__m128i *)(u + x / 2),
+                                 _mm_packus_epi16(_mm_and_si128(c, even), zero));
+                _mm_storel_epi64((__m128i *)(v + x / 2),
+                                 _mm_packus_epi16(_mm_srli_epi16(c, 8), zero));
+        }
+        repack_i420_scalar(s0 + 2 * x, s1 + 2 * x, y0 + x, y1 + x, u + x / 2, v + x / 2,
+                           width - x, uyvy);
+}
+
+/*
+ * AVX2, 32 pixels per iteration: the same steps, but packus works within
+ * each 128-bit lane, so its result has the two sources' quadwords
+ * interleaved; permute4x64 puts them back in order.
+ */
+static inline YUV_REPACK_AVX2 void repack_split_avx2(const uint8_t *s, int uyvy,
+                                                     __m256i *luma, __m256i *chroma)
+{
+        const __m256i even = _mm256_set1_epi16(0x00ff);
+        __m256i p0 = _mm256_loadu_si256((const __m256i *)s);
+        __m256i p1 = _mm256_loadu_si256((const __m256i *)(s + 32));
+        __m256i lo = _mm256_packus_epi16(_mm256_and_si256(p0, even), _mm256_and_si256(p1, even));
+        __m256i hi = _mm256_packus_epi16(_mm256_srli_epi16(p0, 8), _mm256_srli_epi16(p1, 8));
+
+        lo = _mm256_permute4x64_epi64(lo, 0xd8);
+        hi = _mm256_permute4x64_epi64(hi, 0xd8);
+        *luma   = uyvy ? hi : lo;
+        *chroma = uyvy ? lo : hi;
+}
+
+static YUV_REPACK_AVX2 void repack_nv12_avx2(const uint8_t *s0, const uint8_t *s1,
+                                             uint8_t *y0, uint8_t *y1, uint8_t *uv,
+                                             int width, int uyvy)
+{
+        __m256i la, ca, lb, cb;
+        int x;
+
+        for (x = 0; x + 32 <= width; x += 32) {
+                repack_split_avx2(s0 + 2 * x, uyvy, &la, &ca);
+                repack_split_avx2(s1 + 2 * x, uyvy, &lb, &cb);
+                _mm256_storeu_si256((__m256i *)(y0 + x), la);
+                _mm256_storeu_si256((__m256i *)(y1 + x), lb);
+                _mm256_storeu_si256((__m256i *)(uv + x), _mm256_avg_epu8(ca, cb));
+        }
+        repack_nv12_scalar(s0 + 2 * x, s1 + 2 * x, y0 + x, y1 + x, uv + x,
+                           width - x, uyvy);
+}
+
+static YUV_REPACK_AVX2 void repack_i420_avx2(const uint8_t *s0, const uint8_t *s1,
+                                             uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v,
+                                             int width, int uyvy)
+{
+        const __m256i even = _mm256_set1_epi16(0x00ff);
+        const __m256i zero = _mm256_setzero_si256();
+        __m256i la, ca, lb, cb, c, pu, pv;
+        int x;
+
+        for (x = 0; x + 32 <= width; x += 32) {
+                repack_split_avx2(s0 + 2 * x, uyvy, &la, &ca);
+                repack_split_avx2(s1 + 2 * x, uyvy, &lb, &cb);
+                _mm256_storeu_si256((__m256i *)(y0 + x), la);
+                _mm256_storeu_si256((__m256i *)(y1 + x), lb);
+                c = _mm256_avg_epu8(ca, cb);
+                pu = _mm256_packus_epi16(_mm256_and_si256(c, even), zero);
+                pv = _mm256_packus_epi16(_mm256_srli_epi16(c, 8), zero);
+                _mm_storeu_si128((__m128i *)(u + x / 2),
+                                 _mm256_castsi256_si128(_mm256_permute4x64_epi64(pu, 0xd8)));
+                _mm_storeu_si128((__m128i *)(v + x / 2),
+                                 _mm256_castsi256_si128(_mm256_permute4x64_epi64(pv, 0xd8)));
+        }
+        repack_i420_scalar(s0 + 2 * x, s1 + 2 * x, y0 + x, y1 + x, u + x / 2, v + x / 2,
+                           width - x, uyvy);
+}
+#endif /* YUV_REPACK_X86 */
+
+struct repack_kernel {
+        const char     *name;
+        repack_nv12_fn  nv12;
+        repack_i420_fn  i420;
+};
+
+static inline const struct repack_kernel *repack_kernel(void)
+{
+        static const struct repack_kernel kernels[] = {
+#ifdef YUV_REPACK_X86
+                { "avx2",   repack_nv12_avx2,   repack_i420_avx2 },
+                { "sse2",   repack_nv12_sse2,   repack_i420_sse2 },
+#endif
+                { "scalar", repack_nv12_scalar, repack_i420_scalar },
+        };
+        static const struct repack_kernel *picked;
+        const char *force;
+        unsigned int i, n = sizeof(kernels) / sizeof(kernels[0]);
+
+        if (picked)
+                return picked;
+
+        force = getenv("YUV_REPACK_ISA");
+#ifdef YUV_REPACK_X86
+        __builtin_cpu_init();
+#endif
+        picked = &kernels[n - 1];
+        for (i = 0; i < n; ++i) {
+                int supported = 1;
+
+#ifdef YUV_REPACK_X86
+                if (!strcmp(kernels[i].name, "avx2"))
+                        supported = __builtin_cpu_supports("avx2");
+                else if (!strcmp(kernels[i].name, "sse2"))
+                        supported = __builtin_cpu_supports("sse2");
+#endif
+                if (supported && (!force || !strcmp(force, kernels[i].name))) {
+                        picked = &kernels[i];
+                        break;
+                }
+        }
+        return picked;
+}
+
+/* Name of the kernel yuv_repack() uses: "avx2", "sse2" or "scalar". */
+static inline const char *yuv_repack_isa(void)
+{
+        return repack_kernel()->name;
+}
+
+/* Repack one YUYV or UYVY frame of dst->width x dst->height, rows
+ * `src_stride` bytes apart, into `dst`. Returns -1 for other formats. */
+static inline int yuv_repack(const uint8_t *src, size_t src_stride, __u32 src_fourcc,
+                             struct planar_frame *dst)
+{
+        const struct repack_kernel *k = repack_kernel();
+        int uyvy, y;
+
+        if (src_fourcc == V4L2_PIX_FMT_YUYV)
+                uyvy = 0;
+        else if (src_fourcc == V4L2_PIX_FMT_UYVY)
+                uyvy = 1;
+        else
+                return -1;
+
+        for (y = 0; y < dst->height; y += 2) {
+                /* An odd last row pairs with itself. */
+                int y1 = y + 1 < dst->height ? y + 1 : y;
+                const uint8_t *s0 = src + y * src_stride;
+                const uint8_t *s1 = src + y1 * src_stride;
+                uint8_t *l0 = dst->plane[0] + y * dst->stride[0];
+                uint8_t *l1 = dst->plane[0] + y1 * dst->stride[0];
+                size_t cr = y / 2;
+
+                if (dst->fourcc == V4L2_PIX_FMT_NV12)
+                        k->nv12(s0, s1, l0, l1, dst->plane[1] + cr * dst->stride[1],
+                                dst->width, uyvy);
+                else
+                        k->i420(s0, s1, l0, l1, dst->plane[1] + cr * dst->stride[1],
+                                dst->plane[2] + cr * dst->stride[2], dst->width, uyvy);
+        }
+        return 0;
+}
+
+#endif /* YUV_REPACK_H */
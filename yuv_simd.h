@@ -0,0 +1,58 @@
+// yuv_simd.h
+//
+// Building blocks shared by the Y'CbCr -> RGB24 SIMD kernels in
+// yuv_convert.cpp (8-bit YUYV) and yuv16_convert.cpp (10-bit P010). Both
+// compute each channel as (cy*Y' + chroma term + round) >> Shift in 32-bit
+// lanes and interleave 8 pixels per 128-bit lane into 24 bytes of RGB24;
+// only the fixed-point shift differs, so it is a template parameter.
+//
+// Internal to those two translation units; x86 only.
+#pragma once
+
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+// (U coefficient, V coefficient) as one pmaddwd operand.
+static constexpr int32_t coeff_pair(int u, int v) {
+    return int32_t(uint16_t(u) | uint32_t(uint16_t(v)) << 16);
+}
+
+// pshufb masks: R and G packed as [r0..r7 g0..g7] and B as [b0..b7 b0..b7]
+// become bytes 0..15 (rg0 | b0) and 16..23 (rg1 | b1) of RGB24.
+__attribute__((target("sse4.1"))) static inline __m128i shuffle_rg0() {
+    return _mm_setr_epi8(0, 8, -1, 1, 9, -1, 2, 10, -1, 3, 11, -1, 4, 12, -1, 5);
+}
+__attribute__((target("sse4.1"))) static inline __m128i shuffle_b0() {
+    return _mm_setr_epi8(-1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1);
+}
+__attribute__((target("sse4.1"))) static inline __m128i shuffle_rg1() {
+    return _mm_setr_epi8(13, -1, 6, 14, -1, 7, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+}
+__attribute__((target("sse4.1"))) static inline __m128i shuffle_b1() {
+    return _mm_setr_epi8(-1, 5, -1, -1, 6, -1, -1, 7, -1, -1, -1, -1, -1, -1, -1, -1);
+}
+
+// One channel of 8 pixels: the chroma term of each (U', V') pair, added to
+// the cy*Y' of both its pixels, shifted and saturated to 16 bits.
+template <int Shift>
+__attribute__((target("sse4.1"))) static inline __m128i
+channel_sse41(__m128i uv, __m128i k, __m128i round, __m128i y_lo, __m128i y_hi) {
+    __m128i ch = _mm_add_epi32(_mm_madd_epi16(uv, k), round);
+    __m128i lo = _mm_add_epi32(y_lo, _mm_shuffle_epi32(ch, _MM_SHUFFLE(1, 1, 0, 0)));
+    __m128i hi = _mm_add_epi32(y_hi, _mm_shuffle_epi32(ch, _MM_SHUFFLE(3, 3, 2, 2)));
+    return _mm_packs_epi32(_mm_srai_epi32(lo, Shift), _mm_srai_epi32(hi, Shift));
+}
+
+// The same on two independent 128-bit lanes.
+template <int Shift>
+__attribute__((target("avx2"))) static inline __m256i
+channel_avx2(__m256i uv, __m256i k, __m256i round, __m256i y_lo, __m256i y_hi) {
+    __m256i ch = _mm256_add_epi32(_mm256_madd_epi16(uv, k), round);
+    __m256i lo = _mm256_add_epi32(y_lo, _mm256_shuffle_epi32(ch, _MM_SHUFFLE(1, 1, 0, 0)));
+    __m256i hi = _mm256_add_epi32(y_hi, _mm256_shuffle_epi32(ch, _MM_SHUFFLE(3, 3, 2, 2)));
+    return _mm256_packs_epi32(_mm256_srai_epi32(lo, Shift), _mm256_srai_epi32(hi, Shift));
+}
+
+#endif
@@ -0,0 +1,558 @@
+// yuv_transform.cpp
+#include "yuv_transform.h"
+#include "worker_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define YUV_X86 1
+#include <immintrin.h>
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+//
+// === Vertical pass: source rows -> one YUYV row ===
+//
+// Works on the packed bytes as they are, so Y, U and V need no splitting.
+// Box adds up to 256 rows into 16-bit sums (255 * 256 still fits) and then
+// divides by the row count; bilinear blends two rows with 8-bit weights
+// summing to 256. Rows that need neither are used in place.
+
+static void add_row_scalar(uint16_t* acc, const uint8_t* s, int n, bool first) {
+    for (int i = 0; i < n; ++i) acc[i] = (first ? 0 : acc[i]) + s[i];
+}
+
+// d = acc * m / 65536, rounded; m = 65536 / rows, so rows >= 2.
+static void scale_row_scalar(uint8_t* d, const uint16_t* acc, int n, uint16_t m) {
+    for (int i = 0; i < n; ++i) d[i] = uint8_t((uint32_t(acc[i]) * m + 32768) >> 16);
+}
+
+static void lerp_rows_scalar(uint8_t* d, const uint8_t* a, const uint8_t* b, int f, int n) {
+    for (int i = 0; i < n; ++i) d[i] = uint8_t((a[i] * (256 - f) + b[i] * f + 128) >> 8);
+}
+
+#ifdef YUV_X86
+
+TARGET_SSE2 static void add_row_sse2(uint16_t* acc, const uint8_t* s, int n, bool first) {
+    const __m128i zero = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+        __m128i lo = _mm_unpacklo_epi8(in, zero), hi = _mm_unpackhi_epi8(in, zero);
+        __m128i* d = reinterpret_cast<__m128i*>(acc + i);
+        if (!first) {
+            lo = _mm_add_epi16(lo, _mm_loadu_si128(d));
+            hi = _mm_add_epi16(hi, _mm_loadu_si128(d + 1));
+        }
+        _mm_storeu_si128(d, lo);
+        _mm_storeu_si128(d + 1, hi);
+    }
+    add_row_scalar(acc + i, s + i, n - i, first);
+}
+
+// The high half of acc * m, plus one when the low half is >= 32768.
+TARGET_SSE2 static inline __m128i scale_sse2(__m128i acc, __m128i m) {
+    return _mm_add_epi16(_mm_mulhi_epu16(acc, m), _mm_srli_epi16(_mm_mullo_epi16(acc, m), 15));
+}
+
+TARGET_SSE2 static void scale_row_sse2(uint8_t* d, const uint16_t* acc, int n, uint16_t m) {
+    const __m128i vm = _mm_set1_epi16(int16_t(m));
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i lo = scale_sse2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(acc + i)), vm);
+        __m128i hi = scale_sse2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(acc + i + 8)), vm);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(d + i), _mm_packus_epi16(lo, hi));
+    }
+    scale_row_scalar(d + i, acc + i, n - i, m);
+}
+
+TARGET_SSE2 static void lerp_rows_sse2(uint8_t* d, const uint8_t* a, const uint8_t* b,
+                                       int f, int n) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i wa = _mm_set1_epi16(int16_t(256 - f)), wb = _mm_set1_epi16(int16_t(f));
+    const __m128i round = _mm_set1_epi16(128);
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        // Sums stay below 65536, so 16-bit lanes are exact.
+        __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(va, zero), wa),
+                                   _mm_mullo_epi16(_mm_unpacklo_epi8(vb, zero), wb));
+        __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(va, zero), wa),
+                                   _mm_mullo_epi16(_mm_unpackhi_epi8(vb, zero), wb));
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, round), 8);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, round), 8);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(d + i), _mm_packus_epi16(lo, hi));
+    }
+    lerp_rows_scalar(d + i, a + i, b + i, f, n - i);
+}
+
+// AVX2 packus works per 128-bit lane; widening with cvtepu8 and narrowing
+// the two halves separately keeps the bytes in order.
+TARGET_AVX2 static inline __m128i narrow_avx2(__m256i v) {
+    return _mm_packus_epi16(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+}
+
+TARGET_AVX2 static void add_row_avx2(uint16_t* acc, const uint8_t* s, int n, bool first) {
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i in = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i)));
+        __m256i* d = reinterpret_cast<__m256i*>(acc + i);
+        if (!first) in = _mm256_add_epi16(in, _mm256_loadu_si256(d));
+        _mm256_storeu_si256(d, in);
+    }
+    add_row_scalar(acc + i, s + i, n - i, first);
+}
+
+TARGET_AVX2 static void scale_row_avx2(uint8_t* d, const uint16_t* acc, int n, uint16_t m) {
+    const __m256i vm = _mm256_set1_epi16(int16_t(m));
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(acc + i));
+        v = _mm256_add_epi16(_mm256_mulhi_epu16(v, vm),
+                             _mm256_srli_epi16(_mm256_mullo_epi16(v, vm), 15));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(d + i), narrow_avx2(v));
+    }
+    scale_row_scalar(d + i, acc + i, n - i, m);
+}
+
+TARGET_AVX2 static void lerp_rows_avx2(uint8_t* d, const uint8_t* a, const uint8_t* b,
+                                       int f, int n) {
+    const __m256i wa = _mm256_set1_epi16(int16_t(256 - f)), wb = _mm256_set1_epi16(int16_t(f));
+    const __m256i round = _mm256_set1_epi16(128);
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i va = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)));
+        __m256i vb = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i)));
+        __m256i v  = _mm256_add_epi16(_mm256_mullo_epi16(va, wa), _mm256_mullo_epi16(vb, wb));
+        v = _mm256_srli_epi16(_mm256_add_epi16(v, round), 8);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(d + i), narrow_avx2(v));
+    }
+    lerp_rows_scalar(d + i, a + i, b + i, f, n - i);
+}
+
+#endif // YUV_X86
+
+//
+// === Sampling tables ===
+//
+
+// One output row: box covers source rows [i0, i1); bilinear blends i0 and
+// i1 with weight f/256 on i1.
+struct Tap {
+    int i0, i1, f;
+};
+
+static Tap box_tap(int o, int out, int in) {
+    int i0 = int(int64_t(o) * in / out);
+    int i1 = int(int64_t(o + 1) * in / out);
+    // Upscaling repeats a pixel; very large factors sample 256 of them.
+    i1 = std::clamp(i1, i0 + 1, i0 + 256);
+    return {i0, std::min(i1, in), 0};
+}
+
+// `pos` in input pixels, pixel centres at integers.
+static Tap linear_tap(double pos, int in) {
+    if (pos <= 0) return {0, 0, 0};
+    if (pos >= in - 1) return {in - 1, in - 1, 0};
+    const int i0 = int(pos);
+    int f = int(std::lround((pos - i0) * 256));
+    if (f == 256) return {i0 + 1, i0 + 1, 0};
+    return {i0, i0 + 1, f};
+}
+
+static double centre(int o, int out, int in) {
+    return (o + 0.5) * in / out - 0.5;
+}
+
+// One output YUYV pair. Box: source pixels [y0, y0_end) and [y1, y1_end)
+// for the two lumas and [c, c_end) for the chroma, each with its
+// 2^24/count. Bilinear: byte offsets of the two taps of each sample in
+// the vertically filtered row, and w the weight of the second.
+struct PairTap {
+    int      y0, y0_end, y1, y1_end, c, c_end;
+    uint32_t w_y0, w_y1, w_c;
+};
+
+struct Plan {
+    FrameTransform        t;
+    int                   sw, sh;       // output size before rotation
+    int                   row_bytes;    // YUYV bytes of one cropped row
+    bool                  resample_x;   // false: output width == crop width
+    std::vector<PairTap>  pairs;
+    std::vector<Tap>      rows;         // per output row
+    // Bilinear, for the SIMD kernel: the leading pairs whose 4-byte luma
+    // and 8-byte chroma reads stay inside the row, as separate arrays of
+    // first-tap offsets and (256 - f) | f << 16 weights.
+    int                   simd_pairs = 0;
+    std::vector<int32_t>  col_y0, col_y1, col_c;
+    std::vector<int32_t>  w_y0, w_y1, w_c;
+};
+
+static uint32_t recip24(int n) {
+    return uint32_t(((1u << 24) + n / 2) / n);
+}
+
+static Plan make_plan(const FrameTransform& t) {
+    Plan p;
+    p.t = t;
+    const bool turned = t.rotate == Rotation::R90 || t.rotate == Rotation::R270;
+    p.sw = turned ? t.out_h : t.out_w;
+    p.sh = turned ? t.out_w : t.out_h;
+    // Whole pairs, so the last pixel of an odd-width crop has its chroma.
+    p.row_bytes  = (t.crop_w + 1) / 2 * 4;
+    p.resample_x = p.sw != t.crop_w;
+    p.rows.resize(p.sh);
+    p.pairs.resize((p.sw + 1) / 2);
+    const bool box = t.filter == Resample::Box;
+    for (int v = 0; v < p.sh; ++v)
+        p.rows[v] = box ? box_tap(v, p.sh, t.crop_h)
+                        : linear_tap(centre(v, p.sh, t.crop_h), t.crop_h);
+    const int last = p.sw - 1, chroma_w = (t.crop_w + 1) / 2;
+    for (size_t i = 0; i < p.pairs.size(); ++i) {
+        const int u = int(i) * 2;
+        PairTap& pt = p.pairs[i];
+        if (box) {
+            // Chroma covers both pixels' footprint, one sample per luma pixel.
+            const Tap a = box_tap(u, p.sw, t.crop_w);
+            const Tap b = box_tap(std::min(u + 1, last), p.sw, t.crop_w);
+            pt = {a.i0, a.i1, b.i0, b.i1, a.i0, std::max(a.i1, b.i1),
+                  recip24(a.i1 - a.i0), recip24(b.i1 - b.i0),
+                  recip24(std::max(a.i1, b.i1) - a.i0)};
+        } else {
+            const double x = centre(u, p.sw, t.crop_w);
+            const Tap a = linear_tap(x, t.crop_w);
+            const Tap b = linear_tap(centre(std::min(u + 1, last), p.sw, t.crop_w), t.crop_w);
+            const Tap c = linear_tap(x / 2, chroma_w);
+            pt = {a.i0 * 2, a.i1 * 2, b.i0 * 2, b.i1 * 2, c.i0 * 4 + 1, c.i1 * 4 + 1,
+                  uint32_t(a.f), uint32_t(b.f), uint32_t(c.f)};
+        }
+    }
+    if (!box) {
+        // Taps are monotonic, so the safe pairs are a prefix.
+        for (const PairTap& pt : p.pairs) {
+            if (pt.y1 + 4 > p.row_bytes || pt.c + 8 > p.row_bytes) break;
+            p.col_y0.push_back(pt.y0);
+            p.col_y1.push_back(pt.y1);
+            p.col_c.push_back(pt.c);
+            p.w_y0.push_back(int32_t((256 - pt.w_y0) | pt.w_y0 << 16));
+            p.w_y1.push_back(int32_t((256 - pt.w_y1) | pt.w_y1 << 16));
+            p.w_c.push_back(int32_t((256 - pt.w_c) | pt.w_c << 16));
+        }
+        p.simd_pairs = int(p.col_y0.size());
+    }
+    return p;
+}
+
+// Where output pixel (u, v) of the unrotated image lands.
+static void place(const Plan& p, int u, int v, int& x, int& y) {
+    if (p.t.mirror) u = p.sw - 1 - u;
+    if (p.t.flip)   v = p.sh - 1 - v;
+    x = u;
+    y = v;
+    switch (p.t.rotate) {
+    case Rotation::R0:                                           break;
+    case Rotation::R90:  x = p.sh - 1 - v;   y = u;              break;
+    case Rotation::R180: x = p.sw - 1 - u;   y = p.sh - 1 - v;   break;
+    case Rotation::R270: x = v;              y = p.sw - 1 - u;   break;
+    }
+}
+
+//
+// === Horizontal pass ===
+//
+// Filters the YUYV row down to sw pixels of YUYV again, chroma once per
+// output pair, so the SIMD yuyv_to_rgb24() kernels do the colour
+// conversion. The pixel on its own at the end of an odd width gets a pair
+// to itself.
+
+static inline uint8_t box_avg(uint32_t sum, uint32_t recip) {
+    return uint8_t((uint64_t(sum) * recip + (1u << 23)) >> 24);
+}
+
+static void box_row(const Plan& p, const uint8_t* line, uint8_t* out) {
+    for (const PairTap& t : p.pairs) {
+        uint32_t y0 = 0, y1 = 0, cb = 0, cr = 0;
+        for (int x = t.y0; x < t.y0_end; ++x) y0 += line[x * 2];
+        for (int x = t.y1; x < t.y1_end; ++x) y1 += line[x * 2];
+        for (int x = t.c; x < t.c_end; ++x) {
+            const uint8_t* pair = line + (x >> 1) * 4;
+            cb += pair[1];
+            cr += pair[3];
+        }
+        out[0] = box_avg(y0, t.w_y0);
+        out[1] = box_avg(cb, t.w_c);
+        out[2] = box_avg(y1, t.w_y1);
+        out[3] = box_avg(cr, t.w_c);
+        out += 4;
+    }
+}
+
+static inline uint8_t lerp(const uint8_t* line, int i0, int i1, uint32_t f) {
+    return uint8_t((line[i0] * (256 - f) + line[i1] * f + 128) >> 8);
+}
+
+// Pairs [first, end) of the row.
+static void bilinear_pairs(const Plan& p, const uint8_t* line, uint8_t* out, size_t first) {
+    out += first * 4;
+    for (size_t i = first; i < p.pairs.size(); ++i) {
+        const PairTap& t = p.pairs[i];
+        out[0] = lerp(line, t.y0, t.y0_end, t.w_y0);
+        out[1] = lerp(line, t.c, t.c_end, t.w_c);
+        out[2] = lerp(line, t.y1, t.y1_end, t.w_y1);
+        out[3] = lerp(line, t.c + 2, t.c_end + 2, t.w_c);
+        out += 4;
+    }
+}
+
+static int bilinear_cols_none(const Plan&, const uint8_t*, uint8_t*) {
+    return 0;
+}
+
+#ifdef YUV_X86
+
+// AVX2, 8 output pairs per iteration. Bilinear taps are neighbours, so one
+// gathered dword holds both luma taps (bytes 0 and 2) and two hold both
+// chroma taps; masking to the even bytes leaves (tap0, tap1) pairs of
+// 16-bit lanes that one pmaddwd blends with the (256 - f, f) weights.
+TARGET_AVX2 static inline __m256i blend_avx2(__m256i taps, const int32_t* w) {
+    const __m256i round = _mm256_set1_epi32(128);
+    __m256i v = _mm256_madd_epi16(taps, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(w)));
+    return _mm256_srli_epi32(_mm256_add_epi32(v, round), 8);
+}
+
+TARGET_AVX2 static inline __m256i load8(const std::vector<int32_t>& v, int i) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(v.data() + i));
+}
+
+TARGET_AVX2 static int bilinear_cols_avx2(const Plan& p, const uint8_t* line, uint8_t* out) {
+    const int*    base = reinterpret_cast<const int*>(line);
+    const __m256i even = _mm256_set1_epi32(0x00ff00ff);
+    const __m256i lo8  = _mm256_set1_epi32(0x000000ff);
+    int i = 0;
+    for (; i + 8 <= p.simd_pairs; i += 8) {
+        const __m256i c  = load8(p.col_c, i);
+        __m256i y0 = _mm256_and_si256(_mm256_i32gather_epi32(base, load8(p.col_y0, i), 1), even);
+        __m256i y1 = _mm256_and_si256(_mm256_i32gather_epi32(base, load8(p.col_y1, i), 1), even);
+        __m256i ca = _mm256_i32gather_epi32(base, c, 1);          // U0 . V0 .
+        __m256i cb = _mm256_i32gather_epi32(base, _mm256_add_epi32(c, _mm256_set1_epi32(4)), 1);
+        __m256i u  = _mm256_or_si256(_mm256_and_si256(ca, lo8),
+                                     _mm256_slli_epi32(_mm256_and_si256(cb, lo8), 16));
+        __m256i v  = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(ca, 16), lo8),
+                                     _mm256_and_si256(cb, _mm256_set1_epi32(0x00ff0000)));
+        y0 = blend_avx2(y0, p.w_y0.data() + i);
+        y1 = blend_avx2(y1, p.w_y1.data() + i);
+        u  = blend_avx2(u, p.w_c.data() + i);
+        v  = blend_avx2(v, p.w_c.data() + i);
+        __m256i yuyv = _mm256_or_si256(_mm256_or_si256(y0, _mm256_slli_epi32(u, 8)),
+                                       _mm256_or_si256(_mm256_slli_epi32(y1, 16),
+                                                       _mm256_slli_epi32(v, 24)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i * 4), yuyv);
+    }
+    return i;
+}
+
+#endif // YUV_X86
+
+struct TransformKernel {
+    const char* name;
+    void (*add_row)(uint16_t*, const uint8_t*, int, bool);
+    void (*scale_row)(uint8_t*, const uint16_t*, int, uint16_t);
+    void (*lerp_rows)(uint8_t*, const uint8_t*, const uint8_t*, int, int);
+    // Leading bilinear output pairs done with SIMD; the rest are scalar.
+    int  (*bilinear_cols)(const Plan&, const uint8_t*, uint8_t*);
+};
+
+static const TransformKernel& transform_kernel() {
+    static const TransformKernel k = [] {
+#ifdef YUV_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            return TransformKernel{"avx2", add_row_avx2, scale_row_avx2, lerp_rows_avx2,
+                                   bilinear_cols_avx2};
+        if (__builtin_cpu_supports("sse2"))
+            return TransformKernel{"sse2", add_row_sse2, scale_row_sse2, lerp_rows_sse2,
+                                   bilinear_cols_none};
+#endif
+        return TransformKernel{"scalar", add_row_scalar, scale_row_scalar, lerp_rows_scalar,
+                               bilinear_cols_none};
+    }();
+    return k;
+}
+
+const char* yuv_transform_isa() {
+    return transform_kernel().name;
+}
+
+
+//
+// === Frame entry points ===
+//
+
+bool frame_transform_resolve(FrameTransform& t, int src_w, int src_h) {
+    t.crop_x = std::clamp(t.crop_x, 0, std::max(0, src_w - 1)) & ~1;
+    t.crop_y = std::clamp(t.crop_y, 0, std::max(0, src_h - 1));
+    if (t.crop_w <= 0 || t.crop_x + t.crop_w > src_w) t.crop_w = src_w - t.crop_x;
+    if (t.crop_h <= 0 || t.crop_y + t.crop_h > src_h) t.crop_h = src_h - t.crop_y;
+    if (t.crop_w <= 0 || t.crop_h <= 0) return false;
+
+    const bool turned = t.rotate == Rotation::R90 || t.rotate == Rotation::R270;
+    const int w = turned ? t.crop_h : t.crop_w;
+    const int h = turned ? t.crop_w : t.crop_h;
+    if (t.out_w <= 0 && t.out_h <= 0) {
+        t.out_w = w;
+        t.out_h = h;
+    } else if (t.out_w <= 0) {
+        t.out_w = std::max(1, int(int64_t(t.out_h) * w / h));
+    } else if (t.out_h <= 0) {
+        t.out_h = std::max(1, int(int64_t(t.out_w) * h / w));
+    }
+    return true;
+}
+
+bool is_transform_option(const char* option) {
+    for (const char* o : {"--size", "--crop", "--rotate", "--flip", "--filter"})
+        if (!strcmp(option, o)) return true;
+    return false;
+}
+
+bool parse_transform_option(const char* option, const char* value, FrameTransform& t) {
+    char end;
+    if (!strcmp(option, "--size"))
+        return sscanf(value, "%dx%d%c", &t.out_w, &t.out_h, &end) == 2 &&
+               t.out_w >= 0 && t.out_h >= 0;
+    if (!strcmp(option, "--crop"))
+        return sscanf(value, "%dx%d+%d+%d%c", &t.crop_w, &t.crop_h, &t.crop_x, &t.crop_y,
+                      &end) == 4 &&
+               t.crop_w > 0 && t.crop_h > 0 && t.crop_x >= 0 && t.crop_y >= 0;
+    if (!strcmp(option, "--rotate")) {
+        static const struct { const char* name; Rotation r; } rotations[] = {
+            {"0", Rotation::R0}, {"90", Rotation::R90},
+            {"180", Rotation::R180}, {"270", Rotation::R270},
+        };
+        for (const auto& r : rotations)
+            if (!strcmp(value, r.name)) { t.rotate = r.r; return true; }
+        return false;
+    }
+    if (!strcmp(option, "--flip")) {
+        if (!strcmp(value, "h")) t.mirror = true;
+        else if (!strcmp(value, "v")) t.flip = true;
+        else return false;
+        return true;
+    }
+    if (!strcmp(option, "--filter")) {
+        if (!strcmp(value, "box")) t.filter = Resample::Box;
+        else if (!strcmp(value, "bilinear")) t.filter = Resample::Bilinear;
+        else return false;
+        return true;
+    }
+    return false;
+}
+
+void yuyv_to_rgb24_transform(const uint8_t* src, size_t src_stride, int src_w, int src_h,
+                             uint8_t* dst, size_t dst_stride, const FrameTransform& t,
+                             YuvColorimetry cm, WorkerPool& pool) {
+    FrameTransform resolved = t;
+    if (!frame_transform_resolve(resolved, src_w, src_h)) return;
+    const Plan p = make_plan(resolved);
+    const TransformKernel& k = transform_kernel();
+    const bool box = resolved.filter == Resample::Box;
+    const int even_w = (p.sw + 1) & ~1;
+    src += size_t(resolved.crop_y) * src_stride + size_t(resolved.crop_x) * 2;
+
+    // The mapping is affine: dst moves by du bytes per output pixel of an
+    // unrotated row and by dv per row. Rows that keep their order in dst
+    // are converted in place, mirrored ones copied back to front. Rotated
+    // rows land in dst columns, so they are collected in tiles of TILE_ROWS
+    // and written out as runs of TILE_ROWS pixels per dst row.
+    auto at = [&](int u, int v) {
+        int x, y;
+        place(p, u, v, x, y);
+        return dst + size_t(y) * dst_stride + size_t(x) * 3;
+    };
+    const ptrdiff_t du = at(1, 0) - at(0, 0);
+    const ptrdiff_t dv = at(0, 1) - at(0, 0);
+    const bool turned = resolved.rotate == Rotation::R90 || resolved.rotate == Rotation::R270;
+    const bool direct = !turned && (du == 3 || p.sw == 1);
+    constexpr int TILE_ROWS = 16;
+
+    const unsigned stripes = std::min<unsigned>(p.sh, pool.size() * 4);
+    pool.run(stripes, [&](unsigned s) {
+        thread_local std::vector<uint16_t> acc;
+        thread_local std::vector<uint8_t>  line, yuyv, tile;
+        acc.resize(p.row_bytes);
+        line.resize(p.row_bytes);
+        yuyv.resize(size_t(even_w) * 2);
+        const size_t tile_stride = size_t(even_w) * 3;
+        // One spare byte for the 4-byte pixel copies below.
+        tile.resize(tile_stride * (turned ? TILE_ROWS : 1) + 1);
+        const int v_begin = int(int64_t(s) * p.sh / stripes);
+        const int v_end   = int(int64_t(s + 1) * p.sh / stripes);
+
+        // dv is +-3 here. Each run is assembled in ascending address order,
+        // so a 4-byte copy only spills into the pixel written next.
+        auto flush = [&](int v0, int rows) {
+            uint8_t run[TILE_ROWS * 3 + 1];
+            uint8_t* d = at(0, v0) + (dv < 0 ? (rows - 1) * dv : 0);
+            for (int u = 0; u < p.sw; ++u, d += du) {
+                const uint8_t* cell = tile.data() + u * 3;
+                for (int i = 0; i < rows; ++i)
+                    memcpy(run + i * 3, cell + (dv < 0 ? rows - 1 - i : i) * tile_stride, 4);
+                memcpy(d, run, size_t(rows) * 3);
+            }
+        };
+
+        for (int v = v_begin; v < v_end; ++v) {
+            const Tap& r = p.rows[v];
+            const uint8_t* in = src + r.i0 * src_stride;
+            if (box && r.i1 - r.i0 > 1) {
+                for (int y = r.i0; y < r.i1; ++y)
+                    k.add_row(acc.data(), src + y * src_stride, p.row_bytes, y == r.i0);
+                k.scale_row(line.data(), acc.data(), p.row_bytes,
+                             uint16_t((65536 + (r.i1 - r.i0) / 2) / (r.i1 - r.i0)));
+                in = line.data();
+            } else if (!box && r.f) {
+                k.lerp_rows(line.data(), in, src + r.i1 * src_stride, r.f, p.row_bytes);
+                in = line.data();
+            }
+            if (p.resample_x) {
+                if (box)
+                    box_row(p, in, yuyv.data());
+                else
+                    bilinear_pairs(p, in, yuyv.data(), k.bilinear_cols(p, in, yuyv.data()));
+                in = yuyv.data();
+            }
+
+            if (turned) {
+                const int tile_row = (v - v_begin) % TILE_ROWS;
+                yuyv_to_rgb24(in, 0, tile.data() + tile_row * tile_stride, 0, even_w, 1, cm);
+                if (tile_row == TILE_ROWS - 1 || v == v_end - 1)
+                    flush(v - tile_row, tile_row + 1);
+                continue;
+            }
+            uint8_t* d = at(0, v);
+            if (direct && p.sw == even_w) {
+                yuyv_to_rgb24(in, 0, d, 0, p.sw, 1, cm);
+                continue;
+            }
+            yuyv_to_rgb24(in, 0, tile.data(), 0, even_w, 1, cm);
+            if (direct) {
+                memcpy(d, tile.data(), size_t(p.sw) * 3);
+                continue;
+            }
+            for (int u = 0; u < p.sw; ++u, d += du)
+                memcpy(d, tile.data() + u * 3, 3);
+        }
+    });
+}
+
+void yuyv_to_rgb24_transform(const FrameView& src, uint8_t* dst, size_t dst_stride,
+                             const FrameTransform& t, YuvColorimetry cm, WorkerPool& pool) {
+    yuyv_to_rgb24_transform(src.plane[0], src.stride[0], src.width, src.height, dst, dst_stride,
+                            t, cm, pool);
+}
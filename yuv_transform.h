@@ -0,0 +1,63 @@
+// yuv_transform.h
+//
+// YUYV to RGB24 with crop, resampling, mirroring and rotation fused into
+// one pass, for previews that are smaller than (or turned relative to) the
+// camera frame. Each output row is built straight from the source rows it
+// covers:
+//   - a vertical pass blends those rows into one row of 16-bit sums,
+//     still in packed YUYV order (SIMD; this is the only pass that reads
+//     the source, and it reads each byte once when downscaling),
+//   - a horizontal pass filters that row down to the output width,
+//   - only the output pixels go through the colour matrix, and each one is
+//     stored directly at its mirrored/rotated position.
+// No full-size RGB frame is ever built, so a 1080p camera feeding a 480p
+// tile costs little more than reading the camera frame.
+//
+// Box averages all the source pixels an output pixel covers (the right
+// choice for downscaling); bilinear interpolates the nearest two rows and
+// columns (any scale, but aliases below half size). Chroma is filtered on
+// its own half-width grid, co-sited with the even luma pixels.
+#pragma once
+
+#include "yuv_convert.h"
+
+enum class Resample { Box, Bilinear };
+enum class Rotation { R0, R90, R180, R270 };   // clockwise
+
+struct FrameTransform {
+    // Source rectangle; a width or height of 0 extends to the frame edge.
+    // crop_x is rounded down to even so the crop starts on a YUYV pair.
+    int      crop_x = 0, crop_y = 0, crop_w = 0, crop_h = 0;
+    // Output size, after rotation. 0 for both = the (rotated) crop size;
+    // 0 for one of them keeps the crop's aspect ratio.
+    int      out_w = 0, out_h = 0;
+    bool     mirror = false;    // left-right, applied before rotating
+    bool     flip   = false;    // top-bottom, applied before rotating
+    Rotation rotate = Rotation::R0;
+    Resample filter = Resample::Bilinear;
+};
+
+// Fill in the defaults of `t` for a `src_w` x `src_h` frame and clamp the
+// crop to it. Returns false if the crop or output would be empty.
+bool frame_transform_resolve(FrameTransform& t, int src_w, int src_h);
+
+// True for the demos' transform options, which take one value each:
+//   --size WxH  --crop WxH+X+Y  --rotate 0|90|180|270  --flip h|v
+//   --filter box|bilinear
+bool is_transform_option(const char* option);
+// Apply one of them to `t`; false for a malformed value.
+bool parse_transform_option(const char* option, const char* value, FrameTransform& t);
+
+// Convert the crop of a `src_w` x `src_h` YUYV frame into an out_w x out_h
+// RGB24 image, in row stripes on `pool`. `t` is resolved first, so an
+// unresolved transform works too.
+void yuyv_to_rgb24_transform(const uint8_t* src, size_t src_stride, int src_w, int src_h,
+                             uint8_t* dst, size_t dst_stride, const FrameTransform& t,
+                             YuvColorimetry cm, WorkerPool& pool);
+
+// Same, for a YUYV view.
+void yuyv_to_rgb24_transform(const FrameView& src, uint8_t* dst, size_t dst_stride,
+                             const FrameTransform& t, YuvColorimetry cm, WorkerPool& pool);
+
+// Name of the kernels in use: "avx2", "sse2" or "scalar".
+const char* yuv_transform_isa();